@@ -0,0 +1,148 @@
+#pragma once
+
+// The compiler looks these up in std when it lowers co_await/co_return, so unlike everything
+// else in here they can't live in stl. Enough of <coroutine> for our own task types, built on
+// the same GCC builtins libstdc++ uses. Don't include this together with <coroutine>.
+
+namespace std
+{
+
+template<typename TResult, typename... TArgs>
+struct coroutine_traits
+{
+    using promise_type = typename TResult::promise_type;
+};
+
+template<typename TPromise = void>
+struct coroutine_handle;
+
+template<>
+struct coroutine_handle<void>
+{
+    constexpr coroutine_handle() noexcept = default;
+    constexpr coroutine_handle(decltype(nullptr)) noexcept {}
+
+    static constexpr coroutine_handle from_address(void* address) noexcept
+    {
+        coroutine_handle handle;
+        handle.m_frame = address;
+
+        return handle;
+    }
+
+    constexpr void* address() const noexcept { return m_frame; }
+    constexpr explicit operator bool() const noexcept { return m_frame != nullptr; }
+
+    bool done() const { return __builtin_coro_done(m_frame); }
+    void resume() const { __builtin_coro_resume(m_frame); }
+    void destroy() const { __builtin_coro_destroy(m_frame); }
+    void operator()() const { resume(); }
+
+protected:
+    void* m_frame = nullptr;
+};
+
+template<typename TPromise>
+struct coroutine_handle : coroutine_handle<void>
+{
+    constexpr coroutine_handle() noexcept = default;
+    constexpr coroutine_handle(decltype(nullptr)) noexcept {}
+
+    static coroutine_handle from_promise(TPromise& promise) noexcept
+    {
+        coroutine_handle handle;
+        handle.m_frame = __builtin_coro_promise(reinterpret_cast<char*>(&promise), __alignof(TPromise), true);
+
+        return handle;
+    }
+
+    static constexpr coroutine_handle from_address(void* address) noexcept
+    {
+        coroutine_handle handle;
+        handle.m_frame = address;
+
+        return handle;
+    }
+
+    TPromise& promise() const
+    {
+        return *static_cast<TPromise*>(__builtin_coro_promise(m_frame, __alignof(TPromise), false));
+    }
+};
+
+constexpr bool operator==(coroutine_handle<> a, coroutine_handle<> b) noexcept
+{
+    return a.address() == b.address();
+}
+
+struct noop_coroutine_promise {};
+
+namespace detail
+{
+
+inline void noopResumeOrDestroy(void*) {}
+
+// GCC frames start with the resume and destroy functions, so this is all a frame needs to
+// be for resuming it to do nothing.
+struct NoopFrame
+{
+    void (*resume)(void*) = &noopResumeOrDestroy;
+    void (*destroy)(void*) = &noopResumeOrDestroy;
+    noop_coroutine_promise promise;
+};
+
+inline NoopFrame g_noopFrame;
+
+}
+
+// Resuming it does nothing. Handy as the symmetric transfer target when there's nobody to go back to.
+template<>
+struct coroutine_handle<noop_coroutine_promise> : coroutine_handle<void>
+{
+    constexpr bool done() const noexcept { return false; }
+    void resume() const noexcept {}
+    void destroy() const noexcept {}
+
+private:
+    friend coroutine_handle noop_coroutine() noexcept;
+
+    coroutine_handle() noexcept
+    {
+        m_frame = &detail::g_noopFrame;
+    }
+};
+
+using noop_coroutine_handle = coroutine_handle<noop_coroutine_promise>;
+
+inline noop_coroutine_handle noop_coroutine() noexcept
+{
+    return noop_coroutine_handle();
+}
+
+struct suspend_always
+{
+    constexpr bool await_ready() const noexcept { return false; }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+struct suspend_never
+{
+    constexpr bool await_ready() const noexcept { return true; }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+}
+
+namespace stl
+{
+
+template<typename TPromise = void>
+using CoroutineHandle = std::coroutine_handle<TPromise>;
+
+using std::noop_coroutine;
+using SuspendAlways = std::suspend_always;
+using SuspendNever = std::suspend_never;
+
+}
@@ -0,0 +1,545 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "TypeTraits.h"
+
+// printf-style formatting with the format string parsed at compile time. Every call site gets
+// its own formatting code with the literal text and the conversions baked in, the arguments
+// are checked against the conversions, and nothing goes through varargs:
+//
+//     stl::format<"rip: %016lx\n">(buffer, sizeof(buffer), ctx->ip);
+//
+// Supports the flags -, 0, + and #, widths and precisions (also as * arguments), the length
+// modifiers hh, h, l, ll, z, j and t, and the conversions d, i, u, x, X, c, s, p and %%.
+namespace stl
+{
+
+template<size_t N>
+struct FormatString
+{
+    char data[N] = {};
+
+    constexpr FormatString(const char (&string)[N])
+    {
+        for (size_t i = 0; i < N; i++) {
+            data[i] = string[i];
+        }
+    }
+
+    constexpr size_t length() const
+    {
+        return N - 1;
+    }
+};
+
+// Where formatted text goes. Without a flush function, whatever doesn't fit is dropped (but
+// still counted); with one, the buffer is handed over every time it fills up.
+class FormatBuffer
+{
+public:
+    using Flush = void (*)(const char* data, size_t length);
+
+    FormatBuffer(char* data, size_t size, Flush flush = nullptr) :
+        m_data(data), m_size(size), m_flush(flush) {}
+
+    void put(char c)
+    {
+        if (m_used == m_size && !makeRoom()) {
+            m_total++;
+            return;
+        }
+
+        m_data[m_used++] = c;
+        m_total++;
+    }
+
+    void write(const char* text, size_t length)
+    {
+        while (length > 0) {
+            if (m_used == m_size && !makeRoom()) {
+                m_total += length;
+                return;
+            }
+
+            auto chunk = (length < m_size - m_used) ? length : m_size - m_used;
+
+            for (size_t i = 0; i < chunk; i++) {
+                m_data[m_used + i] = text[i];
+            }
+
+            m_used += chunk;
+            m_total += chunk;
+            text += chunk;
+            length -= chunk;
+        }
+    }
+
+    void fill(char c, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            put(c);
+        }
+    }
+
+    // Hands what's left to the flush function, if there is one. Returns the length of
+    // everything that was formatted, whether it fit or not.
+    size_t finish()
+    {
+        if (m_flush && m_used > 0) {
+            makeRoom();
+        }
+
+        return m_total;
+    }
+
+    size_t used() const
+    {
+        return m_used;
+    }
+
+private:
+    bool makeRoom()
+    {
+        if (!m_flush || m_size == 0) {
+            return false;
+        }
+
+        m_flush(m_data, m_used);
+        m_used = 0;
+        return true;
+    }
+
+    char* m_data;
+    size_t m_size;
+    size_t m_used = 0;
+    size_t m_total = 0;
+    Flush m_flush;
+};
+
+namespace detail::format
+{
+
+// A run of literal text, or one conversion. Has to stay usable as a template argument.
+struct Piece
+{
+    size_t start = 0;           // literal text only
+    size_t length = 0;
+    char conversion = 0;        // 0 for literal text
+    bool leftAlign = false;
+    bool zeroPad = false;
+    bool plus = false;
+    bool alternate = false;
+    bool widthArgument = false;
+    bool precisionArgument = false;
+    int width = 0;
+    int precision = -1;
+    size_t size = 4;            // bytes the length modifier asks for
+};
+
+template<size_t N>
+struct Parsed
+{
+    Piece pieces[N ? N : 1];
+    size_t count = N;
+    size_t arguments = 0;
+};
+
+// Not constexpr, so reaching it while parsing fails the build right at the offending line.
+void invalidFormat(const char* reason);
+
+// Splits the format into pieces, or just counts them when pieces is null.
+constexpr size_t parse(const char* format, size_t length, Piece* pieces)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        Piece piece;
+
+        if (format[i] != '%') {
+            piece.start = i;
+
+            while (i < length && format[i] != '%') {
+                i++;
+            }
+
+            piece.length = i - piece.start;
+        } else if (i + 1 < length && format[i + 1] == '%') {
+            piece.start = i + 1;
+            piece.length = 1;
+            i += 2;
+        } else {
+            i++;
+
+            for (bool flags = true; flags && i < length; ) {
+                switch (format[i]) {
+                case '-': piece.leftAlign = true; i++; break;
+                case '0': piece.zeroPad = true; i++; break;
+                case '+': piece.plus = true; i++; break;
+                case '#': piece.alternate = true; i++; break;
+                default: flags = false; break;
+                }
+            }
+
+            if (i < length && format[i] == '*') {
+                piece.widthArgument = true;
+                i++;
+            }
+
+            while (i < length && format[i] >= '0' && format[i] <= '9') {
+                piece.width = piece.width * 10 + (format[i++] - '0');
+            }
+
+            if (i < length && format[i] == '.') {
+                piece.precision = 0;
+                i++;
+
+                if (i < length && format[i] == '*') {
+                    piece.precisionArgument = true;
+                    i++;
+                }
+
+                while (i < length && format[i] >= '0' && format[i] <= '9') {
+                    piece.precision = piece.precision * 10 + (format[i++] - '0');
+                }
+            }
+
+            if (i < length && format[i] == 'h') {
+                piece.size = 2;
+                i++;
+
+                if (i < length && format[i] == 'h') {
+                    piece.size = 1;
+                    i++;
+                }
+            } else if (i < length && (format[i] == 'l' || format[i] == 'z' || format[i] == 'j' || format[i] == 't')) {
+                piece.size = 8;
+                i++;
+
+                if (i < length && format[i - 1] == 'l' && format[i] == 'l') {
+                    i++;
+                }
+            }
+
+            if (i == length) {
+                invalidFormat("conversion at the end of the format");
+            }
+
+            switch (format[i]) {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'c':
+            case 's':
+            case 'p':
+                piece.conversion = format[i++];
+                break;
+
+            default:
+                invalidFormat("unsupported conversion");
+            }
+        }
+
+        if (pieces) {
+            pieces[count] = piece;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+template<FormatString Format>
+constexpr auto makeParsed()
+{
+    constexpr auto count = parse(Format.data, Format.length(), nullptr);
+
+    Parsed<count> parsed;
+    parse(Format.data, Format.length(), parsed.pieces);
+
+    for (size_t i = 0; i < count; i++) {
+        auto& piece = parsed.pieces[i];
+
+        if (piece.conversion) {
+            parsed.arguments += 1 + piece.widthArgument + piece.precisionArgument;
+        }
+    }
+
+    return parsed;
+}
+
+template<FormatString Format>
+constexpr auto PARSED = makeParsed<Format>();
+
+struct DigitPairs
+{
+    char decimal[200];
+    char hex[512];
+    char hexUpper[512];
+};
+
+constexpr DigitPairs makeDigitPairs()
+{
+    DigitPairs pairs{};
+
+    for (size_t i = 0; i < 100; i++) {
+        pairs.decimal[2 * i] = static_cast<char>('0' + i / 10);
+        pairs.decimal[2 * i + 1] = static_cast<char>('0' + i % 10);
+    }
+
+    for (size_t i = 0; i < 256; i++) {
+        pairs.hex[2 * i] = "0123456789abcdef"[i >> 4];
+        pairs.hex[2 * i + 1] = "0123456789abcdef"[i & 0xf];
+        pairs.hexUpper[2 * i] = "0123456789ABCDEF"[i >> 4];
+        pairs.hexUpper[2 * i + 1] = "0123456789ABCDEF"[i & 0xf];
+    }
+
+    return pairs;
+}
+
+// two digits per lookup, so a 64-bit number takes at most 10 divisions instead of 20
+inline constexpr DigitPairs DIGIT_PAIRS = makeDigitPairs();
+
+// Both write the digits so they end right before end, and return where they start.
+inline char* decimalDigits(char* end, uint64_t value)
+{
+    while (value >= 100) {
+        auto pair = &DIGIT_PAIRS.decimal[2 * (value % 100)];
+        value /= 100;
+
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+
+    if (value >= 10) {
+        *--end = DIGIT_PAIRS.decimal[2 * value + 1];
+        *--end = DIGIT_PAIRS.decimal[2 * value];
+    } else {
+        *--end = static_cast<char>('0' + value);
+    }
+
+    return end;
+}
+
+inline char* hexDigits(char* end, uint64_t value, bool upper)
+{
+    auto table = upper ? DIGIT_PAIRS.hexUpper : DIGIT_PAIRS.hex;
+
+    while (value >= 0x100) {
+        auto pair = &table[2 * (value & 0xff)];
+        value >>= 8;
+
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+
+    *--end = table[2 * value + 1];
+    if (value >= 0x10) {
+        *--end = table[2 * value];
+    }
+
+    return end;
+}
+
+inline void writePadded(FormatBuffer& out, const char* prefix, size_t prefixLength, const char* digits,
+    size_t count, int width, int precision, bool leftAlign, bool zeroPad)
+{
+    size_t zeroes = (precision > 0 && static_cast<size_t>(precision) > count) ? static_cast<size_t>(precision) - count : 0;
+    size_t length = prefixLength + zeroes + count;
+    size_t padding = (width > 0 && static_cast<size_t>(width) > length) ? static_cast<size_t>(width) - length : 0;
+
+    // the 0 flag pads between the sign and the digits, and a precision turns it off
+    if (zeroPad && !leftAlign && precision < 0) {
+        zeroes += padding;
+        padding = 0;
+    }
+
+    if (!leftAlign) {
+        out.fill(' ', padding);
+    }
+
+    out.write(prefix, prefixLength);
+    out.fill('0', zeroes);
+    out.write(digits, count);
+
+    if (leftAlign) {
+        out.fill(' ', padding);
+    }
+}
+
+// Narrows like printf() would have through varargs, a %hhx of -1 is ff.
+template<size_t Size, typename T>
+uint64_t asUnsigned(T value)
+{
+    if constexpr (Size == 1) {
+        return static_cast<uint8_t>(value);
+    } else if constexpr (Size == 2) {
+        return static_cast<uint16_t>(value);
+    } else if constexpr (Size == 4) {
+        return static_cast<uint32_t>(value);
+    } else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+template<size_t Size, typename T>
+int64_t asSigned(T value)
+{
+    if constexpr (Size == 1) {
+        return static_cast<int8_t>(value);
+    } else if constexpr (Size == 2) {
+        return static_cast<int16_t>(value);
+    } else if constexpr (Size == 4) {
+        return static_cast<int32_t>(value);
+    } else {
+        return static_cast<int64_t>(value);
+    }
+}
+
+template<Piece Spec, typename T>
+void formatValue(FormatBuffer& out, int width, int precision, T value)
+{
+    bool leftAlign = Spec.leftAlign;
+
+    if (width < 0) {
+        leftAlign = true;
+        width = -width;
+    }
+
+    if constexpr (Spec.conversion == 's') {
+        static_assert(IsSame<T, const char*> || IsSame<T, char*>, "%s takes a string");
+
+        const char* string = value ? value : "(null)";
+        size_t length = 0;
+
+        while (string[length] && (precision < 0 || length < static_cast<size_t>(precision))) {
+            length++;
+        }
+
+        writePadded(out, nullptr, 0, string, length, width, -1, leftAlign, false);
+    } else if constexpr (Spec.conversion == 'p') {
+        static_assert(IsPointer<T>, "%p takes a pointer");
+
+        // same as printf.c: all 16 digits, upper case, no 0x
+        char digits[16];
+        auto start = hexDigits(digits + sizeof(digits), reinterpret_cast<uintptr_t>(value), true);
+
+        writePadded(out, nullptr, 0, start, digits + sizeof(digits) - start, sizeof(digits), -1, leftAlign, true);
+    } else {
+        static_assert(IsIntegral<T>, "integer conversions take integers");
+        // anything narrower than an int would have been promoted to one, so %hx of an int is fine
+        static_assert(sizeof(T) <= (Spec.size < sizeof(int) ? sizeof(int) : Spec.size),
+            "argument is wider than the length modifier says, add an l");
+
+        if constexpr (Spec.conversion == 'c') {
+            char c = static_cast<char>(value);
+            writePadded(out, nullptr, 0, &c, 1, width, -1, leftAlign, false);
+        } else {
+            char digits[20];
+            auto end = digits + sizeof(digits);
+            char* start;
+            char prefix[2] = {};
+            size_t prefixLength = 0;
+
+            if constexpr (Spec.conversion == 'd' || Spec.conversion == 'i') {
+                auto number = asSigned<Spec.size>(value);
+                auto magnitude = (number < 0) ? 0 - static_cast<uint64_t>(number) : static_cast<uint64_t>(number);
+
+                if (number < 0) {
+                    prefix[prefixLength++] = '-';
+                } else if (Spec.plus) {
+                    prefix[prefixLength++] = '+';
+                }
+
+                start = decimalDigits(end, magnitude);
+            } else if constexpr (Spec.conversion == 'u') {
+                start = decimalDigits(end, asUnsigned<Spec.size>(value));
+            } else {
+                auto number = asUnsigned<Spec.size>(value);
+
+                if (Spec.alternate && number != 0) {
+                    prefix[prefixLength++] = '0';
+                    prefix[prefixLength++] = Spec.conversion;
+                }
+
+                start = hexDigits(end, number, Spec.conversion == 'X');
+            }
+
+            // printf("%.0d", 0) prints nothing at all
+            if (precision == 0 && end - start == 1 && *start == '0') {
+                start = end;
+            }
+
+            writePadded(out, prefix, prefixLength, start, end - start, width, precision, leftAlign, Spec.zeroPad);
+        }
+    }
+}
+
+template<FormatString Format, size_t Index = 0, typename... Args>
+void formatPieces(FormatBuffer& out, Args... args);
+
+// Takes the * arguments first, if there are any, and then the value itself.
+template<FormatString Format, size_t Index, size_t Taken, typename First, typename... Rest>
+void formatConversion(FormatBuffer& out, int width, int precision, First first, Rest... rest)
+{
+    constexpr Piece piece = PARSED<Format>.pieces[Index];
+
+    if constexpr (piece.widthArgument && Taken == 0) {
+        static_assert(IsIntegral<First>, "* takes an int");
+        formatConversion<Format, Index, 1>(out, static_cast<int>(first), precision, rest...);
+    } else if constexpr (piece.precisionArgument && Taken == (piece.widthArgument ? 1 : 0)) {
+        static_assert(IsIntegral<First>, "* takes an int");
+        formatConversion<Format, Index, Taken + 1>(out, width, static_cast<int>(first), rest...);
+    } else {
+        formatValue<piece>(out, width, precision, first);
+        formatPieces<Format, Index + 1>(out, rest...);
+    }
+}
+
+template<FormatString Format, size_t Index, typename... Args>
+void formatPieces(FormatBuffer& out, Args... args)
+{
+    if constexpr (Index < PARSED<Format>.count) {
+        constexpr Piece piece = PARSED<Format>.pieces[Index];
+
+        if constexpr (piece.conversion == 0) {
+            out.write(Format.data + piece.start, piece.length);
+            formatPieces<Format, Index + 1>(out, args...);
+        } else {
+            formatConversion<Format, Index, 0>(out, piece.width, piece.precision, args...);
+        }
+    }
+}
+
+}
+
+template<FormatString Format, typename... Args>
+void formatTo(FormatBuffer& out, Args... args)
+{
+    static_assert(detail::format::PARSED<Format>.arguments == sizeof...(Args),
+        "the format string and the arguments don't match up");
+
+    detail::format::formatPieces<Format>(out, args...);
+}
+
+// Like snprintf(): always NUL-terminates (if there's any room), and returns the length the
+// whole thing would have had.
+template<FormatString Format, typename... Args>
+size_t format(char* buffer, size_t size, Args... args)
+{
+    FormatBuffer out(buffer, size ? size - 1 : 0);
+    formatTo<Format>(out, args...);
+
+    auto length = out.finish();
+    if (size > 0) {
+        buffer[out.used()] = '\0';
+    }
+
+    return length;
+}
+
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checksums and hashes that work the same at compile time and at run time, so a key can be
+// hashed into a constant:
+//
+//     constexpr auto KEY = stl::hash64("scheduler", 9);
+//
+// crc32c() is CRC-32C (Castagnoli, the one iSCSI, ext4 and SSE 4.2 use). At run time it goes
+// through the crc32 instruction when the CPU has it and through slice-by-8 tables when not.
+// hash64() is XXH64, so values match the reference implementation and anything else that
+// uses it. Neither is any good against someone picking inputs on purpose.
+namespace stl
+{
+
+namespace detail::hash
+{
+
+// reflected
+constexpr uint32_t CRC32C_POLYNOMIAL = 0x82F6'3B78;
+
+// the crc32 instruction has a latency of three cycles and a throughput of one, so big inputs
+// go through three independent streams of this many bytes each and get stitched together
+constexpr size_t CRC32C_STREAM_SIZE = 256;
+
+constexpr uint64_t PRIME64_1 = 0x9E37'79B1'85EB'CA87;
+constexpr uint64_t PRIME64_2 = 0xC2B2'AE3D'27D4'EB4F;
+constexpr uint64_t PRIME64_3 = 0x1656'67B1'9E37'79F9;
+constexpr uint64_t PRIME64_4 = 0x85EB'CA77'C2B2'AE63;
+constexpr uint64_t PRIME64_5 = 0x27D4'EB2F'1656'67C5;
+
+constexpr uint32_t load32(const char* p)
+{
+    if (__builtin_is_constant_evaluated()) {
+        uint32_t value = 0;
+
+        for (size_t i = 0; i < 4; i++) {
+            value |= uint32_t(uint8_t(p[i])) << (i * 8);
+        }
+
+        return value;
+    }
+
+    uint32_t value;
+    __builtin_memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+constexpr uint64_t load64(const char* p)
+{
+    if (__builtin_is_constant_evaluated()) {
+        return load32(p) | (uint64_t(load32(p + 4)) << 32);
+    }
+
+    uint64_t value;
+    __builtin_memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+constexpr uint64_t rotateLeft(uint64_t value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+struct Crc32cTables
+{
+    // slice[0] is the usual byte-at-a-time table, slice[k] advances a byte k more positions
+    uint32_t slice[8][256];
+};
+
+constexpr Crc32cTables makeCrc32cTables()
+{
+    Crc32cTables tables{};
+
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        auto crc = byte;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        }
+
+        tables.slice[0][byte] = crc;
+    }
+
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        for (size_t k = 1; k < 8; k++) {
+            auto previous = tables.slice[k - 1][byte];
+            tables.slice[k][byte] = (previous >> 8) ^ tables.slice[0][previous & 0xff];
+        }
+    }
+
+    return tables;
+}
+
+inline constexpr Crc32cTables CRC32C_TABLES = makeCrc32cTables();
+
+// Raw register updates, without the inversions crc32c() adds around them.
+constexpr uint32_t crc32cBytes(uint32_t crc, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        crc = (crc >> 8) ^ CRC32C_TABLES.slice[0][(crc ^ uint8_t(data[i])) & 0xff];
+    }
+
+    return crc;
+}
+
+constexpr uint32_t crc32cSlice8(uint32_t crc, const char* data, size_t size)
+{
+    const auto& t = CRC32C_TABLES.slice;
+
+    for (; size >= 8; data += 8, size -= 8) {
+        auto low = load32(data) ^ crc;
+        auto high = load32(data + 4);
+
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+            ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    }
+
+    return crc32cBytes(crc, data, size);
+}
+
+// What feeding `bytes` zero bytes does to a register. It's linear, so it's tabulated a byte of
+// the register at a time: the result for a whole register is the XOR of four lookups.
+struct Crc32cShift
+{
+    uint32_t table[4][256];
+};
+
+constexpr Crc32cShift makeCrc32cShift(size_t bytes)
+{
+    Crc32cShift shift{};
+    uint32_t basis[32] = {};
+
+    for (size_t bit = 0; bit < 32; bit++) {
+        auto crc = uint32_t(1) << bit;
+
+        for (size_t i = 0; i < bytes; i++) {
+            crc = (crc >> 8) ^ CRC32C_TABLES.slice[0][crc & 0xff];
+        }
+
+        basis[bit] = crc;
+    }
+
+    for (size_t k = 0; k < 4; k++) {
+        for (uint32_t byte = 0; byte < 256; byte++) {
+            uint32_t value = 0;
+
+            for (size_t bit = 0; bit < 8; bit++) {
+                if (byte & (1u << bit)) {
+                    value ^= basis[k * 8 + bit];
+                }
+            }
+
+            shift.table[k][byte] = value;
+        }
+    }
+
+    return shift;
+}
+
+inline constexpr Crc32cShift CRC32C_SHIFT_1 = makeCrc32cShift(CRC32C_STREAM_SIZE);
+inline constexpr Crc32cShift CRC32C_SHIFT_2 = makeCrc32cShift(2 * CRC32C_STREAM_SIZE);
+
+inline uint32_t shiftCrc32c(const Crc32cShift& shift, uint32_t crc)
+{
+    return shift.table[0][crc & 0xff] ^ shift.table[1][(crc >> 8) & 0xff]
+        ^ shift.table[2][(crc >> 16) & 0xff] ^ shift.table[3][crc >> 24];
+}
+
+#if defined(__x86_64__)
+
+// -1 until the first call at run time asks CPUID; racing callers all store the same answer
+inline int g_hasCrc32Instruction = -1;
+
+inline bool hasCrc32Instruction()
+{
+    auto known = __atomic_load_n(&g_hasCrc32Instruction, __ATOMIC_RELAXED);
+
+    if (known < 0) {
+        uint32_t eax = 1, ebx, ecx = 0, edx;
+        asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+
+        known = (ecx >> 20) & 1;
+        __atomic_store_n(&g_hasCrc32Instruction, known, __ATOMIC_RELAXED);
+    }
+
+    return known != 0;
+}
+
+// In inline assembly, so it doesn't matter what the compiler was told about SSE 4.2.
+inline uint64_t crc32cWord(uint64_t crc, uint64_t word)
+{
+    asm("crc32q %1, %0" : "+r"(crc) : "rm"(word));
+    return crc;
+}
+
+inline uint32_t crc32cByte(uint32_t crc, uint8_t byte)
+{
+    asm("crc32b %1, %0" : "+r"(crc) : "rm"(byte));
+    return crc;
+}
+
+inline uint32_t crc32cHardware(uint32_t crc, const char* data, size_t size)
+{
+    uint64_t crc0 = crc;
+
+    while (size >= 3 * CRC32C_STREAM_SIZE) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+
+        for (size_t i = 0; i < CRC32C_STREAM_SIZE; i += 8) {
+            crc0 = crc32cWord(crc0, load64(data + i));
+            crc1 = crc32cWord(crc1, load64(data + CRC32C_STREAM_SIZE + i));
+            crc2 = crc32cWord(crc2, load64(data + 2 * CRC32C_STREAM_SIZE + i));
+        }
+
+        crc0 = shiftCrc32c(CRC32C_SHIFT_2, uint32_t(crc0)) ^ shiftCrc32c(CRC32C_SHIFT_1, uint32_t(crc1))
+            ^ uint32_t(crc2);
+
+        data += 3 * CRC32C_STREAM_SIZE;
+        size -= 3 * CRC32C_STREAM_SIZE;
+    }
+
+    for (; size >= 8; data += 8, size -= 8) {
+        crc0 = crc32cWord(crc0, load64(data));
+    }
+
+    auto result = uint32_t(crc0);
+
+    for (size_t i = 0; i < size; i++) {
+        result = crc32cByte(result, uint8_t(data[i]));
+    }
+
+    return result;
+}
+
+#endif
+
+constexpr uint64_t hash64Round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * PRIME64_2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * PRIME64_1;
+}
+
+constexpr uint64_t hash64Merge(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= hash64Round(0, accumulator);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+}
+
+// The table-driven version crc32c() falls back to. `previous` continues an earlier result:
+// crc32c(b, crc32c(a)) is the CRC of a followed by b.
+constexpr uint32_t crc32cSoftware(const char* data, size_t size, uint32_t previous = 0)
+{
+    return ~detail::hash::crc32cSlice8(~previous, data, size);
+}
+
+constexpr uint32_t crc32c(const char* data, size_t size, uint32_t previous = 0)
+{
+#if defined(__x86_64__)
+    if (!__builtin_is_constant_evaluated() && detail::hash::hasCrc32Instruction()) {
+        return ~detail::hash::crc32cHardware(~previous, data, size);
+    }
+#endif
+
+    return crc32cSoftware(data, size, previous);
+}
+
+inline uint32_t crc32c(const void* data, size_t size, uint32_t previous = 0)
+{
+    return crc32c(static_cast<const char*>(data), size, previous);
+}
+
+// Bulk input goes through four independent accumulators, 32 bytes per round, which keeps
+// the multipliers busy without needing vector registers (the kernel has none to spare).
+constexpr uint64_t hash64(const char* data, size_t size, uint64_t seed = 0)
+{
+    using namespace detail::hash;
+
+    auto end = data + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+
+        for (; end - data >= 32; data += 32) {
+            v1 = hash64Round(v1, load64(data));
+            v2 = hash64Round(v2, load64(data + 8));
+            v3 = hash64Round(v3, load64(data + 16));
+            v4 = hash64Round(v4, load64(data + 24));
+        }
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = hash64Merge(hash, v1);
+        hash = hash64Merge(hash, v2);
+        hash = hash64Merge(hash, v3);
+        hash = hash64Merge(hash, v4);
+    } else {
+        hash = seed + PRIME64_5;
+    }
+
+    hash += size;
+
+    for (; end - data >= 8; data += 8) {
+        hash ^= hash64Round(0, load64(data));
+        hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (end - data >= 4) {
+        hash ^= uint64_t(load32(data)) * PRIME64_1;
+        hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+        data += 4;
+    }
+
+    for (; data < end; data++) {
+        hash ^= uint8_t(*data) * PRIME64_5;
+        hash = rotateLeft(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+inline uint64_t hash64(const void* data, size_t size, uint64_t seed = 0)
+{
+    return hash64(static_cast<const char*>(data), size, seed);
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace stl
+{
+
+// Single-producer single-consumer ring buffer. Indices are free-running and only
+// wrapped when indexing, so head - tail is always the number of queued items.
+template<typename T, size_t N>
+class RingBuffer
+{
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+    RingBuffer() = default;
+
+    bool push(const T& value)
+    {
+        auto head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+        auto tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+
+        if (head - tail == N) {
+            return false;
+        }
+
+        m_items[head & MASK] = value;
+        __atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    // Pushes as many values as fit and publishes them all at once. Returns how many that was.
+    size_t push(const T* values, size_t count)
+    {
+        auto head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+        auto tail = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+
+        auto space = N - (head - tail);
+        if (count > space) {
+            count = space;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            m_items[(head + i) & MASK] = values[i];
+        }
+
+        __atomic_store_n(&m_head, head + count, __ATOMIC_RELEASE);
+
+        return count;
+    }
+
+    bool pop(T& value)
+    {
+        auto tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+        auto head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            return false;
+        }
+
+        value = m_items[tail & MASK];
+        __atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    size_t size() const
+    {
+        return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    bool full() const
+    {
+        return size() == N;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return N;
+    }
+
+private:
+    static constexpr size_t MASK = N - 1;
+
+    // keep the producer and consumer indices on separate cache lines
+    alignas(64) size_t m_head = 0;
+    alignas(64) size_t m_tail = 0;
+    alignas(64) T m_items[N] = {};
+};
+
+}
@@ -73,6 +73,13 @@ constexpr bool IsPointer = false;
 template<typename T>
 constexpr bool IsPointer<T*> = true;
 
+template<typename T>
+constexpr bool IsIntegral = IsSame<T, bool> || IsSame<T, char> || IsSame<T, signed char> ||
+    IsSame<T, unsigned char> || IsSame<T, short> || IsSame<T, unsigned short> || IsSame<T, int> ||
+    IsSame<T, unsigned int> || IsSame<T, long> || IsSame<T, unsigned long> || IsSame<T, long long> ||
+    IsSame<T, unsigned long long> || IsSame<T, char8_t> || IsSame<T, char16_t> || IsSame<T, char32_t> ||
+    IsSame<T, wchar_t>;
+
 template<typename T>
 constexpr T&& forward(RemoveReference<T>& t) noexcept
 {
@@ -91,7 +98,7 @@ T&& declval() noexcept;
 template<typename T>
 constexpr RemoveReference<T>&& move(T&& t) noexcept
 {
-    return static_cast<T&&>(t);
+    return static_cast<RemoveReference<T>&&>(t);
 }
 
 }
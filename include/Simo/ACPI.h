@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace multiboot
+{
+
+struct Info;
+
+}
+
+namespace acpi
+{
+
+struct [[gnu::packed]] Rsdp
+{
+    char signature[8];
+    uint8_t checksum;
+    char oemId[6];
+    uint8_t revision;
+    uint32_t rsdtAddress;
+
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdtAddress;
+    uint8_t extendedChecksum;
+    uint8_t reserved[3];
+};
+
+struct [[gnu::packed]] SdtHeader
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oemId[6];
+    char oemTableId[8];
+    uint32_t oemRevision;
+    uint32_t creatorId;
+    uint32_t creatorRevision;
+};
+
+enum class MadtEntryType : uint8_t
+{
+    LocalApic = 0,
+    IoApic = 1,
+    InterruptSourceOverride = 2,
+    LocalApicAddressOverride = 5,
+    LocalX2Apic = 9,
+};
+
+struct [[gnu::packed]] MadtEntry
+{
+    MadtEntryType type;
+    uint8_t length;
+};
+
+struct [[gnu::packed]] MadtLocalApic : public MadtEntry
+{
+    uint8_t processorId;
+    uint8_t apicId;
+    uint32_t flags;
+};
+
+struct [[gnu::packed]] MadtLocalApicAddressOverride : public MadtEntry
+{
+    uint16_t reserved;
+    uint64_t address;
+};
+
+enum MadtLocalApicFlags : uint32_t
+{
+    Enabled = 1 << 0,
+    OnlineCapable = 1 << 1,
+};
+
+struct [[gnu::packed]] Madt : public SdtHeader
+{
+    uint32_t localApicAddress;
+    uint32_t flags;
+    uint8_t entries[0];
+};
+
+// Finds the RSDP handed over by GRUB and maps the root table. Returns false if there's no ACPI.
+bool init(const multiboot::Info* info);
+
+// Returns the (mapped) table with the given signature, or nullptr.
+const SdtHeader* findTable(const char* signature);
+
+template<typename TFunc>
+void forEachMadtEntry(const Madt* madt, TFunc&& func)
+{
+    auto ptr = madt->entries;
+    auto end = reinterpret_cast<const uint8_t*>(madt) + madt->length;
+
+    while (ptr < end) {
+        auto entry = reinterpret_cast<const MadtEntry*>(ptr);
+
+        if (entry->length == 0) {
+            break;
+        }
+
+        func(*entry);
+        ptr += entry->length;
+    }
+}
+
+}
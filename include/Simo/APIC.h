@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace apic
+{
+
+constexpr uint8_t TIMER_VECTOR = 0x30;
+constexpr uint8_t WAKEUP_VECTOR = 0x31;
+constexpr uint8_t SPURIOUS_VECTOR = 0xFF;
+
+// Maps the local APIC registers and enables the BSP's local APIC.
+void init();
+
+// Enables the local APIC on an application processor. The registers are already mapped by then.
+void initAp();
+
+uint32_t id();
+void sendEOI();
+
+// Measures the local APIC timer against the TSC. All CPUs are assumed to run their timers at the same rate.
+void calibrateTimer();
+
+// Starts the calling CPU's local APIC timer in periodic mode.
+void startTimer(uint8_t vector, uint32_t hz);
+
+void sendInit(uint32_t apicId);
+void sendStartup(uint32_t apicId, uint8_t vectorPage);
+void sendIpi(uint32_t apicId, uint8_t vector);
+
+}
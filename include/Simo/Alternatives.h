@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <Simo/CPU.h>
+
+// Boot-time code patching. An ALTERNATIVE() in inline assembly assembles the original
+// instructions in place, padded with NOPs to the length of the replacement if that's longer,
+// and records the site in .alternatives. apply() copies the replacement over every site whose
+// feature the CPU has, so hot paths don't test feature flags at all.
+//
+// Replacements are copied as bytes, so they can't contain anything RIP-relative (no calls,
+// no jumps out of the replacement). The feature goes in as an "i" operand named
+// [alternative], see ALTERNATIVE_FEATURE(). ALTERNATIVE_2() has a second replacement, which
+// wins when the CPU has both features.
+#define ALTERNATIVE(original, replacement, feature) \
+    ".pushsection .alternatives.replacement, \"a\"\n" \
+    "664:\n\t" replacement "\n" \
+    "665:\n" \
+    ".popsection\n" \
+    "661:\n\t" original "\n" \
+    "662:\n" \
+    ".fill -(((665b - 664b) - (662b - 661b)) > 0) * ((665b - 664b) - (662b - 661b)), 1, 0x90\n" \
+    "663:\n" \
+    ".pushsection .alternatives, \"a\"\n" \
+    ".balign 4\n" \
+    ".long 661b - .\n" \
+    ".long 664b - .\n" \
+    ".word " feature "\n" \
+    ".byte 663b - 661b\n" \
+    ".byte 665b - 664b\n" \
+    ".popsection\n"
+
+#define ALTERNATIVE_2(original, replacement1, feature1, replacement2, feature2) \
+    ".pushsection .alternatives.replacement, \"a\"\n" \
+    "664:\n\t" replacement1 "\n" \
+    "665:\n" \
+    "666:\n\t" replacement2 "\n" \
+    "667:\n" \
+    ".popsection\n" \
+    "661:\n\t" original "\n" \
+    "662:\n" \
+    ".fill -(((665b - 664b) - (662b - 661b)) > 0) * ((665b - 664b) - (662b - 661b)), 1, 0x90\n" \
+    "663:\n" \
+    ".fill -(((667b - 666b) - (663b - 661b)) > 0) * ((667b - 666b) - (663b - 661b)), 1, 0x90\n" \
+    "668:\n" \
+    ".pushsection .alternatives, \"a\"\n" \
+    ".balign 4\n" \
+    ".long 661b - .\n" \
+    ".long 664b - .\n" \
+    ".word " feature1 "\n" \
+    ".byte 668b - 661b\n" \
+    ".byte 665b - 664b\n" \
+    ".long 661b - .\n" \
+    ".long 666b - .\n" \
+    ".word " feature2 "\n" \
+    ".byte 668b - 661b\n" \
+    ".byte 667b - 666b\n" \
+    ".popsection\n"
+
+#define ALTERNATIVE_FEATURE(feature) [alternative]"i"(static_cast<uint16_t>(feature))
+#define ALTERNATIVE_FEATURE_2(feature) [alternative2]"i"(static_cast<uint16_t>(feature))
+
+namespace alternatives
+{
+
+// One patch site, with both addresses relative to the field they're stored in.
+struct Entry
+{
+    int32_t site;
+    int32_t replacement;
+    uint16_t feature;
+    uint8_t siteLength;
+    uint8_t replacementLength;
+};
+
+static_assert(sizeof(Entry) == 12);
+
+// Patches every site on the BSP, before the APs start. Needs cpu::detectFeatures() and a
+// writable kernel text, so after paging::init().
+void apply();
+
+// A feature test that compiles to a JMP, which apply() turns into NOPs when the CPU has the
+// feature. Always false before apply().
+template<cpu::Feature Feature>
+inline bool hasFeature()
+{
+    asm goto(ALTERNATIVE("jmp %l[missing]", "", "%c[alternative]")
+        : : ALTERNATIVE_FEATURE(Feature) : : missing);
+
+    return true;
+
+missing:
+    return false;
+}
+
+}
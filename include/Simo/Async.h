@@ -0,0 +1,207 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Simo/WorkQueue.h>
+#include <STL/Coroutine.h>
+#include <STL/TypeTraits.h>
+
+// Coroutines for code that spends most of its time waiting, like driver I/O. A suspended
+// coroutine only keeps its frame (usually a few hundred bytes) instead of a whole thread
+// stack, and the per-CPU work queue workers double as the executor that resumes them.
+namespace async
+{
+
+struct FrameStats
+{
+    uint64_t pooled;
+    uint64_t fromHeap;      // too big for any pool
+    size_t largest;
+};
+
+// Frames come from small per-CPU free lists, one per size class.
+void* allocateFrame(size_t size);
+void freeFrame(void* frame, size_t size);
+FrameStats frameStats();
+
+namespace detail
+{
+
+struct PromiseBase
+{
+    static void* operator new(size_t size) { return allocateFrame(size); }
+    static void operator delete(void* frame, size_t size) { freeFrame(frame, size); }
+
+    // hands control back to whoever co_awaited us, without growing the stack
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename TPromise>
+        stl::CoroutineHandle<> await_suspend(stl::CoroutineHandle<TPromise> handle) noexcept
+        {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : stl::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    stl::SuspendAlways initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    // no exceptions in the kernel
+    void unhandled_exception() {}
+
+    stl::CoroutineHandle<> continuation;
+};
+
+// T has to be default constructible
+template<typename T>
+struct Promise : PromiseBase
+{
+    void return_value(T result) { value = stl::move(result); }
+
+    T value{};
+};
+
+template<>
+struct Promise<void> : PromiseBase
+{
+    void return_void() {}
+};
+
+}
+
+// A lazily started coroutine. Nothing runs until it's co_awaited, then it runs right away on
+// the awaiting CPU, and the awaiter continues once it's done. Owns the frame.
+template<typename T = void>
+class [[nodiscard]] Task
+{
+public:
+    struct promise_type;
+    using Handle = stl::CoroutineHandle<promise_type>;
+
+    struct promise_type : detail::Promise<T>
+    {
+        Task get_return_object() { return Task(Handle::from_promise(*this)); }
+    };
+
+    struct Awaiter
+    {
+        Handle handle;
+
+        bool await_ready() const noexcept { return false; }
+
+        stl::CoroutineHandle<> await_suspend(stl::CoroutineHandle<> awaiting) noexcept
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume()
+        {
+            if constexpr (!stl::IsSame<T, void>) {
+                return stl::move(handle.promise().value);
+            }
+        }
+    };
+
+    Task(Task&& other) :
+        m_handle(other.m_handle)
+    {
+        other.m_handle = nullptr;
+    }
+
+    ~Task()
+    {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    Awaiter operator co_await() noexcept
+    {
+        return Awaiter{m_handle};
+    }
+
+private:
+    explicit Task(Handle handle) :
+        m_handle(handle)
+    {
+    }
+
+    Handle m_handle;
+};
+
+// co_await resumeOn(cpu) continues the coroutine on that CPU's worker thread.
+struct ResumeOn
+{
+    work::Item item;        // must stay first
+    uint32_t cpu;
+    stl::CoroutineHandle<> handle;
+
+    explicit ResumeOn(uint32_t targetCpu) :
+        item{},
+        cpu(targetCpu)
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(stl::CoroutineHandle<> awaiting)
+    {
+        handle = awaiting;
+        item.function = [](work::Item* item) {
+            reinterpret_cast<ResumeOn*>(item)->handle.resume();
+        };
+
+        // we might be running on the other CPU already once this returns
+        work::queue(&item, cpu);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+// Runs task to completion on the given CPU's worker and frees it. Needs work::init().
+void spawn(Task<> task, uint32_t cpu);
+
+// One-shot completion for a single waiter. Whoever finishes the work calls set(), which is
+// fine from an interrupt handler, and the coroutine co_awaiting it continues on its own CPU.
+class Event
+{
+public:
+    constexpr Event() = default;
+
+    Event(const Event&) = delete;
+    Event& operator=(const Event&) = delete;
+
+    bool isSet() const
+    {
+        return __atomic_load_n(&m_state, __ATOMIC_ACQUIRE) == Set;
+    }
+
+    void set();
+
+    bool await_ready() const noexcept { return isSet(); }
+    bool await_suspend(stl::CoroutineHandle<> awaiting);
+    void await_resume() const noexcept {}
+
+private:
+    enum : uint32_t
+    {
+        Empty,
+        Waiting,
+        Set,
+    };
+
+    work::Item m_item = {};
+    stl::CoroutineHandle<> m_waiter;
+    uint32_t m_cpu = 0;
+    uint32_t m_state = Empty;
+};
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace bench
+{
+
+// Entry point for the benchmark thread kmain starts when built with -Dbenchmarks=true.
+void run(void*);
+
+// Two threads pinned to one CPU yielding to each other, with and without extended state.
+void contextSwitch();
+
+// Read-side cost of RCU versus a ticket lock, from one reader up to one per CPU.
+void rcuReaders();
+
+// Zeroes a big buffer on one CPU, then with parallelFor() on all of them.
+void parallelZero();
+
+// Wakes a thread blocked on an otherwise idle CPU, through MWAIT and through HLT plus an IPI.
+void wakeupLatency();
+
+// SYSCALL/SYSRET round trip from ring 3 into an empty handler.
+void nullSyscall();
+
+// A user program pushing Nops through an io ring and entering the kernel for each, which also
+// checks what setup() and enter() refuse.
+void ioRingNop();
+
+// tsc::now(), which does what user code does with the time page instead of a syscall.
+void clockRead();
+
+// Lock/unlock of a futex-backed Mutex by one thread, then by one thread per CPU.
+void mutexContention();
+
+// A coroutine bouncing through its CPU's work queue, which is what every co_await on I/O costs.
+void coroutineResume();
+
+// klog::write() from a hot path, next to a printf() of the same line.
+void logRecord();
+
+// dumpInterruptContext()'s format through snprintf() and through stl::format().
+void formatContext();
+
+// memcpy() and memset() from 1 byte to 16 MiB, one size at a time with a warm cache until it
+// doesn't fit any more.
+void memorySweep();
+
+// stl::crc32c() with and without the crc32 instruction, and stl::hash64(), in GB/s.
+void hashThroughput();
+
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace cpu
+{
+
+enum class Msr : uint32_t
+{
+    ApicBase = 0x1B,
+    ArchCapabilities = 0x10A,
+    Pat = 0x277,
+    Efer = 0xC000'0080,
+    FsBase = 0xC000'0100,
+    GsBase = 0xC000'0101,
+    KernelGsBase = 0xC000'0102,
+    Star = 0xC000'0081,
+    LStar = 0xC000'0082,
+    SfMask = 0xC000'0084,
+};
+
+// A feature is a CPUID output register and a bit in it, numbered as word * 32 + bit so
+// detectFeatures() can keep them all in one array.
+enum class FeatureWord : uint16_t
+{
+    Leaf1Ecx,
+    Leaf1Edx,
+    Leaf7Ebx,
+    Leaf7Ecx,
+    Leaf7Edx,
+    LeafDSub1Eax,
+    Extended1Ecx,
+    Extended1Edx,
+    Extended7Edx,
+    Count,
+};
+
+constexpr uint16_t featureBit(FeatureWord word, uint16_t bit)
+{
+    return static_cast<uint16_t>(static_cast<uint16_t>(word) * 32 + bit);
+}
+
+enum class Feature : uint16_t
+{
+    Sse3 = featureBit(FeatureWord::Leaf1Ecx, 0),
+    Monitor = featureBit(FeatureWord::Leaf1Ecx, 3),
+    Ssse3 = featureBit(FeatureWord::Leaf1Ecx, 9),
+    Pcid = featureBit(FeatureWord::Leaf1Ecx, 17),
+    Sse41 = featureBit(FeatureWord::Leaf1Ecx, 19),
+    Sse42 = featureBit(FeatureWord::Leaf1Ecx, 20),
+    X2Apic = featureBit(FeatureWord::Leaf1Ecx, 21),
+    Popcnt = featureBit(FeatureWord::Leaf1Ecx, 23),
+    TscDeadline = featureBit(FeatureWord::Leaf1Ecx, 24),
+    Xsave = featureBit(FeatureWord::Leaf1Ecx, 26),
+    Avx = featureBit(FeatureWord::Leaf1Ecx, 28),
+    Rdrand = featureBit(FeatureWord::Leaf1Ecx, 30),
+    Hypervisor = featureBit(FeatureWord::Leaf1Ecx, 31),
+
+    Tsc = featureBit(FeatureWord::Leaf1Edx, 4),
+    Msr = featureBit(FeatureWord::Leaf1Edx, 5),
+    Apic = featureBit(FeatureWord::Leaf1Edx, 9),
+    Pat = featureBit(FeatureWord::Leaf1Edx, 16),
+    Clflush = featureBit(FeatureWord::Leaf1Edx, 19),
+    Sse2 = featureBit(FeatureWord::Leaf1Edx, 26),
+
+    FsGsBase = featureBit(FeatureWord::Leaf7Ebx, 0),
+    Bmi1 = featureBit(FeatureWord::Leaf7Ebx, 3),
+    Avx2 = featureBit(FeatureWord::Leaf7Ebx, 5),
+    Smep = featureBit(FeatureWord::Leaf7Ebx, 7),
+    Bmi2 = featureBit(FeatureWord::Leaf7Ebx, 8),
+    Erms = featureBit(FeatureWord::Leaf7Ebx, 9),
+    Invpcid = featureBit(FeatureWord::Leaf7Ebx, 10),
+    Avx512F = featureBit(FeatureWord::Leaf7Ebx, 16),
+    Rdseed = featureBit(FeatureWord::Leaf7Ebx, 18),
+    Smap = featureBit(FeatureWord::Leaf7Ebx, 20),
+    Clflushopt = featureBit(FeatureWord::Leaf7Ebx, 23),
+    Clwb = featureBit(FeatureWord::Leaf7Ebx, 24),
+
+    Umip = featureBit(FeatureWord::Leaf7Ecx, 2),
+    Waitpkg = featureBit(FeatureWord::Leaf7Ecx, 5),
+    Rdpid = featureBit(FeatureWord::Leaf7Ecx, 22),
+
+    Fsrm = featureBit(FeatureWord::Leaf7Edx, 4),
+    ArchCapabilities = featureBit(FeatureWord::Leaf7Edx, 29),
+
+    Xsaveopt = featureBit(FeatureWord::LeafDSub1Eax, 0),
+    Xsavec = featureBit(FeatureWord::LeafDSub1Eax, 1),
+    Xsaves = featureBit(FeatureWord::LeafDSub1Eax, 3),
+
+    Lzcnt = featureBit(FeatureWord::Extended1Ecx, 5),
+    TopologyExtensions = featureBit(FeatureWord::Extended1Ecx, 22),
+
+    Syscall = featureBit(FeatureWord::Extended1Edx, 11),
+    NoExecute = featureBit(FeatureWord::Extended1Edx, 20),
+    Pages1G = featureBit(FeatureWord::Extended1Edx, 26),
+    Rdtscp = featureBit(FeatureWord::Extended1Edx, 27),
+    LongMode = featureBit(FeatureWord::Extended1Edx, 29),
+
+    InvariantTsc = featureBit(FeatureWord::Extended7Edx, 8),
+};
+
+struct CpuidResult
+{
+    uint32_t eax;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+};
+
+inline CpuidResult cpuid(uint32_t leaf, uint32_t subleaf = 0)
+{
+    CpuidResult result;
+
+    asm volatile("cpuid"
+        : "=a"(result.eax), "=b"(result.ebx), "=c"(result.ecx), "=d"(result.edx)
+        : "a"(leaf), "c"(subleaf));
+
+    return result;
+}
+
+// Reads every feature word on the calling CPU (the BSP, the APs are assumed to match) along with
+// the address sizes and the MSRs that describe the CPU. Has to run before anything below is
+// used, and before alternatives::apply().
+void detectFeatures();
+
+bool hasFeature(Feature feature);
+
+// MAXPHYADDR, 52 until detectFeatures() knows better
+uint8_t physicalAddressBits();
+uint8_t linearAddressBits();
+
+// IA32_ARCH_CAPABILITIES, 0 on CPUs without it
+uint64_t archCapabilities();
+
+inline uint64_t readMsr(Msr msr)
+{
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(static_cast<uint32_t>(msr)));
+
+    return (uint64_t(high) << 32) | low;
+}
+
+inline void writeMsr(Msr msr, uint64_t value)
+{
+    asm volatile("wrmsr"
+        : : "c"(static_cast<uint32_t>(msr)), "a"(static_cast<uint32_t>(value)), "d"(static_cast<uint32_t>(value >> 32))
+        : "memory");
+}
+
+inline uint64_t rdtsc()
+{
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+
+    return (uint64_t(high) << 32) | low;
+}
+
+inline uint64_t readCR3()
+{
+    uint64_t value;
+    asm volatile("movq %%cr3, %0" : "=r"(value));
+
+    return value;
+}
+
+inline void pause()
+{
+    asm volatile("pause" : : : "memory");
+}
+
+[[noreturn]] inline void halt()
+{
+    while (true) {
+        asm volatile("cli; hlt");
+    }
+}
+
+}
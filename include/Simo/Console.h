@@ -6,6 +6,9 @@
 namespace console
 {
 
+// text mode VGA memory, mapped at the same address by paging::init()
+constexpr uint64_t VGA_BUFFER_ADDRESS = 0xb8000;
+
 enum class Color : uint8_t
 {
     Black           = 0,
@@ -33,6 +36,13 @@ void setForegroundColor(Color c);
 void setBackgroundColor(Color c);
 
 void setPosition(size_t x, size_t y);
+
+// Draws into a RAM shadow of the screen. Changed lines reach VGA memory on flush(), which
+// happens by itself on a newline every 10ms and from the timer tick.
 void putChar(char c);
+void flush();
+
+// Same as putChar() for every byte, but only takes the lock once.
+void write(const char* data, size_t length);
 
 }
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace fpu
+{
+
+// Enables x87/SSE (and AVX through XSAVE when the CPU has it) on the calling CPU.
+// Every CPU has to run this before a thread with extended state is scheduled on it.
+void init();
+
+bool hasXsave();
+bool hasXsaveopt();
+
+// AVX is enabled in XCR0, so the ymm registers are usable.
+bool hasAvx();
+
+// Size of a save area for everything enabled in XCR0.
+size_t stateSize();
+
+// Save areas are 64-byte aligned and start out in the init state.
+void* allocateState();
+void freeState(void* state);
+
+void save(void* state);
+void restore(void* state);
+
+// The kernel is built with -mgeneral-regs-only, so the vector registers still hold whatever the
+// last thread with FPU state left in them. Bulk copies borrow two of them (ymm0 and ymm1 with
+// AVX, xmm0 and xmm1 otherwise) and put them back, which is a lot cheaper than a full XSAVE.
+// Only safe with interrupts off, and after init() ran on this CPU. Longer stretches of vector
+// code with interrupts on want a sched::FpuScope instead.
+class BorrowedRegisters
+{
+public:
+    BorrowedRegisters() :
+        m_avx(hasAvx())
+    {
+        if (m_avx) {
+            asm volatile("vmovdqu %%ymm0, (%0); vmovdqu %%ymm1, 32(%0)" : : "r"(m_saved) : "memory");
+        } else {
+            asm volatile("movdqu %%xmm0, (%0); movdqu %%xmm1, 16(%0)" : : "r"(m_saved) : "memory");
+        }
+    }
+
+    ~BorrowedRegisters()
+    {
+        if (m_avx) {
+            asm volatile("vmovdqu (%0), %%ymm0; vmovdqu 32(%0), %%ymm1" : : "r"(m_saved) : "memory");
+        } else {
+            asm volatile("movdqu (%0), %%xmm0; movdqu 16(%0), %%xmm1" : : "r"(m_saved) : "memory");
+        }
+    }
+
+    BorrowedRegisters(const BorrowedRegisters&) = delete;
+    BorrowedRegisters& operator=(const BorrowedRegisters&) = delete;
+
+private:
+    bool m_avx;
+    uint8_t m_saved[64];
+};
+
+}
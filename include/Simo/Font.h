@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace font
+{
+
+const size_t WIDTH = 8;
+const size_t HEIGHT = 16;
+const char FIRST = ' ';
+const char LAST = '~';
+
+// Printable ASCII only. One byte per scanline, the most significant bit is the leftmost pixel.
+extern const uint8_t glyphs[LAST - FIRST + 1][HEIGHT];
+
+}
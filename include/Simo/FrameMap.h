@@ -16,6 +16,7 @@ public:
     PhysicalFrameMap(PhysicalAddress memoryBase, size_t memorySize);
 
     PhysicalAddress allocateFrame();
+    PhysicalAddress allocateFrames(size_t count);
     PhysicalAddress getNextFreeFrame();
     void freeFrame(PhysicalAddress frame);
     void markFrame(PhysicalAddress address, bool used);
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace multiboot
+{
+
+struct Info;
+
+}
+
+namespace framebuffer::console
+{
+
+// Takes over the linear framebuffer GRUB set up, if it's 16, 24 or 32 bpp RGB. Returns false
+// otherwise, in which case write() does nothing. The blits borrow vector registers, so every CPU
+// that prints has to have run fpu::init() first.
+bool init(const multiboot::Info* info);
+
+// Draws into a RAM shadow through the glyph cache. Changed text rows reach the framebuffer on
+// flush(), which happens by itself on a newline every 10ms and from the timer tick.
+void write(const char* data, size_t length);
+void flush();
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Address-keyed wait queues, like Linux futexes. Waiters hash into buckets by address, and
+// every bucket has its own lock, so unrelated addresses rarely contend with each other.
+// Nothing here is touched unless someone actually has to sleep.
+namespace futex
+{
+
+constexpr uint32_t WAKE_ALL = ~0u;
+
+// Sleeps until wake() is called on address, unless *address no longer equals expected once
+// we're queued, in which case it returns false straight away. Wakeups can be spurious, so
+// callers re-check their condition in a loop.
+bool wait(const uint32_t* address, uint32_t expected);
+
+// Wakes up to count threads waiting on address, oldest first. Returns how many it woke.
+uint32_t wake(const uint32_t* address, uint32_t count);
+
+}
@@ -9,8 +9,33 @@ enum class Selector : uint16_t
 {
     KernelCode = 0x08,
     KernelData = 0x10,
+    // SYSRET wants user data right before user code, see syscalls::init()
+    UserData = 0x18,
+    UserCode = 0x20,
+    TaskState = 0x28,
 };
 
-void init();
+// requested privilege level for selectors loaded in ring 3
+constexpr uint16_t USER_RPL = 3;
 
-}
\ No newline at end of file
+struct [[gnu::packed]] TaskStateSegment
+{
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t ioMapBase;
+};
+
+// Every CPU gets its own copy, since the TSS descriptor (and the busy bit in it) can't be shared.
+struct Tables
+{
+    alignas(16) uint64_t descriptors[7];
+    TaskStateSegment tss;
+};
+
+void init(Tables& tables);
+
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace heap
+{
+
+// 16-byte aligned, never returns nullptr (asserts instead)
+void* allocate(size_t size);
+void free(void* ptr);
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace idle
+{
+
+struct Stats
+{
+    uint64_t idleCycles;        // residency, in TSC cycles
+    uint64_t entries;
+    uint64_t mwaitWakeups;
+    uint64_t ipiWakeups;
+    uint64_t wakeupCycles;      // kick() to leaving the idle state, summed over all wakeups above
+    uint64_t maxWakeupCycles;
+};
+
+// Per CPU, called by the scheduler before it starts the idle loop.
+void init();
+
+// Sleeps until an interrupt or a kick(). Called by the idle thread with interrupts off,
+// returns with interrupts off again.
+void enter();
+
+// Makes an idle CPU go look at its run queue. A CPU in MWAIT wakes up from the store
+// to its wakeup flag alone, one in HLT needs an IPI. Cheap if the CPU isn't idle.
+void kick(uint32_t cpu);
+
+bool hasMwait();
+
+// Falls back to HLT and IPIs even if MWAIT is available, for comparing the two.
+void setMwaitEnabled(bool enabled);
+
+const Stats& stats(uint32_t cpu);
+void dumpStats();
+
+}
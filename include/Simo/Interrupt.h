@@ -1,10 +1,94 @@
 #pragma once
 
 #include <Simo/Kernel.h>
+#include <STL/Bit.h>
 
 namespace interrupts
 {
 
+struct InterruptContext
+{
+    uint64_t ip;
+    uint64_t cs;
+    uint64_t flags;
+    uint64_t sp;
+    uint64_t ss;
+};
+
+// What exception handlers dump an InterruptContext with, in that order.
+constexpr char CONTEXT_FORMAT[] = R"(context:
+  rip:    %016lx
+  cs:     %04lx
+  flags:  %08lx
+  rsp:    %016lx
+  ss:     %04lx)""\n\n";
+
+// TODO: how to ensure [[gnu::interrupt]]?
+using InterruptHandler = void (*)(InterruptContext*);
+using ExceptionHandler = void (*)(InterruptContext*, uint64_t);
+
 void init();
 
-}
\ No newline at end of file
+// Loads the (shared) IDT on the calling CPU. init() does this for the BSP.
+void load();
+
+void setHandler(uint8_t vector, InterruptHandler handler);
+
+inline void enable()
+{
+    asm volatile("sti" : : : "memory");
+}
+
+inline void disable()
+{
+    asm volatile("cli" : : : "memory");
+}
+
+inline bool enabled()
+{
+    uint64_t flags;
+    asm volatile("pushfq; popq %0" : "=r"(flags));
+
+    return (flags & stl::bit(9)) != 0;
+}
+
+inline uint64_t saveAndDisable()
+{
+    uint64_t flags;
+    asm volatile(R"(
+        pushfq
+        popq %0
+        cli
+        )" : "=r"(flags) : : "memory");
+
+    return flags;
+}
+
+inline void restore(uint64_t flags)
+{
+    if (flags & stl::bit(9)) {
+        enable();
+    }
+}
+
+class InterruptGuard
+{
+public:
+    InterruptGuard() :
+        m_flags(saveAndDisable())
+    {
+    }
+
+    ~InterruptGuard()
+    {
+        restore(m_flags);
+    }
+
+    InterruptGuard(const InterruptGuard&) = delete;
+    InterruptGuard& operator=(const InterruptGuard&) = delete;
+
+private:
+    uint64_t m_flags;
+};
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <STL/RingBuffer.h>
+
+// Batched system calls through rings shared with user space, in the spirit of Linux's io_uring.
+// User code pushes submissions and pops completions on its own; the kernel only needs to be
+// entered to ring the doorbell, or not at all while a polling thread is watching the ring.
+namespace ioring
+{
+
+constexpr size_t SUBMISSION_ENTRIES = 128;
+constexpr size_t COMPLETION_ENTRIES = 256;     // so completions rarely back up
+constexpr size_t MAX_RINGS = 16;
+
+enum class Opcode : uint8_t
+{
+    Nop = 0,
+    Write = 1,          // args[0]: user buffer, args[1]: length, goes to the kernel log
+    ReadClock = 2,      // result is tsc::now()
+};
+
+struct SubmissionEntry
+{
+    Opcode opcode;
+    uint8_t reserved[7];
+    uint64_t userData;      // handed back untouched in the completion
+    uint64_t args[4];
+};
+
+struct CompletionEntry
+{
+    uint64_t userData;
+    int64_t result;         // negative on failure
+};
+
+enum RingFlags : uint32_t
+{
+    NeedWakeup = 1,     // the polling thread went to sleep, enter() with Wakeup to get it going again
+};
+
+enum SetupFlags : uint32_t
+{
+    KernelPoll = 1,     // a kernel thread consumes submissions, no enter() needed while it's awake
+};
+
+enum EnterFlags : uint32_t
+{
+    Wakeup = 1,
+};
+
+// What gets mapped at the user address. User space produces submissions and consumes
+// completions, the kernel does the opposite, and each side only writes its own indices.
+// After pushing to a KernelPoll ring, user code has to do a full fence before it checks
+// flags for NeedWakeup.
+struct SharedRings
+{
+    stl::RingBuffer<SubmissionEntry, SUBMISSION_ENTRIES> submissions;
+    stl::RingBuffer<CompletionEntry, COMPLETION_ENTRIES> completions;
+    alignas(64) uint32_t flags;
+};
+
+size_t sharedPages();
+
+// Maps a fresh SharedRings at userAddress (page aligned, sharedPages() long) and returns the
+// ring's id, or -1. The range can't start at 0, have anything mapped in it already, or cover
+// one of the kernel's own lower-half pages. With KernelPoll, the polling thread is pinned to pollCpu.
+int64_t setup(uint64_t userAddress, uint32_t flags, uint32_t pollCpu);
+
+// Consumes up to toSubmit submissions (all of them are completed synchronously for now) and
+// returns how many, or -1. For KernelPoll rings it only wakes the polling thread. Only the
+// thread that set the ring up can enter it.
+int64_t enter(uint64_t ring, uint32_t toSubmit, uint32_t flags);
+
+}
@@ -7,6 +7,10 @@
 void* operator new  (size_t, void* p) throw();
 void* operator new[](size_t, void* p) throw();
 
+// backed by the kernel heap
+void* operator new  (size_t size);
+void* operator new[](size_t size);
+
 void  operator delete  (void*) throw();
 void  operator delete[](void*) throw();
 void  operator delete  (void*, size_t) throw();
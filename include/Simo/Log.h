@@ -0,0 +1,131 @@
+#pragma once
+
+#include <STL/TypeTraits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Asynchronous kernel log. Records go into a lock-free multi-producer ring with a timestamp,
+// CPU and level attached, and a kernel thread drains them into the output handlers (see
+// addOutputHandler()) in batches. Safe from interrupt handlers, and messages below
+// SIMO_LOG_LEVEL aren't even compiled in:
+//
+//     LOG_INFO("virtio-console at %02x:%02x.%x\n", bus, device, function);
+//
+// Unlike printf(), nothing reaches a device before the drainer gets to it, so paths that never
+// return have to go through panic::enter() first.
+//
+// Configured with -Dlog_format=binary, the LOG_* macros skip formatting altogether: the format
+// string goes into the .klog.formats section, which is never loaded, and a record is just its
+// offset and the raw argument words. The drainer sends those to COM1 as frames (see LogFrame.h)
+// and tools/klogdecode turns a capture of the serial port back into text with kernel.elf's
+// help. Formats have to be literals then, and %s only works for strings in the kernel image.
+namespace klog
+{
+
+enum class Level : uint8_t
+{
+    Debug,
+    Info,
+    Warning,
+    Error,
+};
+
+#ifndef SIMO_LOG_LEVEL
+#define SIMO_LOG_LEVEL 1
+#endif
+
+constexpr bool enabled([[maybe_unused]] Level level)
+{
+    // comparing against 0 would be a -Wtype-limits warning
+#if SIMO_LOG_LEVEL > 0
+    return static_cast<int>(level) >= SIMO_LOG_LEVEL;
+#else
+    return true;
+#endif
+}
+
+// Starts the drainer thread. Until then, every write() drains the ring synchronously.
+void init();
+
+// Formats into a free slot and returns. Messages that don't fit in a record get truncated,
+// and when the ring is full they're dropped (and counted) rather than waited on.
+void write(Level level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// What a binary record holds at most, it reuses the space of the text.
+constexpr size_t MAX_ARGUMENTS = 13;
+
+// Publishes a binary record, format is the string's offset into .klog.formats. Use
+// KLOG_BINARY() rather than calling this directly.
+void writeWords(Level level, uint32_t format, const uint64_t* arguments, size_t count);
+
+// Never defined, only there so the compiler checks binary records' arguments like printf()'s.
+int checkFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+template<typename T>
+uint64_t argumentWord(T value)
+{
+    if constexpr (stl::IsPointer<T>) {
+        return reinterpret_cast<uintptr_t>(value);
+    } else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+template<typename... Args>
+void writeBinary(Level level, const char* format, Args... arguments)
+{
+    static_assert(sizeof...(Args) <= MAX_ARGUMENTS, "too many arguments for a binary log record");
+
+    // the trailing 0 keeps the array from being empty
+    const uint64_t words[] = {argumentWord(arguments)..., 0};
+    writeWords(level, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(format)), words, sizeof...(Args));
+}
+
+// Called from the timer tick, wakes the drainer if it slept through new records.
+void poll();
+
+// Drains whatever's in the ring on the calling CPU, without waiting for a drainer that
+// might never run again.
+void panicFlush();
+
+// Output handler that keeps the last HISTORY_SIZE bytes of output around.
+constexpr size_t HISTORY_SIZE = 16 * 1024;
+void memorySink(const char* data, size_t length);
+
+// Copies the newest (up to size) bytes of history into buffer, oldest first.
+size_t readHistory(char* buffer, size_t size);
+
+}
+
+#define KLOG_STRINGIFY_(x) #x
+#define KLOG_STRINGIFY(x) KLOG_STRINGIFY_(x)
+
+#define KLOG_TEXT(level, ...) \
+    do { \
+        if constexpr (klog::enabled(level)) { \
+            klog::write(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+// Entries are "file:line\0format\0", .klog.formats is linked at 0 so an entry's address is its
+// ID. The sizeof() only type-checks the arguments, they're evaluated once.
+#define KLOG_BINARY(level, format, ...) \
+    do { \
+        if constexpr (klog::enabled(level)) { \
+            [[gnu::section(".klog.formats"), gnu::used]] static const char klogFormat_[] = \
+                __FILE__ ":" KLOG_STRINGIFY(__LINE__) "\0" format; \
+            static_cast<void>(sizeof(klog::checkFormat(format __VA_OPT__(,) __VA_ARGS__))); \
+            klog::writeBinary(level, klogFormat_ __VA_OPT__(,) __VA_ARGS__); \
+        } \
+    } while (0)
+
+#ifdef SIMO_LOG_BINARY
+#define KLOG KLOG_BINARY
+#else
+#define KLOG KLOG_TEXT
+#endif
+
+#define LOG_DEBUG(...) KLOG(klog::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) KLOG(klog::Level::Info, __VA_ARGS__)
+#define LOG_WARNING(...) KLOG(klog::Level::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) KLOG(klog::Level::Error, __VA_ARGS__)
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// How binary log records (see KLOG_BINARY in Log.h) go over the serial port. Shared with
+// tools/klogdecode.cpp, so this has to stay host-compilable.
+namespace klog
+{
+
+// never shows up in the ASCII around the frames, that's how the decoder finds them again
+constexpr uint8_t FRAME_MAGIC = 0xFE;
+
+// the section the format strings go into, an ID is an offset into it
+constexpr const char FORMAT_SECTION[] = ".klog.formats";
+
+struct [[gnu::packed]] FrameHeader
+{
+    uint8_t magic;
+    uint8_t level;
+    uint8_t count;          // argument words following the header
+    uint16_t cpu;
+    uint32_t format;
+    uint64_t timestamp;     // nanoseconds since boot
+};
+
+static_assert(sizeof(FrameHeader) == 17);
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+
+// memcpy(), memmove() and memset() live in Memory.cpp. They start out with general-purpose
+// registers only, which works on any CPU at any point of boot. alternatives::apply() patches in
+// rep movsb/stosb, and init() picks the vector loops and when to switch to non-temporal stores
+// for the CPU we're running on.
+namespace memory
+{
+
+// Has to run on the BSP after fpu::init(), and every AP has to run fpu::init() before it
+// copies anything big.
+void init();
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Simo/Futex.h>
+
+// A sleeping lock for threads, in the three-state scheme from Drepper's "Futexes Are Tricky".
+// Taking and releasing it uncontended is one atomic instruction each; the futex calls only
+// happen once someone has to wait. Works with LockGuard, but not from interrupt handlers.
+class Mutex
+{
+public:
+    constexpr Mutex() = default;
+
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+
+    void lock()
+    {
+        uint32_t state = Unlocked;
+
+        if (!__atomic_compare_exchange_n(&m_state, &state, Locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            lockSlow(state);
+        }
+    }
+
+    bool tryLock()
+    {
+        uint32_t state = Unlocked;
+        return __atomic_compare_exchange_n(&m_state, &state, Locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
+    void unlock()
+    {
+        if (__atomic_exchange_n(&m_state, Unlocked, __ATOMIC_RELEASE) == Contended) {
+            futex::wake(&m_state, 1);
+        }
+    }
+
+private:
+    enum : uint32_t
+    {
+        Unlocked = 0,
+        Locked = 1,
+        Contended = 2,      // locked, and someone might be sleeping on it
+    };
+
+    void lockSlow(uint32_t state)
+    {
+        // once we've slept we can't tell whether there are more waiters, so we always
+        // take it as contended from here on
+        if (state != Contended) {
+            state = __atomic_exchange_n(&m_state, Contended, __ATOMIC_ACQUIRE);
+        }
+
+        while (state != Unlocked) {
+            futex::wait(&m_state, Contended);
+            state = __atomic_exchange_n(&m_state, Contended, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    uint32_t m_state = Unlocked;
+};
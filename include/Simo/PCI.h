@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace pci
+{
+
+struct Address
+{
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+};
+
+enum ConfigOffsets : uint8_t
+{
+    VendorId = 0x00,
+    DeviceId = 0x02,
+    Command = 0x04,
+    Status = 0x06,
+    HeaderType = 0x0E,
+    Bar0 = 0x10,
+    SubsystemId = 0x2E,
+    InterruptLine = 0x3C,
+};
+
+enum CommandFlags : uint16_t
+{
+    IoSpace = 1 << 0,
+    MemorySpace = 1 << 1,
+    BusMaster = 1 << 2,
+    InterruptDisable = 1 << 10,
+};
+
+uint32_t read32(Address address, uint8_t offset);
+uint16_t read16(Address address, uint8_t offset);
+uint8_t read8(Address address, uint8_t offset);
+void write32(Address address, uint8_t offset, uint32_t value);
+void write16(Address address, uint8_t offset, uint16_t value);
+
+// Brute-force scan of the configuration space, returns false if nothing matched.
+bool findDevice(uint16_t vendorId, uint16_t deviceId, Address* result);
+
+// Returns the base of an I/O port BAR, or 0 if the BAR is a memory BAR.
+uint16_t getIoBar(Address address, uint8_t bar);
+
+}
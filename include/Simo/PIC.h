@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace pic
+{
+
+// legacy IRQs are remapped to start at this vector so they don't collide with CPU exceptions
+constexpr uint8_t IRQ_BASE = 0x20;
+
+enum class Irq : uint8_t
+{
+    Timer = 0,
+    Keyboard = 1,
+    Cascade = 2,
+    Com2 = 3,
+    Com1 = 4,
+    Spurious = 7,
+    SpuriousSlave = 15,
+};
+
+constexpr uint8_t vectorFromIrq(Irq irq)
+{
+    return IRQ_BASE + static_cast<uint8_t>(irq);
+}
+
+void init();
+void mask(Irq irq);
+void unmask(Irq irq);
+void sendEOI(Irq irq);
+bool isSpurious(Irq irq);
+
+}
@@ -82,8 +82,9 @@ private:
     static constexpr bool canMapPage = !(disabledFlags & PMEFlags::PageSize);
 };
 
-// Intel docs says MAXPHYADDR is at most 52 on current platforms and I'd rather not deal with CPUID now
-// so I'll just pretend it's always 52
+// The architectural limit. The CPU's own MAXPHYADDR (cpu::physicalAddressBits()) is usually
+// lower and the bits in between are reserved, so the masks can stay constants as long as
+// nothing gets mapped above it, which mapping a page checks.
 const size_t MAXPHYADDR = 52;
 
 using PML4E = PageMapEntry<
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <STL/Bit.h>
 #include <STL/Flags.h>
@@ -19,7 +20,9 @@ enum class PMEFlags : uint64_t
     Present             = stl::bit(0),
     Write               = stl::bit(1),
     Supervisor          = stl::bit(2),
+    User                = stl::bit(2),  // it's really the U/S bit: set means ring 3 may access it
     PageWriteThrough    = stl::bit(3),
+    WriteCombining      = stl::bit(3),  // PWT alone picks PAT entry 1, which loadPat() makes WC
     PageCacheDisable    = stl::bit(4),
     Accessed            = stl::bit(5),
     Dirty               = stl::bit(6),
@@ -64,7 +67,37 @@ constexpr bool operator<(PhysicalAddress a, PhysicalAddress b)
     return static_cast<uint64_t>(a) < static_cast<uint64_t>(b);
 }
 
+// everything below the canonical hole
+constexpr uint64_t USER_SPACE_END = 0x0000'8000'0000'0000;
+
+inline bool isUserRange(uint64_t address, size_t length)
+{
+    return address < USER_SPACE_END && length <= USER_SPACE_END - address;
+}
+
+// Whether ring 3 can read the whole range, going by the page tables. Nothing unmaps user pages
+// yet, so once it's true it stays true.
+bool isUserAccessible(uint64_t address, size_t length);
+
 void init(const multiboot::Info*);
+
+// Loads the kernel's PAT on the calling CPU, they all have to agree. init() does this for the BSP.
+void loadPat();
+
 void mapRange(void* virtualAddr, PhysicalAddress physAddr, size_t length, stl::Flags<PMEFlags> flags);
 
+// Allocates zeroed, physically contiguous pages (e.g. for DMA) and maps them into kernel space.
+void* allocatePages(size_t count, PhysicalAddress* physAddr = nullptr);
+
+// Backs count pages at virtualAddr (in the lower half) with zeroed frames that ring 3 can access.
+void* allocateUserPages(void* virtualAddr, size_t count);
+
+// Maps memory the frame allocator doesn't own (MMIO, firmware tables, ...) without touching the frame map.
+void mapPageUntracked(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> flags);
+
+// Same as mapPageUntracked() for count contiguous pages, but only if none of them is mapped yet,
+// so there's never a stale TLB entry to flush. Returns false and maps nothing otherwise.
+bool mapUnusedRangeUntracked(void* virtualAddr, PhysicalAddress physAddr, size_t count, stl::Flags<PMEFlags> flags);
+void* mapPhysical(PhysicalAddress physAddr, size_t length, stl::Flags<PMEFlags> flags);
+
 }
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <STL/TypeTraits.h>
+
+// Per-CPU variables, without indexing arrays by CPU (and sharing their cache lines):
+//
+//     PER_CPU PerCpu<uint64_t> g_hits;
+//     percpu::add<g_hits>(1);
+//
+// They all end up in .percpu, which is linked at 0 and copied for every CPU at boot (see
+// linker.ld), so a variable's address is its offset into that copy, and the GS base points
+// at the current CPU's one. The scalar accessors are a single %gs-relative instruction each,
+// so neither an interrupt nor a migration can split them and they don't need preemptDisable().
+// Nothing here works before smp::initBsp().
+#define PER_CPU [[gnu::section(".percpu")]]
+
+template<typename T>
+class PerCpu
+{
+public:
+    using ValueType = T;
+
+    constexpr PerCpu() = default;
+
+    constexpr explicit PerCpu(const T& initial) :
+        m_value(initial)
+    {
+    }
+
+    PerCpu(const PerCpu&) = delete;
+    PerCpu& operator=(const PerCpu&) = delete;
+
+private:
+    // only the template every CPU's copy starts out as, nothing is mapped at this address
+    T m_value{};
+};
+
+namespace percpu
+{
+
+namespace detail
+{
+
+template<auto& Var>
+using ValueType = typename stl::RemoveReference<decltype(Var)>::ValueType;
+
+template<auto& Var>
+constexpr bool IS_SCALAR = sizeof(ValueType<Var>) <= 8 && (sizeof(ValueType<Var>) & (sizeof(ValueType<Var>) - 1)) == 0;
+
+}
+
+template<auto& Var>
+inline detail::ValueType<Var> read()
+{
+    static_assert(detail::IS_SCALAR<Var>, "use Local or localPointer() for bigger types");
+
+    detail::ValueType<Var> value;
+    asm volatile("mov %%gs:%c1, %0" : "=r"(value) : "i"(&Var) : "memory");
+
+    return value;
+}
+
+template<auto& Var>
+inline void write(detail::ValueType<Var> value)
+{
+    static_assert(detail::IS_SCALAR<Var>, "use Local or localPointer() for bigger types");
+
+    asm volatile("mov %1, %%gs:%c0" : : "i"(&Var), "r"(value) : "memory");
+}
+
+// Not atomic with respect to other CPUs, it doesn't have to be: nobody else writes our copy.
+template<auto& Var>
+inline void add(detail::ValueType<Var> value)
+{
+    static_assert(detail::IS_SCALAR<Var>, "use Local or localPointer() for bigger types");
+
+    asm volatile("add %1, %%gs:%c0" : : "i"(&Var), "r"(value) : "memory", "cc");
+}
+
+// The calling CPU's copy. Only good for as long as we can't migrate, see Local.
+template<auto& Var>
+inline detail::ValueType<Var>* localPointer()
+{
+    auto base = reinterpret_cast<char*>(&smp::current());
+    return reinterpret_cast<detail::ValueType<Var>*>(base + reinterpret_cast<uintptr_t>(&Var));
+}
+
+// Some other CPU's copy, e.g. to add up counters.
+template<auto& Var>
+inline detail::ValueType<Var>* remotePointer(size_t cpu)
+{
+    auto base = reinterpret_cast<char*>(&smp::cpu(cpu));
+    return reinterpret_cast<detail::ValueType<Var>*>(base + reinterpret_cast<uintptr_t>(&Var));
+}
+
+// The calling CPU's copy, with preemption off for as long as this is alive. Interrupt
+// handlers can still get in, so anything they touch too needs interrupts off instead.
+template<auto& Var>
+class Local
+{
+public:
+    Local()
+    {
+        sched::preemptDisable();
+        m_value = localPointer<Var>();
+    }
+
+    ~Local()
+    {
+        sched::preemptEnable();
+    }
+
+    Local(const Local&) = delete;
+    Local& operator=(const Local&) = delete;
+
+    detail::ValueType<Var>& operator*() const { return *m_value; }
+    detail::ValueType<Var>* operator->() const { return m_value; }
+
+private:
+    detail::ValueType<Var>* m_value;
+};
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <Simo/Scheduler.h>
+
+namespace rcu
+{
+
+// Quiescent-state-based RCU. Readers only keep the scheduler from switching away, and every
+// context switch, idle entry and timer tick outside of a read-side section counts as a
+// quiescent state for that CPU. A grace period is over once every CPU has gone through one.
+
+struct Head
+{
+    Head* next;
+    uint64_t gracePeriod;
+    void (*callback)(Head*);
+};
+
+// Read-side sections must not sleep or yield.
+inline void readLock()
+{
+    sched::preemptDisable();
+}
+
+inline void readUnlock()
+{
+    sched::preemptEnable();
+}
+
+template<typename T>
+inline T* dereference(T* const& pointer)
+{
+    return __atomic_load_n(&pointer, __ATOMIC_ACQUIRE);
+}
+
+// Publishes a fully initialized object to readers.
+template<typename T>
+inline void assign(T*& pointer, T* value)
+{
+    __atomic_store_n(&pointer, value, __ATOMIC_RELEASE);
+}
+
+class ReadGuard
+{
+public:
+    ReadGuard() { readLock(); }
+    ~ReadGuard() { readUnlock(); }
+
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+};
+
+// Runs callback(head) on this CPU once every reader that could have seen the object is gone.
+// Callbacks run from the timer interrupt or the scheduler with interrupts disabled.
+void call(Head* head, void (*callback)(Head*));
+
+// heap::free()s the pointer after a grace period.
+void free(void* ptr);
+
+// Waits for a full grace period. Yields, so not from interrupt context.
+void synchronize();
+
+// Called by the scheduler: once per CPU when it starts scheduling, and on every quiescent state.
+void cpuOnline();
+void quiescentState();
+
+}
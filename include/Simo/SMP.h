@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Simo/GDT.h>
+
+namespace smp
+{
+
+constexpr size_t MAX_CPUS = 64;
+
+// where startAps() copies the real mode entry code, identity mapped
+constexpr uint64_t TRAMPOLINE_BASE = 0x8000;
+
+// Starts every CPU's copy of .percpu (see PerCpu.h), and the GS base points at it.
+struct CpuData
+{
+    CpuData* self;      // must stay first, current() reads it through %gs:0
+    uint64_t kernelStack;       // top of the running thread's stack, for SYSCALL; offsets are used in SyscallEntry.S
+    uint64_t userStack;         // scratch for the user RSP while SYSCALL switches stacks
+    uint32_t index;
+    uint32_t apicId;
+    void* stackTop;
+    bool online;
+    bool needResched;           // a time slice ran out while preemption was disabled
+    uint32_t preemptCount;      // only ever touched through %gs, see sched::preemptDisable()
+    gdt::Tables gdt;
+};
+
+// Sets up the BSP's GDT, TSS and per-CPU area. Must run after paging::init() and before interrupts::init().
+void initBsp();
+
+// Enumerates CPUs from the MADT and starts every AP. Needs ACPI, the local APIC and the TSC.
+void startAps();
+
+// volatile because a thread can move to another CPU between two calls, so the read mustn't be merged
+inline CpuData& current()
+{
+    CpuData* cpu;
+    asm volatile("movq %%gs:0, %0" : "=r"(cpu));
+
+    return *cpu;
+}
+
+size_t cpuCount();
+CpuData& cpu(size_t index);
+
+}
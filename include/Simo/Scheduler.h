@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Simo/SMP.h>
+#include <STL/Flags.h>
+
+namespace sched
+{
+
+constexpr uint32_t TICK_HZ = 1000;
+constexpr uint32_t TIME_SLICE_TICKS = 10;
+constexpr size_t THREAD_STACK_SIZE = 16 * 1024;
+
+using ThreadEntry = void (*)(void*);
+
+enum class ThreadState : uint8_t
+{
+    Ready,
+    Running,
+    Blocked,
+    Dead,
+};
+
+enum class ThreadFlags : uint32_t
+{
+    None = 0,
+    Pinned = 1 << 0,        // never stolen by another CPU
+    UsesFpu = 1 << 1,       // gets an XSAVE area that's switched along with the thread
+};
+
+struct Thread
+{
+    uint64_t sp;            // saved by switchContext, everything else lives on the stack
+    Thread* next;           // run queue link
+    ThreadState state;
+    bool onCpu;             // still executing (or switching away), must not be picked up elsewhere yet
+    uint32_t id;
+    uint32_t cpu;
+    stl::Flags<ThreadFlags> flags;
+    void* stack;
+    void* fpuState;
+    uint32_t fpuCpu;        // CPU whose registers held this thread's extended state last
+    ThreadEntry entry;
+    void* arg;
+    const char* name;
+};
+
+struct CpuStats
+{
+    uint64_t ticks;
+    uint64_t idleTicks;
+    uint64_t contextSwitches;
+    uint64_t preemptions;
+    uint64_t stealAttempts;
+    uint64_t steals;
+    uint64_t threadsStolen;
+    uint64_t fpuRestoresSkipped;
+};
+
+// Creates a thread and queues it on the given CPU (or the calling CPU when cpu < 0).
+Thread* createThread(const char* name, ThreadEntry entry, void* arg, int cpu = -1,
+    stl::Flags<ThreadFlags> flags = ThreadFlags::None);
+
+// Turns the calling context into this CPU's idle thread, starts the tick and never returns.
+[[noreturn]] void start();
+
+void yield();
+[[noreturn]] void exit();
+
+// Puts the current thread to sleep until someone calls wake() on it.
+// The caller must have interrupts disabled and set state to Blocked beforehand.
+void block();
+void wake(Thread* thread);
+
+// Keeps the timer from switching away from the current thread, and with that pins it to this CPU.
+// These nest. The count has to be changed with a single %gs-relative instruction, otherwise we
+// could get preempted between finding our CpuData and updating it.
+inline void preemptDisable()
+{
+    asm volatile("incl %%gs:%c0" : : "i"(offsetof(smp::CpuData, preemptCount)) : "memory");
+}
+
+void preemptEnable();
+
+void beginFpu();
+void endFpu();
+
+// Hands every vector register to kernel code until the scope ends. If the current thread's
+// extended state is live in the registers it's saved first and restored at the end; otherwise
+// the registers only held a copy of someone's saved state, and the scheduler is told to load it
+// again instead. Keeps preemption off throughout, doesn't nest, and can't be used in interrupt
+// handlers or with a spinlock held (the end can yield). Those stick to fpu::BorrowedRegisters.
+class FpuScope
+{
+public:
+    FpuScope()
+    {
+        beginFpu();
+    }
+
+    ~FpuScope()
+    {
+        endFpu();
+    }
+
+    FpuScope(const FpuScope&) = delete;
+    FpuScope& operator=(const FpuScope&) = delete;
+};
+
+// Whether an FpuScope is allowed here: interrupts are on and nothing holds preemption off.
+bool canUseFpuScope();
+
+Thread* currentThread();
+const CpuStats& stats(size_t cpu);
+void dumpStats();
+
+}
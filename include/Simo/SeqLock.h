@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+// Sequence counter for data with a single writer (or writers serialized some other way) and
+// readers that can't take a lock, e.g. because they're in ring 3. An odd count means a write
+// is in progress, and readers retry whenever the count moved while they were reading.
+class SeqCount
+{
+public:
+    uint32_t readBegin() const
+    {
+        uint32_t sequence;
+
+        while ((sequence = __atomic_load_n(&m_sequence, __ATOMIC_ACQUIRE)) & 1) {
+            asm volatile("pause");
+        }
+
+        return sequence;
+    }
+
+    bool readRetry(uint32_t sequence) const
+    {
+        // the data reads have to be done before we look at the count again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        return __atomic_load_n(&m_sequence, __ATOMIC_RELAXED) != sequence;
+    }
+
+    void writeBegin()
+    {
+        __atomic_store_n(&m_sequence, m_sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void writeEnd()
+    {
+        __atomic_store_n(&m_sequence, m_sequence + 1, __ATOMIC_RELEASE);
+    }
+
+private:
+    uint32_t m_sequence = 0;
+};
@@ -1,8 +1,23 @@
 #pragma once
 
+#include <stddef.h>
+
 namespace serial
 {
 
-void write(char value);
+// Switches the output from polling to the IRQ-driven TX ring. Needs interrupts::init() first.
+void init();
+
+// Queues the bytes for transmission. Falls back to writeSync() before init() and after enterPanicMode().
+void write(const char* data, size_t length);
+
+// Busy-waits until the UART can take the byte. Bypasses the TX ring entirely.
+void writeSync(char value);
+
+// Synchronously drains everything still sitting in the TX ring.
+void flush();
+
+// Flushes the TX ring and makes all further writes synchronous. Use this on paths that never return.
+void enterPanicMode();
 
 }
\ No newline at end of file
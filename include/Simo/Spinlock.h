@@ -0,0 +1,434 @@
+#pragma once
+
+#include <Simo/CPU.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Utils.h>
+
+struct LockStats
+{
+    uint64_t acquires;
+    uint64_t contended;         // acquires that had to wait
+    uint64_t maxHoldCycles;     // in TSC cycles
+};
+
+// Stats are only ever updated by the lock holder, so they don't need to be atomic.
+// The untracked version compiles away to nothing.
+template<bool Enabled>
+class LockStatsTracker
+{
+public:
+    constexpr explicit LockStatsTracker(const char* = nullptr) {}
+
+protected:
+    void acquired(bool) {}
+    void released() {}
+};
+
+template<>
+class LockStatsTracker<true>
+{
+public:
+    constexpr explicit LockStatsTracker(const char* name = nullptr) :
+        m_name(name)
+    {
+    }
+
+    const char* name() const { return m_name; }
+    const LockStats& stats() const { return m_stats; }
+
+protected:
+    void acquired(bool contended)
+    {
+        m_stats.acquires++;
+        m_stats.contended += contended;
+        m_lockedAt = cpu::rdtsc();
+    }
+
+    void released()
+    {
+        auto held = cpu::rdtsc() - m_lockedAt;
+        if (held > m_stats.maxHoldCycles) {
+            m_stats.maxHoldCycles = held;
+        }
+    }
+
+private:
+    const char* m_name = nullptr;
+    LockStats m_stats = {};
+    uint64_t m_lockedAt = 0;
+};
+
+using TrackedLock = LockStatsTracker<true>;
+
+// Test-and-test-and-set, so waiters spin on a shared cache line instead of hammering it.
+// Cheapest when uncontended, but unfair.
+template<bool TrackStats = false>
+class BasicSpinlock : public LockStatsTracker<TrackStats>
+{
+public:
+    constexpr explicit BasicSpinlock(const char* name = nullptr) :
+        LockStatsTracker<TrackStats>(name)
+    {
+    }
+
+    BasicSpinlock(const BasicSpinlock&) = delete;
+    BasicSpinlock& operator=(const BasicSpinlock&) = delete;
+
+    void lock()
+    {
+        bool contended = false;
+
+        while (__atomic_exchange_n(&m_locked, true, __ATOMIC_ACQUIRE)) {
+            contended = true;
+
+            while (__atomic_load_n(&m_locked, __ATOMIC_RELAXED)) {
+                cpu::pause();
+            }
+        }
+
+        this->acquired(contended);
+    }
+
+    bool tryLock()
+    {
+        if (__atomic_load_n(&m_locked, __ATOMIC_RELAXED) || __atomic_exchange_n(&m_locked, true, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+
+        this->acquired(false);
+        return true;
+    }
+
+    void unlock()
+    {
+        this->released();
+        __atomic_store_n(&m_locked, false, __ATOMIC_RELEASE);
+    }
+
+    uint64_t lockIrqSave()
+    {
+        auto flags = interrupts::saveAndDisable();
+        lock();
+
+        return flags;
+    }
+
+    void unlockIrqRestore(uint64_t flags)
+    {
+        unlock();
+        interrupts::restore(flags);
+    }
+
+private:
+    bool m_locked = false;
+};
+
+// FIFO fair: everyone takes a ticket and waits for it to be served.
+template<bool TrackStats = false>
+class BasicTicketLock : public LockStatsTracker<TrackStats>
+{
+public:
+    constexpr explicit BasicTicketLock(const char* name = nullptr) :
+        LockStatsTracker<TrackStats>(name)
+    {
+    }
+
+    BasicTicketLock(const BasicTicketLock&) = delete;
+    BasicTicketLock& operator=(const BasicTicketLock&) = delete;
+
+    void lock()
+    {
+        auto ticket = __atomic_fetch_add(&m_next, 1, __ATOMIC_RELAXED);
+        bool contended = false;
+
+        while (__atomic_load_n(&m_serving, __ATOMIC_ACQUIRE) != ticket) {
+            contended = true;
+            cpu::pause();
+        }
+
+        this->acquired(contended);
+    }
+
+    bool tryLock()
+    {
+        // only succeeds if nobody holds or waits for the lock
+        auto serving = __atomic_load_n(&m_serving, __ATOMIC_RELAXED);
+        auto expected = serving;
+
+        if (!__atomic_compare_exchange_n(&m_next, &expected, serving + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return false;
+        }
+
+        this->acquired(false);
+        return true;
+    }
+
+    void unlock()
+    {
+        this->released();
+        __atomic_store_n(&m_serving, m_serving + 1, __ATOMIC_RELEASE);
+    }
+
+    uint64_t lockIrqSave()
+    {
+        auto flags = interrupts::saveAndDisable();
+        lock();
+
+        return flags;
+    }
+
+    void unlockIrqRestore(uint64_t flags)
+    {
+        unlock();
+        interrupts::restore(flags);
+    }
+
+private:
+    uint32_t m_next = 0;
+    uint32_t m_serving = 0;
+};
+
+// Every waiter spins on its own node, so a handoff only touches the next waiter's cache line.
+// For the heavily contended paths. The node has to stay alive until unlock().
+template<bool TrackStats = false>
+class BasicMcsLock : public LockStatsTracker<TrackStats>
+{
+public:
+    struct Node
+    {
+        Node* next = nullptr;
+        bool locked = false;
+    };
+
+    constexpr explicit BasicMcsLock(const char* name = nullptr) :
+        LockStatsTracker<TrackStats>(name)
+    {
+    }
+
+    BasicMcsLock(const BasicMcsLock&) = delete;
+    BasicMcsLock& operator=(const BasicMcsLock&) = delete;
+
+    void lock(Node& node)
+    {
+        node.next = nullptr;
+        node.locked = true;
+
+        auto predecessor = __atomic_exchange_n(&m_tail, &node, __ATOMIC_ACQ_REL);
+        if (predecessor) {
+            __atomic_store_n(&predecessor->next, &node, __ATOMIC_RELEASE);
+
+            while (__atomic_load_n(&node.locked, __ATOMIC_ACQUIRE)) {
+                cpu::pause();
+            }
+        }
+
+        this->acquired(predecessor != nullptr);
+    }
+
+    bool tryLock(Node& node)
+    {
+        node.next = nullptr;
+        node.locked = false;
+
+        Node* expected = nullptr;
+        if (!__atomic_compare_exchange_n(&m_tail, &expected, &node, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return false;
+        }
+
+        this->acquired(false);
+        return true;
+    }
+
+    void unlock(Node& node)
+    {
+        this->released();
+
+        auto next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE);
+        if (!next) {
+            auto expected = &node;
+            if (__atomic_compare_exchange_n(&m_tail, &expected, nullptr, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                return;
+            }
+
+            // someone swapped themselves in but hasn't linked up yet
+            while (!(next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE))) {
+                cpu::pause();
+            }
+        }
+
+        __atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
+    }
+
+    uint64_t lockIrqSave(Node& node)
+    {
+        auto flags = interrupts::saveAndDisable();
+        lock(node);
+
+        return flags;
+    }
+
+    void unlockIrqRestore(Node& node, uint64_t flags)
+    {
+        unlock(node);
+        interrupts::restore(flags);
+    }
+
+private:
+    Node* m_tail = nullptr;
+};
+
+using Spinlock = BasicSpinlock<false>;
+using TicketLock = BasicTicketLock<false>;
+using McsLock = BasicMcsLock<false>;
+
+using TrackedSpinlock = BasicSpinlock<true>;
+using TrackedTicketLock = BasicTicketLock<true>;
+using TrackedMcsLock = BasicMcsLock<true>;
+
+template<typename TLock>
+class LockGuard
+{
+public:
+    explicit LockGuard(TLock& lock) :
+        m_lock(lock)
+    {
+        m_lock.lock();
+    }
+
+    ~LockGuard()
+    {
+        m_lock.unlock();
+    }
+
+    LockGuard(const LockGuard&) = delete;
+    LockGuard& operator=(const LockGuard&) = delete;
+
+private:
+    TLock& m_lock;
+};
+
+template<typename TLock>
+class IrqLockGuard
+{
+public:
+    explicit IrqLockGuard(TLock& lock) :
+        m_lock(lock),
+        m_flags(lock.lockIrqSave())
+    {
+    }
+
+    ~IrqLockGuard()
+    {
+        m_lock.unlockIrqRestore(m_flags);
+    }
+
+    IrqLockGuard(const IrqLockGuard&) = delete;
+    IrqLockGuard& operator=(const IrqLockGuard&) = delete;
+
+private:
+    TLock& m_lock;
+    uint64_t m_flags;
+};
+
+// How long a panic waits for a lock whose holder might be this CPU, interrupted inside the
+// critical section, or one that's never coming back.
+constexpr size_t PANIC_SPINS = 1'000'000;
+
+// IrqLockGuard for the locks output goes through. After panic::enter() it gives up after
+// PANIC_SPINS and the caller goes ahead without the lock: garbled output beats none.
+template<typename TLock>
+class OutputLockGuard
+{
+public:
+    explicit OutputLockGuard(TLock& lock) :
+        m_lock(lock),
+        m_flags(interrupts::saveAndDisable())
+    {
+        if (!panic::active()) {
+            m_lock.lock();
+            return;
+        }
+
+        m_locked = false;
+        for (size_t i = 0; i < PANIC_SPINS && !m_locked; i++) {
+            m_locked = m_lock.tryLock();
+            cpu::pause();
+        }
+    }
+
+    ~OutputLockGuard()
+    {
+        if (m_locked) {
+            m_lock.unlock();
+        }
+
+        interrupts::restore(m_flags);
+    }
+
+    OutputLockGuard(const OutputLockGuard&) = delete;
+    OutputLockGuard& operator=(const OutputLockGuard&) = delete;
+
+private:
+    TLock& m_lock;
+    uint64_t m_flags;
+    bool m_locked = true;
+};
+
+// MCS locks need a queue node, the guards bring their own
+template<bool TrackStats>
+class LockGuard<BasicMcsLock<TrackStats>>
+{
+public:
+    explicit LockGuard(BasicMcsLock<TrackStats>& lock) :
+        m_lock(lock)
+    {
+        m_lock.lock(m_node);
+    }
+
+    ~LockGuard()
+    {
+        m_lock.unlock(m_node);
+    }
+
+    LockGuard(const LockGuard&) = delete;
+    LockGuard& operator=(const LockGuard&) = delete;
+
+private:
+    BasicMcsLock<TrackStats>& m_lock;
+    typename BasicMcsLock<TrackStats>::Node m_node;
+};
+
+template<bool TrackStats>
+class IrqLockGuard<BasicMcsLock<TrackStats>>
+{
+public:
+    explicit IrqLockGuard(BasicMcsLock<TrackStats>& lock) :
+        m_lock(lock),
+        m_flags(lock.lockIrqSave(m_node))
+    {
+    }
+
+    ~IrqLockGuard()
+    {
+        m_lock.unlockIrqRestore(m_node, m_flags);
+    }
+
+    IrqLockGuard(const IrqLockGuard&) = delete;
+    IrqLockGuard& operator=(const IrqLockGuard&) = delete;
+
+private:
+    BasicMcsLock<TrackStats>& m_lock;
+    typename BasicMcsLock<TrackStats>::Node m_node;
+    uint64_t m_flags;
+};
+
+#define LOCK_STATS_CONCAT_(a, b) a##b
+#define LOCK_STATS_CONCAT(a, b) LOCK_STATS_CONCAT_(a, b)
+
+// Adds a tracked lock to what dumpLockStats() prints. The pointers end up in the .lockstats
+// section, so nothing has to run at boot to register them.
+#define REGISTER_LOCK_STATS(lock) \
+    [[gnu::used, gnu::section(".lockstats")]] \
+    static const TrackedLock* const LOCK_STATS_CONCAT(g_lockStats, __LINE__) = &(lock)
+
+void dumpLockStats();
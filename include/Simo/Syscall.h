@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace syscalls
+{
+
+// rax holds the number, arguments go in rdi, rsi, rdx, r10, r8 and r9 like on Linux. The
+// result comes back in rax; rcx and r11 are clobbered by SYSCALL/SYSRET themselves.
+enum class Number : uint64_t
+{
+    Null = 0,
+    Exit = 1,
+    Yield = 2,
+    IoRingSetup = 3,        // see ioring::setup()
+    IoRingEnter = 4,        // see ioring::enter()
+};
+
+constexpr uint64_t INVALID_SYSCALL = ~uint64_t(0);
+
+using Handler = uint64_t (*)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+// Programs STAR/LSTAR/SFMASK and turns on SYSCALL on the calling CPU.
+void init();
+
+// Drops the calling kernel thread to ring 3 at entry, with arg in rdi. Doesn't come back;
+// the thread ends when the user code calls Exit.
+[[noreturn]] void enterUserMode(uint64_t entry, uint64_t stack, uint64_t arg);
+
+}
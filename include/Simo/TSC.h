@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <Simo/CPU.h>
+#include <Simo/SeqLock.h>
+
+namespace tsc
+{
+
+// Where ring 3 finds the time page, read-only.
+constexpr uint64_t TIME_PAGE_ADDRESS = 0x0000'7fff'ffff'f000;
+
+// Everything needed to turn a TSC value into nanoseconds since boot:
+// baseNanoseconds + ((tsc - baseCycles) * multiplier) >> shift
+struct TimePage
+{
+    SeqCount sequence;
+    uint32_t shift;
+    uint64_t multiplier;
+    uint64_t baseCycles;
+    uint64_t baseNanoseconds;
+};
+
+// Doesn't touch anything but the page, so user code can use it as is.
+inline uint64_t readTimePage(const TimePage& page)
+{
+    uint32_t sequence;
+    uint64_t nanoseconds;
+
+    do {
+        sequence = page.sequence.readBegin();
+
+        auto delta = cpu::rdtsc() - page.baseCycles;
+        nanoseconds = page.baseNanoseconds + static_cast<uint64_t>((static_cast<unsigned __int128>(delta) * page.multiplier) >> page.shift);
+    } while (page.sequence.readRetry(sequence));
+
+    return nanoseconds;
+}
+
+// Calibrates the TSC against PIT channel 2 and publishes the time page. Must run after
+// paging::init() and before anything below is used.
+void init();
+
+uint64_t frequency();
+uint64_t cyclesToNanoseconds(uint64_t cycles);
+
+// Nanoseconds since init(), through the time page.
+uint64_t now();
+
+void delayMicroseconds(uint64_t us);
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <STL/Format.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -24,6 +25,17 @@ inline void doAssert(bool expression, const char* msg, const char* file = __buil
 
 #define ASSERT(expr) assertion::doAssert((expr), #expr)
 
+namespace panic
+{
+
+// Gets output out of a CPU that's about to halt: serial goes synchronous, the log ring gets
+// drained, and from then on output only waits a bounded time for its locks (see OutputLockGuard).
+void enter();
+
+bool active();
+
+}
+
 inline void outb(uint16_t port, uint8_t value)
 {
     asm volatile("outb %0, %1" : : "a"(value), "d"(port));
@@ -38,6 +50,58 @@ inline uint8_t inb(uint16_t port)
     return value;
 }
 
-using PutcharHandler = void (*)(char);
+inline void outw(uint16_t port, uint16_t value)
+{
+    asm volatile("outw %0, %1" : : "a"(value), "d"(port));
+}
+
+inline uint16_t inw(uint16_t port)
+{
+    uint16_t value = 0;
+
+    asm volatile("inw %1, %0" : "=a"(value) : "d"(port));
+
+    return value;
+}
+
+inline void outl(uint16_t port, uint32_t value)
+{
+    asm volatile("outl %0, %1" : : "a"(value), "d"(port));
+}
+
+inline uint32_t inl(uint16_t port)
+{
+    uint32_t value = 0;
+
+    asm volatile("inl %1, %0" : "=a"(value) : "d"(port));
+
+    return value;
+}
 
-void setPutcharHandler(PutcharHandler handler);
+// Output devices get whole chunks of text, printf() hands them over a buffer at a time.
+// Serial is there from the start, up to three more can be added.
+using OutputHandler = void (*)(const char* data, size_t length);
+
+bool addOutputHandler(OutputHandler handler);
+void removeOutputHandler(OutputHandler handler);
+
+// Passes the data to every output handler, all under one lock.
+void writeOutput(const char* data, size_t length);
+
+// For binary data only a host-side tool understands: goes to COM1 alone, whatever else is
+// installed, but under the same lock so it doesn't end up in the middle of a line.
+void writeSerialOutput(const char* data, size_t length);
+
+// printf() with the format parsed and the arguments checked at compile time (see
+// STL/Format.h). Output reaches the handlers in chunks of up to 256 bytes.
+//
+//     print<"rip: %016lx\n">(ctx->ip);
+template<stl::FormatString Format, typename... Args>
+void print(Args... args)
+{
+    char buffer[256];
+    stl::FormatBuffer out(buffer, sizeof(buffer), &writeOutput);
+
+    stl::formatTo<Format>(out, args...);
+    out.finish();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <STL/Bit.h>
+
+// Legacy (virtio 0.9.5) PCI transport, which is what QEMU exposes by default on i440fx.
+namespace virtio
+{
+
+constexpr uint16_t VENDOR_ID = 0x1AF4;
+
+enum LegacyRegisters : uint16_t
+{
+    DeviceFeatures = 0x00,
+    GuestFeatures = 0x04,
+    QueueAddress = 0x08,
+    QueueSize = 0x0C,
+    QueueSelect = 0x0E,
+    QueueNotify = 0x10,
+    DeviceStatus = 0x12,
+    IsrStatus = 0x13,
+    DeviceConfig = 0x14,
+};
+
+enum StatusFlags : uint8_t
+{
+    Acknowledge = 1,
+    Driver = 2,
+    DriverOk = 4,
+    Failed = 128,
+};
+
+enum DescriptorFlags : uint16_t
+{
+    Next = 1,
+    Write = 2,
+};
+
+enum RingFlags : uint16_t
+{
+    AvailNoInterrupt = 1,
+    UsedNoNotify = 1,
+};
+
+constexpr size_t QUEUE_ALIGN = 4096;
+
+struct Descriptor
+{
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+};
+
+struct AvailRing
+{
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[0];
+};
+
+struct UsedElement
+{
+    uint32_t id;
+    uint32_t len;
+};
+
+struct UsedRing
+{
+    uint16_t flags;
+    uint16_t idx;
+    UsedElement ring[0];
+};
+
+constexpr size_t alignQueue(size_t size)
+{
+    return stl::align(QUEUE_ALIGN, size);
+}
+
+// descriptor table and available ring share the first part, the used ring starts on the next page
+constexpr size_t usedRingOffset(uint16_t queueSize)
+{
+    return alignQueue(sizeof(Descriptor) * queueSize + sizeof(uint16_t) * (3 + queueSize));
+}
+
+constexpr size_t queueByteSize(uint16_t queueSize)
+{
+    return usedRingOffset(queueSize) + alignQueue(sizeof(uint16_t) * 3 + sizeof(UsedElement) * queueSize);
+}
+
+}
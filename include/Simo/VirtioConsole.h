@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace virtio::console
+{
+
+// Looks for a legacy virtio-console device and sets up port 0's transmit queue.
+// Returns false if there's no such device, in which case write() must not be used.
+bool init();
+
+// Buffers the bytes and kicks the device when a buffer fills up, or when they finished a line
+// and the last kick was 10ms ago or more. Meant to be passed to addOutputHandler().
+void write(const char* data, size_t length);
+
+// Hands any partially filled buffer to the device.
+void flush();
+
+// Same, but at most every 10ms. The timer tick calls this on CPU 0.
+void flushIfDue();
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace work
+{
+
+struct Item
+{
+    Item* next;
+    void (*function)(Item*);
+};
+
+// Starts one pinned worker thread per online CPU. Call after smp::startAps().
+void init();
+bool running();
+
+// Runs item->function(item) on the given CPU's worker. The item has to stay alive until then.
+void queue(Item* item, uint32_t cpu);
+
+struct Range
+{
+    size_t begin;
+    size_t end;
+};
+
+void parallelFor(Range range, size_t grain, void (*invoke)(const void* fn, Range chunk), const void* fn);
+
+// Splits range into chunks of `grain` and runs fn(chunk) for them on every online CPU,
+// including the calling one, which also waits for the rest to finish. Runs everything
+// inline before init(). Don't call it with interrupts off, or from a work item.
+template<typename TFn>
+void parallelFor(Range range, size_t grain, const TFn& fn)
+{
+    parallelFor(range, grain, [](const void* fn, Range chunk) {
+        (*static_cast<const TFn*>(fn))(chunk);
+    }, &fn);
+}
+
+}
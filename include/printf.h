@@ -56,6 +56,24 @@ extern "C" {
 void _putchar(char character);
 
 
+/**
+ * Output a whole chunk of formatted text, used by printf() instead of _putchar() whenever
+ * _printf_buffer_acquire() hands out a buffer to format into
+ * \param data Characters to output, not null terminated
+ * \param length Number of characters
+ */
+void _write(const char* data, size_t length);
+
+
+/**
+ * Scratch buffer for printf(), given back with _printf_buffer_release() when it's done
+ * \param size Receives the size of the buffer
+ * \return The buffer, or NULL to fall back to _putchar()
+ */
+char* _printf_buffer_acquire(size_t* size);
+void _printf_buffer_release(char* buffer);
+
+
 // if PRINTF_OVERRIDE_LIBC is is defined, the regular printf() API is overridden by macro defines
 // and internal underscore-appended functions like printf_() are used to avoid conflicts with
 // LIBC defined printf() functions.
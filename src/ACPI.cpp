@@ -0,0 +1,114 @@
+#include <Simo/ACPI.h>
+#include <Simo/Multiboot.h>
+#include <Simo/Paging.h>
+#include <Simo/Utils.h>
+#include <printf.h>
+
+namespace acpi
+{
+
+namespace
+{
+
+const SdtHeader* g_rootTable = nullptr;
+bool g_extended = false;
+
+bool signatureMatches(const char* a, const char* b, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool checksumValid(const void* data, size_t length)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        sum = static_cast<uint8_t>(sum + bytes[i]);
+    }
+
+    return sum == 0;
+}
+
+// We don't know a table's size until we've seen its header, so map the header first and then the whole thing.
+const SdtHeader* mapTable(uint64_t physAddr)
+{
+    const auto address = paging::PhysicalAddress{physAddr};
+
+    auto header = static_cast<const SdtHeader*>(
+        paging::mapPhysical(address, sizeof(SdtHeader), paging::PMEFlags::Present));
+
+    auto table = static_cast<const SdtHeader*>(
+        paging::mapPhysical(address, header->length, paging::PMEFlags::Present));
+
+    if (!checksumValid(table, table->length)) {
+        printf("ACPI: bad checksum on table %.4s\n", table->signature);
+    }
+
+    return table;
+}
+
+const Rsdp* findRsdp(const multiboot::Info* info)
+{
+    const Rsdp* rsdp = nullptr;
+
+    for (const auto& tag : info) {
+        // prefer the ACPI 2.0 copy if GRUB gave us both
+        if (tag.type == multiboot::TagType::AcpiNew) {
+            return reinterpret_cast<const Rsdp*>(static_cast<const multiboot::NewAcpiTag&>(tag).rsdp);
+        } else if (tag.type == multiboot::TagType::AcpiOld) {
+            rsdp = reinterpret_cast<const Rsdp*>(static_cast<const multiboot::OldAcpiTag&>(tag).rsdp);
+        }
+    }
+
+    return rsdp;
+}
+
+}
+
+bool init(const multiboot::Info* info)
+{
+    auto rsdp = findRsdp(info);
+    if (!rsdp || !signatureMatches(rsdp->signature, "RSD PTR ", 8)) {
+        printf("ACPI: no RSDP\n");
+        return false;
+    }
+
+    g_extended = rsdp->revision >= 2 && rsdp->xsdtAddress != 0;
+    g_rootTable = mapTable(g_extended ? rsdp->xsdtAddress : rsdp->rsdtAddress);
+
+    printf("ACPI: revision %d, %s at %p\n", rsdp->revision, g_extended ? "XSDT" : "RSDT", g_rootTable);
+
+    return true;
+}
+
+const SdtHeader* findTable(const char* signature)
+{
+    if (!g_rootTable) {
+        return nullptr;
+    }
+
+    auto entryBase = reinterpret_cast<const uint8_t*>(g_rootTable) + sizeof(SdtHeader);
+    auto entrySize = g_extended ? sizeof(uint64_t) : sizeof(uint32_t);
+    auto numEntries = (g_rootTable->length - sizeof(SdtHeader)) / entrySize;
+
+    for (size_t i = 0; i < numEntries; i++) {
+        uint64_t physAddr = 0;
+        memcpy(&physAddr, entryBase + i * entrySize, entrySize);
+
+        auto table = mapTable(physAddr);
+        if (signatureMatches(table->signature, signature, 4)) {
+            return table;
+        }
+    }
+
+    return nullptr;
+}
+
+}
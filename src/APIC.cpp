@@ -0,0 +1,154 @@
+#include <Simo/APIC.h>
+#include <Simo/CPU.h>
+#include <Simo/Interrupt.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Paging.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+#include <printf.h>
+
+namespace apic
+{
+
+enum Registers : uint32_t
+{
+    Id = 0x020,
+    EndOfInterrupt = 0x0B0,
+    SpuriousVector = 0x0F0,
+    InterruptCommandLow = 0x300,
+    InterruptCommandHigh = 0x310,
+    LvtTimer = 0x320,
+    TimerInitialCount = 0x380,
+    TimerCurrentCount = 0x390,
+    TimerDivide = 0x3E0,
+};
+
+enum LvtFlags : uint32_t
+{
+    Masked = 1 << 16,
+    TimerPeriodic = 1 << 17,
+};
+
+// divide the bus clock by 16
+const uint32_t TIMER_DIVIDE_BY_16 = 0b0011;
+
+enum IcrFlags : uint32_t
+{
+    DeliveryFixed = 0b000 << 8,
+    DeliveryInit = 0b101 << 8,
+    DeliveryStartup = 0b110 << 8,
+    DeliveryPending = 1 << 12,
+    LevelAssert = 1 << 14,
+};
+
+namespace
+{
+
+volatile uint32_t* g_registers = nullptr;
+uint64_t g_timerTicksPerSecond = 0;
+
+uint32_t read(Registers reg)
+{
+    return g_registers[reg / sizeof(uint32_t)];
+}
+
+void write(Registers reg, uint32_t value)
+{
+    g_registers[reg / sizeof(uint32_t)] = value;
+}
+
+void sendCommand(uint32_t apicId, uint32_t command)
+{
+    interrupts::InterruptGuard guard;
+
+    write(InterruptCommandHigh, apicId << 24);
+    write(InterruptCommandLow, command);
+
+    while (read(InterruptCommandLow) & DeliveryPending) {
+        cpu::pause();
+    }
+}
+
+void enable()
+{
+    // software enable bit plus the spurious vector
+    write(SpuriousVector, stl::bit<uint32_t>(8) | SPURIOUS_VECTOR);
+}
+
+[[gnu::interrupt]] void spuriousHandler(interrupts::InterruptContext*)
+{
+    // spurious interrupts must not be acknowledged
+}
+
+}
+
+void init()
+{
+    auto base = cpu::readMsr(cpu::Msr::ApicBase);
+    auto physAddr = paging::PhysicalAddress{base & stl::bitmask(51, 12)};
+
+    g_registers = static_cast<volatile uint32_t*>(paging::mapPhysical(physAddr, paging::PAGE_SIZE,
+        paging::PMEFlags::Present | paging::PMEFlags::Write | paging::PMEFlags::PageCacheDisable));
+
+    interrupts::setHandler(SPURIOUS_VECTOR, spuriousHandler);
+    enable();
+
+    printf("local APIC at %016lx, BSP APIC ID %u\n", uint64_t(physAddr), id());
+}
+
+void initAp()
+{
+    enable();
+}
+
+uint32_t id()
+{
+    return read(Id) >> 24;
+}
+
+void sendEOI()
+{
+    write(EndOfInterrupt, 0);
+}
+
+void calibrateTimer()
+{
+    const uint64_t calibrationUs = 10'000;
+
+    write(TimerDivide, TIMER_DIVIDE_BY_16);
+    write(LvtTimer, Masked);
+    write(TimerInitialCount, 0xffff'ffff);
+
+    tsc::delayMicroseconds(calibrationUs);
+
+    auto elapsed = 0xffff'ffff - read(TimerCurrentCount);
+    write(TimerInitialCount, 0);
+
+    g_timerTicksPerSecond = uint64_t(elapsed) * 1'000'000 / calibrationUs;
+    printf("local APIC timer runs at %lu kHz\n", g_timerTicksPerSecond / 1000);
+}
+
+void startTimer(uint8_t vector, uint32_t hz)
+{
+    write(TimerDivide, TIMER_DIVIDE_BY_16);
+    write(LvtTimer, TimerPeriodic | vector);
+    write(TimerInitialCount, static_cast<uint32_t>(g_timerTicksPerSecond / hz));
+}
+
+void sendInit(uint32_t apicId)
+{
+    sendCommand(apicId, (DeliveryInit | LevelAssert).value());
+}
+
+void sendStartup(uint32_t apicId, uint8_t vectorPage)
+{
+    sendCommand(apicId, DeliveryStartup | vectorPage);
+}
+
+void sendIpi(uint32_t apicId, uint8_t vector)
+{
+    sendCommand(apicId, DeliveryFixed | vector);
+}
+
+}
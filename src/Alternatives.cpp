@@ -0,0 +1,81 @@
+#include <Simo/Alternatives.h>
+#include <Simo/CPU.h>
+#include <Simo/Interrupt.h>
+#include <printf.h>
+#include <stddef.h>
+
+extern "C" const alternatives::Entry _alternativesStart[];
+extern "C" const alternatives::Entry _alternativesEnd[];
+
+namespace alternatives
+{
+
+namespace
+{
+
+// the recommended multi-byte NOPs, one per length
+const uint8_t NOPS[][8] = {
+    {},
+    {0x90},
+    {0x66, 0x90},
+    {0x0f, 0x1f, 0x00},
+    {0x0f, 0x1f, 0x40, 0x00},
+    {0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+    {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+const size_t MAX_NOP = 8;
+
+template<typename T>
+T* resolve(const int32_t& offset)
+{
+    return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(&offset) + offset);
+}
+
+// Byte by byte, memcpy() itself may be one of the sites.
+void patch(volatile uint8_t* site, size_t siteLength, const uint8_t* replacement, size_t replacementLength)
+{
+    size_t i = 0;
+
+    for (; i < replacementLength; i++) {
+        site[i] = replacement[i];
+    }
+
+    while (i < siteLength) {
+        auto nop = (siteLength - i < MAX_NOP) ? siteLength - i : MAX_NOP;
+
+        for (size_t j = 0; j < nop; j++) {
+            site[i + j] = NOPS[nop][j];
+        }
+
+        i += nop;
+    }
+}
+
+}
+
+void apply()
+{
+    interrupts::InterruptGuard guard;
+    size_t patched = 0;
+    size_t total = static_cast<size_t>(_alternativesEnd - _alternativesStart);
+
+    for (auto entry = _alternativesStart; entry != _alternativesEnd; entry++) {
+        if (!cpu::hasFeature(static_cast<cpu::Feature>(entry->feature))) {
+            continue;
+        }
+
+        patch(resolve<volatile uint8_t>(entry->site), entry->siteLength,
+            resolve<const uint8_t>(entry->replacement), entry->replacementLength);
+        patched++;
+    }
+
+    // CPUID serializes, so nothing runs from a stale prefetch of the old bytes
+    cpu::cpuid(0);
+
+    printf("alternatives: patched %lu of %lu sites\n", patched, total);
+}
+
+}
@@ -0,0 +1,173 @@
+#include <Simo/Async.h>
+#include <Simo/Heap.h>
+#include <Simo/Interrupt.h>
+#include <Simo/PerCpu.h>
+#include <Simo/SMP.h>
+#include <Simo/Utils.h>
+
+namespace async
+{
+
+namespace
+{
+
+const size_t SIZE_CLASSES[] = {128, 256, 512, 1024};
+const size_t CLASS_COUNT = sizeof(SIZE_CLASSES) / sizeof(SIZE_CLASSES[0]);
+const size_t FRAMES_PER_REFILL = 16;
+
+struct FreeFrame
+{
+    FreeFrame* next;
+};
+
+// Only ever touched by its own CPU with interrupts off. A frame freed elsewhere simply
+// joins that CPU's list.
+struct FramePool
+{
+    FreeFrame* free[CLASS_COUNT] = {};
+};
+
+PER_CPU PerCpu<FramePool> g_pool;
+PER_CPU PerCpu<uint64_t> g_pooled;
+PER_CPU PerCpu<uint64_t> g_fromHeap;
+size_t g_largest = 0;
+
+size_t sizeClass(size_t size)
+{
+    for (size_t i = 0; i < CLASS_COUNT; i++) {
+        if (size <= SIZE_CLASSES[i]) {
+            return i;
+        }
+    }
+
+    return CLASS_COUNT;
+}
+
+// Carves a batch of frames out of one heap allocation. They're never given back.
+FreeFrame* refill(size_t sizeIndex)
+{
+    auto size = SIZE_CLASSES[sizeIndex];
+    auto chunk = static_cast<char*>(heap::allocate(size * FRAMES_PER_REFILL));
+
+    for (size_t i = 0; i < FRAMES_PER_REFILL - 1; i++) {
+        reinterpret_cast<FreeFrame*>(chunk + i * size)->next = reinterpret_cast<FreeFrame*>(chunk + (i + 1) * size);
+    }
+
+    reinterpret_cast<FreeFrame*>(chunk + (FRAMES_PER_REFILL - 1) * size)->next = nullptr;
+
+    return reinterpret_cast<FreeFrame*>(chunk);
+}
+
+struct Detached
+{
+    struct promise_type
+    {
+        static void* operator new(size_t size) { return allocateFrame(size); }
+        static void operator delete(void* frame, size_t size) { freeFrame(frame, size); }
+
+        Detached get_return_object() { return {}; }
+
+        // runs until the first co_await right away, and cleans up after itself at the end
+        stl::SuspendNever initial_suspend() noexcept { return {}; }
+        stl::SuspendNever final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        void unhandled_exception() {}
+    };
+};
+
+Detached runDetached(Task<> task, uint32_t cpu)
+{
+    co_await ResumeOn(cpu);
+    co_await task;
+}
+
+}
+
+void* allocateFrame(size_t size)
+{
+    auto sizeIndex = sizeClass(size);
+
+    if (size > __atomic_load_n(&g_largest, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&g_largest, size, __ATOMIC_RELAXED);
+    }
+
+    if (sizeIndex == CLASS_COUNT) {
+        percpu::add<g_fromHeap>(1);
+        return heap::allocate(size);
+    }
+
+    percpu::add<g_pooled>(1);
+
+    interrupts::InterruptGuard guard;
+    auto& pool = *percpu::localPointer<g_pool>();
+
+    if (!pool.free[sizeIndex]) {
+        pool.free[sizeIndex] = refill(sizeIndex);
+    }
+
+    auto frame = pool.free[sizeIndex];
+    pool.free[sizeIndex] = frame->next;
+
+    return frame;
+}
+
+void freeFrame(void* frame, size_t size)
+{
+    auto sizeIndex = sizeClass(size);
+
+    if (sizeIndex == CLASS_COUNT) {
+        heap::free(frame);
+        return;
+    }
+
+    interrupts::InterruptGuard guard;
+    auto& pool = *percpu::localPointer<g_pool>();
+
+    auto freeFrame = static_cast<FreeFrame*>(frame);
+    freeFrame->next = pool.free[sizeIndex];
+    pool.free[sizeIndex] = freeFrame;
+}
+
+FrameStats frameStats()
+{
+    FrameStats stats{};
+
+    for (size_t cpu = 0; cpu < smp::cpuCount(); cpu++) {
+        stats.pooled += *percpu::remotePointer<g_pooled>(cpu);
+        stats.fromHeap += *percpu::remotePointer<g_fromHeap>(cpu);
+    }
+
+    stats.largest = __atomic_load_n(&g_largest, __ATOMIC_RELAXED);
+
+    return stats;
+}
+
+void spawn(Task<> task, uint32_t cpu)
+{
+    ASSERT(work::running());
+    runDetached(stl::move(task), cpu);
+}
+
+void Event::set()
+{
+    if (__atomic_exchange_n(&m_state, Set, __ATOMIC_ACQ_REL) == Waiting) {
+        work::queue(&m_item, m_cpu);
+    }
+}
+
+bool Event::await_suspend(stl::CoroutineHandle<> awaiting)
+{
+    m_waiter = awaiting;
+    m_cpu = smp::current().index;
+    m_item.function = [](work::Item* item) {
+        // m_item is the first member
+        reinterpret_cast<Event*>(item)->m_waiter.resume();
+    };
+
+    // if set() got in first, don't suspend at all
+    uint32_t expected = Empty;
+    return __atomic_compare_exchange_n(&m_state, &expected, Waiting, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+}
@@ -0,0 +1,728 @@
+#include <Simo/Benchmark.h>
+#include <Simo/Async.h>
+#include <Simo/CPU.h>
+#include <Simo/FPU.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Idle.h>
+#include <Simo/Interrupt.h>
+#include <Simo/IoRing.h>
+#include <Simo/Log.h>
+#include <Simo/Mutex.h>
+#include <Simo/Paging.h>
+#include <Simo/RCU.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <Simo/Spinlock.h>
+#include <Simo/Syscall.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <Simo/WorkQueue.h>
+#include <STL/Hash.h>
+#include <printf.h>
+
+extern "C" const char userNullSyscallStart[];
+extern "C" const char userNullSyscallEnd[];
+extern "C" const char userIoRingStart[];
+extern "C" const char userIoRingEnd[];
+
+namespace bench
+{
+
+namespace
+{
+
+const uint64_t PING_PONG_ITERATIONS = 100'000;
+const uint64_t RCU_READ_ITERATIONS = 1'000'000;
+const uint64_t RCU_UPDATES = 1000;
+const size_t PARALLEL_ZERO_SIZE = 64_MiB;
+const size_t PARALLEL_ZERO_GRAIN = 256_KiB;
+const uint64_t WAKEUP_ITERATIONS = 1000;
+const uint64_t WAKEUP_SETTLE_US = 50;
+const uint64_t NULL_SYSCALL_ITERATIONS = 1'000'000;
+const uint64_t IORING_ITERATIONS = 1'000'000;
+const uint64_t CLOCK_READ_ITERATIONS = 1'000'000;
+
+// stays below a quarter of the ring, so the drainer doesn't wake up in the middle
+const uint64_t LOG_ITERATIONS = 128;
+const uint64_t MUTEX_ITERATIONS = 1'000'000;
+const uint64_t MUTEX_CONTENDED_ITERATIONS = 100'000;
+const uint64_t COROUTINE_HOPS = 100'000;
+const uint64_t FORMAT_ITERATIONS = 100'000;
+
+// every size copies about this much in total, but at least a few times
+const size_t MEMORY_SWEEP_MAX = 16_MiB;
+const size_t MEMORY_SWEEP_TOTAL = 64_MiB;
+const uint64_t MEMORY_SWEEP_MIN_ITERATIONS = 4;
+
+// fits in L2, so it's the hashing that gets measured rather than memory
+const size_t HASH_BUFFER_SIZE = 64_KiB;
+const size_t HASH_TOTAL = 64_MiB;
+
+// code page, data page, then the stack, once per program in BenchmarkUser.S
+const uint64_t USER_BENCH_BASE = 0x40'0000;
+const uint64_t USER_IORING_BASE = 0x80'0000;
+const size_t USER_BENCH_PAGES = 4;
+
+// left unmapped for the program to set its ring up at
+const uint64_t USER_IORING_RING = 0xC0'0000;
+
+// Lets the benchmark thread sleep until the worker threads it started are done.
+struct Workers
+{
+    uint32_t remaining;
+    sched::Thread* waiter;
+};
+
+void workerDone(Workers& workers)
+{
+    if (__atomic_sub_fetch(&workers.remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        sched::wake(workers.waiter);
+    }
+}
+
+// Calls startWorker(i) for every worker, then blocks until each of them called workerDone().
+template<typename TStart>
+void runWorkers(Workers& workers, uint32_t count, TStart&& startWorker)
+{
+    interrupts::InterruptGuard guard;
+
+    workers.remaining = count;
+    workers.waiter = sched::currentThread();
+    workers.waiter->state = sched::ThreadState::Blocked;
+
+    for (uint32_t i = 0; i < count; i++) {
+        startWorker(i);
+    }
+
+    sched::block();
+}
+
+struct PingPong
+{
+    Workers workers;
+    uint64_t start;
+    uint64_t end;
+};
+
+void pingPongThread(void* arg)
+{
+    auto& pingPong = *static_cast<PingPong*>(arg);
+
+    // whoever runs first starts the clock
+    uint64_t zero = 0;
+    auto now = cpu::rdtsc();
+    __atomic_compare_exchange_n(&pingPong.start, &zero, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    for (uint64_t i = 0; i < PING_PONG_ITERATIONS; i++) {
+        sched::yield();
+    }
+
+    __atomic_store_n(&pingPong.end, cpu::rdtsc(), __ATOMIC_RELAXED);
+    workerDone(pingPong.workers);
+}
+
+uint64_t runPingPong(stl::Flags<sched::ThreadFlags> flags)
+{
+    PingPong pingPong{};
+    auto cpu = static_cast<int>(smp::current().index);
+
+    runWorkers(pingPong.workers, 2, [&](uint32_t) {
+        sched::createThread("ping-pong", &pingPongThread, &pingPong, cpu, flags | sched::ThreadFlags::Pinned);
+    });
+
+    // every yield is one switch, timer preemptions are in the noise at this iteration count
+    return (pingPong.end - pingPong.start) / (2 * PING_PONG_ITERATIONS);
+}
+
+struct Config
+{
+    uint64_t generation;
+    uint64_t values[7];
+};
+
+Config* g_config = nullptr;
+TicketLock g_configLock;
+
+struct ReaderRun
+{
+    Workers workers;
+    bool useLock;
+    uint64_t totalCycles;
+    uint64_t checksum;
+};
+
+void readerThread(void* arg)
+{
+    auto& run = *static_cast<ReaderRun*>(arg);
+    uint64_t sum = 0;
+
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < RCU_READ_ITERATIONS; i++) {
+        if (run.useLock) {
+            LockGuard guard(g_configLock);
+            sum += g_config->values[i & 3];
+        } else {
+            rcu::ReadGuard guard;
+            sum += rcu::dereference(g_config)->values[i & 3];
+        }
+    }
+
+    auto cycles = cpu::rdtsc() - start;
+
+    __atomic_fetch_add(&run.totalCycles, cycles, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&run.checksum, sum, __ATOMIC_RELAXED);
+    workerDone(run.workers);
+}
+
+// Cycles per read with one reader pinned to each of the first `readers` CPUs.
+uint64_t runReaders(uint32_t readers, bool useLock)
+{
+    ReaderRun run{};
+    run.useLock = useLock;
+
+    runWorkers(run.workers, readers, [&](uint32_t i) {
+        sched::createThread("reader", &readerThread, &run, static_cast<int>(i), sched::ThreadFlags::Pinned);
+    });
+
+    return run.totalCycles / (readers * RCU_READ_ITERATIONS);
+}
+
+struct Sleeper
+{
+    sched::Thread* thread;
+    uint64_t wokenAt;
+    uint32_t wakeups;
+    bool stop;
+    bool done;
+};
+
+void sleeperThread(void* arg)
+{
+    auto& sleeper = *static_cast<Sleeper*>(arg);
+
+    while (true) {
+        {
+            interrupts::InterruptGuard guard;
+
+            sleeper.thread->state = sched::ThreadState::Blocked;
+            sched::block();
+        }
+
+        __atomic_store_n(&sleeper.wokenAt, cpu::rdtsc(), __ATOMIC_RELAXED);
+
+        if (__atomic_load_n(&sleeper.stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        __atomic_add_fetch(&sleeper.wakeups, 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&sleeper.done, true, __ATOMIC_RELEASE);
+}
+
+void waitUntilAsleep(const Sleeper& sleeper)
+{
+    while (__atomic_load_n(&sleeper.thread->state, __ATOMIC_ACQUIRE) != sched::ThreadState::Blocked
+        || __atomic_load_n(&sleeper.thread->onCpu, __ATOMIC_ACQUIRE)) {
+        cpu::pause();
+    }
+
+    // give its CPU time to actually go idle
+    tsc::delayMicroseconds(WAKEUP_SETTLE_US);
+}
+
+// Average cycles from wake() on this CPU until the sleeper runs on the other one.
+uint64_t measureWakeups(uint32_t cpu)
+{
+    Sleeper sleeper{};
+    sleeper.thread = sched::createThread("sleeper", &sleeperThread, &sleeper, static_cast<int>(cpu),
+        sched::ThreadFlags::Pinned);
+
+    uint64_t total = 0;
+
+    for (uint32_t i = 0; i < WAKEUP_ITERATIONS; i++) {
+        waitUntilAsleep(sleeper);
+
+        auto start = cpu::rdtsc();
+        sched::wake(sleeper.thread);
+
+        while (__atomic_load_n(&sleeper.wakeups, __ATOMIC_ACQUIRE) == i) {
+            cpu::pause();
+        }
+
+        total += __atomic_load_n(&sleeper.wokenAt, __ATOMIC_RELAXED) - start;
+    }
+
+    waitUntilAsleep(sleeper);
+    __atomic_store_n(&sleeper.stop, true, __ATOMIC_RELEASE);
+    sched::wake(sleeper.thread);
+
+    while (!__atomic_load_n(&sleeper.done, __ATOMIC_ACQUIRE)) {
+        cpu::pause();
+    }
+
+    return total / WAKEUP_ITERATIONS;
+}
+
+struct MutexRun
+{
+    Workers workers;
+    Mutex mutex;
+    uint64_t counter;
+    uint64_t start;
+};
+
+void mutexThread(void* arg)
+{
+    auto& run = *static_cast<MutexRun*>(arg);
+
+    uint64_t zero = 0;
+    auto now = cpu::rdtsc();
+    __atomic_compare_exchange_n(&run.start, &zero, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    for (uint64_t i = 0; i < MUTEX_CONTENDED_ITERATIONS; i++) {
+        LockGuard guard(run.mutex);
+        run.counter++;
+    }
+
+    workerDone(run.workers);
+}
+
+struct CoroutineRun
+{
+    Workers workers;
+    uint64_t cycles;
+};
+
+async::Task<uint64_t> hop(uint32_t cpu)
+{
+    co_await async::ResumeOn(cpu);
+    co_return 1;
+}
+
+async::Task<> hopLoop(CoroutineRun& run, uint32_t cpu)
+{
+    uint64_t hops = 0;
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < COROUTINE_HOPS; i++) {
+        hops += co_await hop(cpu);
+    }
+
+    run.cycles = (cpu::rdtsc() - start) / hops;
+    workerDone(run.workers);
+}
+
+// Shared with the code in BenchmarkUser.S, which lives in the data page.
+struct UserSyscallRun
+{
+    uint64_t iterations;
+    uint64_t cycles;
+};
+
+// Shared with userIoRingStart, which hardcodes the offsets.
+struct UserIoRingRun
+{
+    uint64_t ring;
+    uint64_t iterations;
+    int64_t rejected;       // what setting up a ring at address 0 returned
+    int64_t id;
+    uint64_t completed;
+    uint64_t cycles;
+    uint64_t done;
+};
+
+static_assert(offsetof(UserIoRingRun, rejected) == 16);
+static_assert(offsetof(UserIoRingRun, completed) == 32);
+static_assert(offsetof(UserIoRingRun, done) == 48);
+static_assert(ioring::SUBMISSION_ENTRIES == 128 && sizeof(ioring::SubmissionEntry) == 48);
+static_assert(ioring::COMPLETION_ENTRIES == 256 && sizeof(ioring::CompletionEntry) == 16);
+static_assert(offsetof(ioring::SharedRings, completions) == 6272);
+
+// Copies one of the programs in BenchmarkUser.S to base and returns its data page.
+char* loadUserProgram(uint64_t base, const char* start, const char* end)
+{
+    auto code = static_cast<char*>(paging::allocateUserPages(reinterpret_cast<void*>(base), USER_BENCH_PAGES));
+    memcpy(code, start, end - start);
+
+    return code + paging::PAGE_SIZE;
+}
+
+void userThread(void* arg)
+{
+    auto base = reinterpret_cast<uint64_t>(arg);
+
+    syscalls::enterUserMode(base, base + USER_BENCH_PAGES * paging::PAGE_SIZE, base + paging::PAGE_SIZE);
+}
+
+// Same CPU as the caller, so the user thread exiting is the only thing that can end its wait.
+void startUserProgram(uint64_t base)
+{
+    sched::createThread("user", &userThread, reinterpret_cast<void*>(base), static_cast<int>(smp::current().index),
+        sched::ThreadFlags::Pinned);
+}
+
+}
+
+void run(void*)
+{
+    printf("running benchmarks on CPU %u\n", smp::current().index);
+
+    contextSwitch();
+    rcuReaders();
+    parallelZero();
+    wakeupLatency();
+    nullSyscall();
+    ioRingNop();
+    clockRead();
+    mutexContention();
+    coroutineResume();
+    logRecord();
+    formatContext();
+    memorySweep();
+    hashThroughput();
+
+    printf("benchmarks done\n");
+    sched::dumpStats();
+    dumpLockStats();
+}
+
+void contextSwitch()
+{
+    auto plain = runPingPong(sched::ThreadFlags::None);
+    auto withFpu = runPingPong(sched::ThreadFlags::UsesFpu);
+
+    printf("context switch: %lu cycles (%lu ns), %lu cycles (%lu ns) with %lu bytes of %s state\n",
+        plain, tsc::cyclesToNanoseconds(plain), withFpu, tsc::cyclesToNanoseconds(withFpu), fpu::stateSize(),
+        fpu::hasXsaveopt() ? "XSAVEOPT" : (fpu::hasXsave() ? "XSAVE" : "FXSAVE"));
+}
+
+void rcuReaders()
+{
+    g_config = new Config{};
+
+    printf("readers  rcu cycles/read  ticket lock cycles/read\n");
+    for (uint32_t readers = 1; readers <= smp::cpuCount(); readers++) {
+        auto rcuCycles = runReaders(readers, false);
+        auto lockCycles = runReaders(readers, true);
+
+        printf("%7u  %15lu  %23lu\n", readers, rcuCycles, lockCycles);
+    }
+
+    // the update side: publish a new copy, hand the old one to rcu::free()
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < RCU_UPDATES; i++) {
+        auto config = new Config{*g_config};
+        config->generation++;
+
+        auto old = g_config;
+        rcu::assign(g_config, config);
+        rcu::free(old);
+    }
+
+    auto updateCycles = (cpu::rdtsc() - start) / RCU_UPDATES;
+
+    start = cpu::rdtsc();
+    rcu::synchronize();
+    auto synchronizeCycles = cpu::rdtsc() - start;
+
+    printf("rcu update: %lu cycles, synchronize: %lu ns\n", updateCycles, tsc::cyclesToNanoseconds(synchronizeCycles));
+}
+
+void parallelZero()
+{
+    auto buffer = static_cast<char*>(paging::allocatePages(PARALLEL_ZERO_SIZE / paging::PAGE_SIZE));
+
+    auto start = cpu::rdtsc();
+    memset(buffer, 0, PARALLEL_ZERO_SIZE);
+    auto serial = tsc::cyclesToNanoseconds(cpu::rdtsc() - start);
+
+    start = cpu::rdtsc();
+    work::parallelFor({0, PARALLEL_ZERO_SIZE}, PARALLEL_ZERO_GRAIN, [&](work::Range chunk) {
+        memset(buffer + chunk.begin, 0, chunk.end - chunk.begin);
+    });
+    auto parallel = tsc::cyclesToNanoseconds(cpu::rdtsc() - start);
+
+    printf("zeroing %lu MiB: %lu us on one CPU, %lu us with parallelFor on %lu\n",
+        PARALLEL_ZERO_SIZE / 1_MiB, serial / 1000, parallel / 1000, smp::cpuCount());
+}
+
+void wakeupLatency()
+{
+    if (smp::cpuCount() < 2) {
+        printf("wakeup latency: needs a second CPU\n");
+        return;
+    }
+
+    // CPU 0 runs us, the sleeper gets CPU 1 to itself
+    idle::setMwaitEnabled(false);
+    auto halt = measureWakeups(1);
+
+    printf("wakeup latency: %lu ns with HLT and an IPI", tsc::cyclesToNanoseconds(halt));
+
+    if (idle::hasMwait()) {
+        idle::setMwaitEnabled(true);
+        auto mwait = measureWakeups(1);
+
+        printf(", %lu ns with MWAIT", tsc::cyclesToNanoseconds(mwait));
+    }
+
+    printf("\n");
+    idle::setMwaitEnabled(true);
+    idle::dumpStats();
+}
+
+void nullSyscall()
+{
+    auto run = reinterpret_cast<UserSyscallRun*>(loadUserProgram(USER_BENCH_BASE, userNullSyscallStart, userNullSyscallEnd));
+    run->iterations = NULL_SYSCALL_ITERATIONS;
+
+    startUserProgram(USER_BENCH_BASE);
+
+    while (__atomic_load_n(&run->cycles, __ATOMIC_ACQUIRE) == 0) {
+        sched::yield();
+    }
+
+    auto cycles = run->cycles / NULL_SYSCALL_ITERATIONS;
+    printf("null syscall: %lu cycles (%lu ns) round trip\n", cycles, tsc::cyclesToNanoseconds(cycles));
+}
+
+void ioRingNop()
+{
+    auto run = reinterpret_cast<UserIoRingRun*>(loadUserProgram(USER_IORING_BASE, userIoRingStart, userIoRingEnd));
+    run->ring = USER_IORING_RING;
+    run->iterations = IORING_ITERATIONS;
+
+    startUserProgram(USER_IORING_BASE);
+
+    while (__atomic_load_n(&run->done, __ATOMIC_ACQUIRE) == 0) {
+        sched::yield();
+    }
+
+    if (run->id < 0) {
+        printf("io ring: setup failed, %ld at address 0\n", run->rejected);
+        return;
+    }
+
+    // the ring belongs to the user thread, so this has to be refused
+    auto foreign = ioring::enter(static_cast<uint64_t>(run->id), 1, 0);
+
+    auto cycles = run->cycles / IORING_ITERATIONS;
+    printf("io ring: %lu cycles (%lu ns) per Nop through enter(), %lu of %lu completed, "
+        "%ld at address 0, %ld entering from another thread\n",
+        cycles, tsc::cyclesToNanoseconds(cycles), run->completed, IORING_ITERATIONS, run->rejected, foreign);
+}
+
+void clockRead()
+{
+    uint64_t sum = 0;
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < CLOCK_READ_ITERATIONS; i++) {
+        sum += tsc::now();
+    }
+
+    auto cycles = (cpu::rdtsc() - start) / CLOCK_READ_ITERATIONS;
+    printf("clock read through the time page: %lu cycles (%lu ns), checksum %lx\n",
+        cycles, tsc::cyclesToNanoseconds(cycles), sum & 0xff);
+}
+
+void mutexContention()
+{
+    Mutex mutex;
+    uint64_t counter = 0;
+
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < MUTEX_ITERATIONS; i++) {
+        LockGuard guard(mutex);
+        counter++;
+    }
+
+    auto uncontended = (cpu::rdtsc() - start) / MUTEX_ITERATIONS;
+
+    // at least two threads, so there's something to fight over even on one CPU
+    auto threads = smp::cpuCount() < 2 ? 2 : static_cast<uint32_t>(smp::cpuCount());
+    MutexRun run{};
+
+    runWorkers(run.workers, threads, [&](uint32_t i) {
+        sched::createThread("mutex", &mutexThread, &run, static_cast<int>(i % smp::cpuCount()), sched::ThreadFlags::Pinned);
+    });
+
+    // includes waking us up, which is noise at this iteration count
+    auto end = cpu::rdtsc();
+
+    ASSERT(run.counter == threads * MUTEX_CONTENDED_ITERATIONS);
+    auto contended = (end - run.start) / (threads * MUTEX_CONTENDED_ITERATIONS);
+
+    printf("mutex: %lu cycles uncontended, %lu cycles per acquire with %u threads fighting over it\n",
+        uncontended, contended, threads);
+}
+
+void coroutineResume()
+{
+    CoroutineRun run{};
+    auto cpu = smp::current().index;
+
+    runWorkers(run.workers, 1, [&](uint32_t) {
+        async::spawn(hopLoop(run, cpu), cpu);
+    });
+
+    auto frames = async::frameStats();
+    printf("coroutine suspend and resume through the executor: %lu cycles (%lu ns), frames up to %lu bytes\n",
+        run.cycles, tsc::cyclesToNanoseconds(run.cycles), frames.largest);
+}
+
+void logRecord()
+{
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < LOG_ITERATIONS; i++) {
+        klog::write(klog::Level::Info, "log record benchmark %lu", i);
+    }
+
+    auto logged = (cpu::rdtsc() - start) / LOG_ITERATIONS;
+
+#ifdef SIMO_LOG_BINARY
+    // only in binary builds, anywhere else the frames would end up on the terminal
+    start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < LOG_ITERATIONS; i++) {
+        KLOG_BINARY(klog::Level::Info, "binary log record benchmark %lu", i);
+    }
+
+    auto binary = (cpu::rdtsc() - start) / LOG_ITERATIONS;
+    printf("binary log record: %lu cycles (%lu ns)\n", binary, tsc::cyclesToNanoseconds(binary));
+#endif
+
+    start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < LOG_ITERATIONS; i++) {
+        printf("printf benchmark %lu\n", i);
+    }
+
+    auto printed = (cpu::rdtsc() - start) / LOG_ITERATIONS;
+
+    printf("log record: %lu cycles (%lu ns), synchronous printf: %lu cycles (%lu ns)\n",
+        logged, tsc::cyclesToNanoseconds(logged), printed, tsc::cyclesToNanoseconds(printed));
+}
+
+void formatContext()
+{
+    interrupts::InterruptContext context{0xffffffff80012345, 0x8, 0x246, 0xffffffff80200f58, 0x10};
+    char buffer[128];
+
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < FORMAT_ITERATIONS; i++) {
+        // makes the compiler load the fields again every time instead of formatting constants
+        asm volatile("" : : "r"(&context), "r"(buffer) : "memory");
+        snprintf(buffer, sizeof(buffer), interrupts::CONTEXT_FORMAT, context.ip, context.cs, context.flags,
+            context.sp, context.ss);
+    }
+
+    auto printed = (cpu::rdtsc() - start) / FORMAT_ITERATIONS;
+
+    start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < FORMAT_ITERATIONS; i++) {
+        asm volatile("" : : "r"(&context), "r"(buffer) : "memory");
+        stl::format<interrupts::CONTEXT_FORMAT>(buffer, sizeof(buffer), context.ip, context.cs, context.flags,
+            context.sp, context.ss);
+    }
+
+    auto formatted = (cpu::rdtsc() - start) / FORMAT_ITERATIONS;
+
+    printf("interrupt context format: snprintf %lu cycles (%lu ns), stl::format %lu cycles (%lu ns)\n",
+        printed, tsc::cyclesToNanoseconds(printed), formatted, tsc::cyclesToNanoseconds(formatted));
+}
+
+void memorySweep()
+{
+    auto dst = static_cast<char*>(paging::allocatePages(MEMORY_SWEEP_MAX / paging::PAGE_SIZE));
+    auto src = static_cast<char*>(paging::allocatePages(MEMORY_SWEEP_MAX / paging::PAGE_SIZE));
+
+    // touches every page once, so the first size doesn't pay for the TLB misses
+    memset(src, 0x5a, MEMORY_SWEEP_MAX);
+    memset(dst, 0, MEMORY_SWEEP_MAX);
+
+    for (size_t size = 1; size <= MEMORY_SWEEP_MAX; size *= 4) {
+        auto iterations = (MEMORY_SWEEP_TOTAL / size > MEMORY_SWEEP_MIN_ITERATIONS) ? MEMORY_SWEEP_TOTAL / size
+            : MEMORY_SWEEP_MIN_ITERATIONS;
+
+        auto start = cpu::rdtsc();
+
+        for (uint64_t i = 0; i < iterations; i++) {
+            // keeps the size a runtime value, otherwise gcc inlines the small copies
+            asm volatile("" : "+r"(size) : "r"(dst), "r"(src) : "memory");
+            memcpy(dst, src, size);
+        }
+
+        auto copied = (cpu::rdtsc() - start) / iterations;
+
+        start = cpu::rdtsc();
+
+        for (uint64_t i = 0; i < iterations; i++) {
+            asm volatile("" : "+r"(size) : "r"(dst) : "memory");
+            memset(dst, 0, size);
+        }
+
+        auto set = (cpu::rdtsc() - start) / iterations;
+
+        // bytes per cycle with two decimals
+        auto copyRate = size * 100 / (copied ? copied : 1);
+        auto setRate = size * 100 / (set ? set : 1);
+
+        printf("%8lu bytes: memcpy %8lu cycles (%lu.%02lu B/cycle), memset %8lu cycles (%lu.%02lu B/cycle)\n",
+            size, copied, copyRate / 100, copyRate % 100, set, setRate / 100, setRate % 100);
+    }
+}
+
+template<typename THash>
+void printHashThroughput(const char* name, const char* buffer, size_t size, THash&& hash)
+{
+    auto iterations = HASH_TOTAL / size;
+    uint64_t sink = 0;
+
+    auto start = cpu::rdtsc();
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        // keeps gcc from hoisting the hash out of the loop
+        asm volatile("" : : "r"(buffer) : "memory");
+        sink += hash(buffer, size);
+    }
+
+    auto ns = tsc::cyclesToNanoseconds(cpu::rdtsc() - start);
+    asm volatile("" : : "r"(sink));
+
+    // bytes per nanosecond is GB/s, with two decimals
+    auto rate = iterations * size * 100 / (ns ? ns : 1);
+    printf("%-14s %6lu bytes: %lu.%02lu GB/s\n", name, size, rate / 100, rate % 100);
+}
+
+void hashThroughput()
+{
+    auto buffer = static_cast<char*>(paging::allocatePages(HASH_BUFFER_SIZE / paging::PAGE_SIZE));
+
+    for (size_t i = 0; i < HASH_BUFFER_SIZE; i++) {
+        buffer[i] = static_cast<char>(i * 131);
+    }
+
+    const size_t sizes[] = {64, 4_KiB, HASH_BUFFER_SIZE};
+
+    for (auto size : sizes) {
+        printHashThroughput("crc32c", buffer, size, [](const char* data, size_t length) {
+            return stl::crc32c(data, length);
+        });
+        printHashThroughput("crc32c tables", buffer, size, [](const char* data, size_t length) {
+            return stl::crc32cSoftware(data, length);
+        });
+        printHashThroughput("hash64", buffer, size, [](const char* data, size_t length) {
+            return stl::hash64(data, length);
+        });
+    }
+}
+
+}
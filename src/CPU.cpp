@@ -0,0 +1,102 @@
+#include <Simo/CPU.h>
+#include <STL/Bit.h>
+#include <printf.h>
+
+namespace cpu
+{
+
+namespace
+{
+
+const uint32_t EXTENDED_LEAVES = 0x8000'0000;
+
+struct Features
+{
+    uint32_t words[static_cast<size_t>(FeatureWord::Count)];
+    uint8_t physicalAddressBits;
+    uint8_t linearAddressBits;
+    uint64_t archCapabilities;
+};
+
+Features g_features = {{}, 52, 48, 0};
+
+void setWord(FeatureWord word, uint32_t value)
+{
+    g_features.words[static_cast<size_t>(word)] = value;
+}
+
+}
+
+void detectFeatures()
+{
+    auto maxLeaf = cpuid(0).eax;
+    auto maxExtendedLeaf = cpuid(EXTENDED_LEAVES).eax;
+
+    auto leaf1 = cpuid(1);
+    setWord(FeatureWord::Leaf1Ecx, leaf1.ecx);
+    setWord(FeatureWord::Leaf1Edx, leaf1.edx);
+
+    if (maxLeaf >= 7) {
+        auto leaf7 = cpuid(7, 0);
+        setWord(FeatureWord::Leaf7Ebx, leaf7.ebx);
+        setWord(FeatureWord::Leaf7Ecx, leaf7.ecx);
+        setWord(FeatureWord::Leaf7Edx, leaf7.edx);
+    }
+
+    if (maxLeaf >= 0xD && hasFeature(Feature::Xsave)) {
+        setWord(FeatureWord::LeafDSub1Eax, cpuid(0xD, 1).eax);
+    }
+
+    if (maxExtendedLeaf >= EXTENDED_LEAVES + 1) {
+        auto extended1 = cpuid(EXTENDED_LEAVES + 1);
+        setWord(FeatureWord::Extended1Ecx, extended1.ecx);
+        setWord(FeatureWord::Extended1Edx, extended1.edx);
+    }
+
+    if (maxExtendedLeaf >= EXTENDED_LEAVES + 7) {
+        setWord(FeatureWord::Extended7Edx, cpuid(EXTENDED_LEAVES + 7).edx);
+    }
+
+    if (maxExtendedLeaf >= EXTENDED_LEAVES + 8) {
+        auto sizes = cpuid(EXTENDED_LEAVES + 8).eax;
+        g_features.physicalAddressBits = static_cast<uint8_t>(sizes & 0xff);
+        g_features.linearAddressBits = static_cast<uint8_t>((sizes >> 8) & 0xff);
+    } else {
+        // what a CPU without the leaf is architecturally guaranteed to support
+        g_features.physicalAddressBits = hasFeature(Feature::Pages1G) ? 40 : 36;
+    }
+
+    if (hasFeature(Feature::ArchCapabilities)) {
+        g_features.archCapabilities = readMsr(Msr::ArchCapabilities);
+    }
+
+    printf("cpu: %u-bit physical, %u-bit linear addresses, arch capabilities %lx%s%s%s%s%s%s\n",
+        g_features.physicalAddressBits, g_features.linearAddressBits, g_features.archCapabilities,
+        hasFeature(Feature::Avx2) ? ", AVX2" : "", hasFeature(Feature::Erms) ? ", ERMS" : "",
+        hasFeature(Feature::Fsrm) ? ", FSRM" : "", hasFeature(Feature::Xsaveopt) ? ", XSAVEOPT" : "",
+        hasFeature(Feature::Rdtscp) ? ", RDTSCP" : "", hasFeature(Feature::Hypervisor) ? ", hypervisor" : "");
+}
+
+bool hasFeature(Feature feature)
+{
+    auto index = static_cast<uint16_t>(feature);
+
+    return (g_features.words[index / 32] & stl::bit(index % 32)) != 0;
+}
+
+uint8_t physicalAddressBits()
+{
+    return g_features.physicalAddressBits;
+}
+
+uint8_t linearAddressBits()
+{
+    return g_features.linearAddressBits;
+}
+
+uint64_t archCapabilities()
+{
+    return g_features.archCapabilities;
+}
+
+}
@@ -1,22 +1,61 @@
 #include <Simo/Kernel.h>
 #include <Simo/Console.h>
+#include <Simo/CPU.h>
+#include <Simo/Spinlock.h>
+#include <Simo/TSC.h>
 #include <Simo/Utils.h>
 #include <STL/Array.h>
+#include <STL/Bit.h>
 
 namespace
 {
 
 const size_t CONSOLE_WIDTH = 80;
 const size_t CONSOLE_HEIGHT = 25;
+const uint64_t FLUSH_INTERVAL_US = 10'000;
+
+static_assert(CONSOLE_HEIGHT <= 32, "dirty lines are tracked in a uint32_t");
 
 size_t x;
-size_t y = 79; // start printing at the bottom
+size_t y = CONSOLE_HEIGHT - 1; // start printing at the bottom
 console::Color background;
 console::Color foreground;
 
 using ConsoleBuffer = stl::Array<uint16_t, CONSOLE_WIDTH * CONSOLE_HEIGHT>;
 ConsoleBuffer* vgaBuffer = nullptr;
 
+// Everything is drawn here first, VGA memory is uncached and only ever gets written by
+// flush(). Screen row r lives in g_lines[(g_top + r) % CONSOLE_HEIGHT], so scrolling just
+// moves g_top instead of copying the whole screen.
+uint16_t g_lines[CONSOLE_HEIGHT][CONSOLE_WIDTH];
+size_t g_top = 0;
+uint32_t g_dirty = 0;       // one bit per screen row
+uint64_t g_lastFlush = 0;
+
+// protects the cursor, the colors and the buffer contents
+TrackedSpinlock g_lock{"console"};
+REGISTER_LOCK_STATS(g_lock);
+
+uint16_t* screenLine(size_t row)
+{
+    return g_lines[(g_top + row) % CONSOLE_HEIGHT];
+}
+
+void flushLocked()
+{
+    auto dirty = g_dirty;
+
+    while (dirty) {
+        auto row = static_cast<size_t>(__builtin_ctz(dirty));
+        dirty &= dirty - 1;
+
+        memcpy(&vgaBuffer->at(row * CONSOLE_WIDTH), screenLine(row), CONSOLE_WIDTH * sizeof(uint16_t));
+    }
+
+    __atomic_store_n(&g_dirty, 0, __ATOMIC_RELAXED);
+    g_lastFlush = cpu::rdtsc();
+}
+
 }
 
 namespace console
@@ -26,47 +65,62 @@ void init()
 {
     // running the constructor will just overwrite the vga buffer :()
     //vgaBuffer = new (reinterpret_cast<void*>(0xb8000)) ConsoleBuffer();
-    vgaBuffer = reinterpret_cast<ConsoleBuffer*>(0xb8000);
+    vgaBuffer = reinterpret_cast<ConsoleBuffer*>(VGA_BUFFER_ADDRESS);
+
+    // the one time we read VGA memory, so whatever's on screen (the boot splash) scrolls along
+    memcpy(g_lines, vgaBuffer->data(), sizeof(g_lines));
     setForegroundColor(Color::LightGrey);
     setBackgroundColor(Color::Black);
 }
 
 void clear()
 {
+    OutputLockGuard guard(g_lock);
+
     x = 0;
     y = 0;
-    memset(vgaBuffer->data(), 0, vgaBuffer->byteSize());
+    memset(g_lines, 0, sizeof(g_lines));
+    g_dirty = (1u << CONSOLE_HEIGHT) - 1;
+    flushLocked();
+}
+
+void flush()
+{
+    // the timer calls this on every tick, make the common case cheap
+    if (__atomic_load_n(&g_dirty, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    OutputLockGuard guard(g_lock);
+    flushLocked();
 }
 
 void setForegroundColor(Color c)
 {
+    OutputLockGuard guard(g_lock);
     foreground = c;
 }
 
 void setBackgroundColor(Color c)
 {
+    OutputLockGuard guard(g_lock);
     background = c;
 }
 
 void setPosition(size_t newX, size_t newY)
 {
+    OutputLockGuard guard(g_lock);
+
     x = (newX < CONSOLE_WIDTH) ? newX : x;
     y = (newY < CONSOLE_HEIGHT) ? newY : y;
 }
 
 void scrollSingleLine()
 {
-    memmove(
-        &vgaBuffer->at(0),
-        &vgaBuffer->at(CONSOLE_WIDTH),
-        CONSOLE_WIDTH * (CONSOLE_HEIGHT - 1) * sizeof(uint16_t)
-    );
-
-    memset(
-        &vgaBuffer->at((CONSOLE_HEIGHT - 1) * CONSOLE_WIDTH),
-        0,
-        CONSOLE_WIDTH * sizeof(uint16_t)
-    );
+    // the old top line becomes the new bottom one, and every row on screen changed
+    memset(screenLine(0), 0, CONSOLE_WIDTH * sizeof(uint16_t));
+    g_top = (g_top + 1) % CONSOLE_HEIGHT;
+    g_dirty = (1u << CONSOLE_HEIGHT) - 1;
 }
 
 void moveByOffset(size_t xOff, size_t yOff)
@@ -117,7 +171,7 @@ void incrementPosition(bool column, bool row)
     }
 }
 
-void putChar(char c)
+void putCharLocked(char c)
 {
     if (c == '\n') {
         //incrementPosition(false, true);
@@ -132,10 +186,44 @@ void putChar(char c)
         }
     } else {
         uint16_t value = (uint16_t(background) << 12) | (uint16_t(foreground) << 8) | uint8_t(c);
-        vgaBuffer->at(y * CONSOLE_WIDTH + x) = value;
+        screenLine(y)[x] = value;
+        g_dirty |= stl::bit(y);
         //incrementPosition(true, false);
         moveByOffset(1, 0);
     }
 }
 
+void flushIfDue()
+{
+    // a burst of output goes out in one go, the timer picks up whatever's left
+    if (cpu::rdtsc() - g_lastFlush >= tsc::frequency() * FLUSH_INTERVAL_US / 1'000'000) {
+        flushLocked();
+    }
+}
+
+void putChar(char c)
+{
+    OutputLockGuard guard(g_lock);
+    putCharLocked(c);
+
+    if (c == '\n') {
+        flushIfDue();
+    }
+}
+
+void write(const char* data, size_t length)
+{
+    OutputLockGuard guard(g_lock);
+    bool newline = false;
+
+    for (size_t i = 0; i < length; i++) {
+        putCharLocked(data[i]);
+        newline |= data[i] == '\n';
+    }
+
+    if (newline) {
+        flushIfDue();
+    }
+}
+
 }
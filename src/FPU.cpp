@@ -0,0 +1,190 @@
+#include <Simo/FPU.h>
+#include <Simo/Alternatives.h>
+#include <Simo/CPU.h>
+#include <Simo/Heap.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+#include <printf.h>
+
+namespace fpu
+{
+
+namespace
+{
+
+enum Cr0 : uint64_t
+{
+    MonitorCoprocessor = stl::bit(1),
+    Emulation = stl::bit(2),
+    TaskSwitched = stl::bit(3),
+    NumericError = stl::bit(5),
+};
+
+enum Cr4 : uint64_t
+{
+    OsFxsr = stl::bit(9),
+    OsXmmExcept = stl::bit(10),
+    OsXsave = stl::bit(18),
+};
+
+enum Xcr0 : uint64_t
+{
+    X87 = stl::bit(0),
+    Sse = stl::bit(1),
+    Avx = stl::bit(2),
+};
+
+const size_t FXSAVE_SIZE = 512;
+const size_t STATE_ALIGN = 64;
+const uint16_t DEFAULT_FCW = 0x037F;
+const uint32_t DEFAULT_MXCSR = 0x1F80;
+
+bool g_hasXsave = false;
+bool g_hasXsaveopt = false;
+uint64_t g_xcr0 = 0;
+size_t g_stateSize = FXSAVE_SIZE;
+
+uint64_t readCR0()
+{
+    uint64_t value;
+    asm volatile("movq %%cr0, %0" : "=r"(value));
+
+    return value;
+}
+
+void writeCR0(uint64_t value)
+{
+    asm volatile("movq %0, %%cr0" : : "r"(value) : "memory");
+}
+
+uint64_t readCR4()
+{
+    uint64_t value;
+    asm volatile("movq %%cr4, %0" : "=r"(value));
+
+    return value;
+}
+
+void writeCR4(uint64_t value)
+{
+    asm volatile("movq %0, %%cr4" : : "r"(value) : "memory");
+}
+
+void writeXCR0(uint64_t value)
+{
+    asm volatile("xsetbv" : : "c"(0), "a"(static_cast<uint32_t>(value)), "d"(static_cast<uint32_t>(value >> 32)));
+}
+
+}
+
+void init()
+{
+    auto hasXsave = cpu::hasFeature(cpu::Feature::Xsave);
+
+    // no emulation, #MF instead of the legacy FERR# pin, and no lazy switching through TS
+    auto cr0 = readCR0();
+    cr0 &= ~(Emulation | TaskSwitched);
+    cr0 |= MonitorCoprocessor | NumericError;
+    writeCR0(cr0);
+
+    auto cr4 = readCR4() | OsFxsr | OsXmmExcept;
+    if (hasXsave) {
+        cr4 |= OsXsave;
+    }
+
+    writeCR4(cr4);
+
+    if (hasXsave) {
+        auto supported = cpu::cpuid(0xD, 0);
+        auto xcr0 = (X87 | Sse | Avx) & supported.eax;
+
+        writeXCR0(xcr0);
+
+        // ebx is the size needed for what's enabled in XCR0 right now
+        auto enabled = cpu::cpuid(0xD, 0);
+
+        // only the BSP's answers are kept, the APs are assumed to match
+        if (g_xcr0 == 0) {
+            g_hasXsave = true;
+            g_hasXsaveopt = cpu::hasFeature(cpu::Feature::Xsaveopt);
+            g_xcr0 = xcr0;
+            g_stateSize = enabled.ebx;
+
+            printf("XSAVE%s, XCR0 %lx, %lu byte save area\n", g_hasXsaveopt ? "OPT" : "", g_xcr0, g_stateSize);
+        }
+    }
+
+    asm volatile("fninit");
+}
+
+bool hasXsave()
+{
+    return g_hasXsave;
+}
+
+bool hasXsaveopt()
+{
+    return g_hasXsaveopt;
+}
+
+bool hasAvx()
+{
+    return (g_xcr0 & Avx) != 0;
+}
+
+size_t stateSize()
+{
+    return g_stateSize;
+}
+
+void* allocateState()
+{
+    // the heap only guarantees 16 bytes, so over-allocate and keep the real pointer just in front
+    auto raw = static_cast<char*>(heap::allocate(g_stateSize + STATE_ALIGN));
+    auto state = reinterpret_cast<char*>(stl::align(STATE_ALIGN, reinterpret_cast<uint64_t>(raw) + sizeof(void*)));
+    reinterpret_cast<void**>(state)[-1] = raw;
+
+    memset(state, 0, g_stateSize);
+
+    // the XSAVE header is all zeroes, so XRSTOR loads the init state for every component,
+    // except MXCSR, which is always taken from the legacy area
+    *reinterpret_cast<uint16_t*>(state) = DEFAULT_FCW;
+    *reinterpret_cast<uint32_t*>(state + 24) = DEFAULT_MXCSR;
+
+    return state;
+}
+
+void freeState(void* state)
+{
+    if (state) {
+        heap::free(static_cast<void**>(state)[-1]);
+    }
+}
+
+void save(void* state)
+{
+    auto low = static_cast<uint32_t>(g_xcr0);
+    auto high = static_cast<uint32_t>(g_xcr0 >> 32);
+
+    // XSAVEOPT skips components that are still in their init state, or that haven't changed
+    // since they were restored from this same area. XSAVE needs fpu::init() to have set
+    // CR4.OSXSAVE, which it does whenever the CPU has it.
+    asm volatile(ALTERNATIVE_2("fxsave64 (%[state])",
+            "xsave64 (%[state])", "%c[alternative]",
+            "xsaveopt64 (%[state])", "%c[alternative2]")
+        : : [state]"r"(state), "a"(low), "d"(high),
+            ALTERNATIVE_FEATURE(cpu::Feature::Xsave), ALTERNATIVE_FEATURE_2(cpu::Feature::Xsaveopt)
+        : "memory");
+}
+
+void restore(void* state)
+{
+    auto low = static_cast<uint32_t>(g_xcr0);
+    auto high = static_cast<uint32_t>(g_xcr0 >> 32);
+
+    asm volatile(ALTERNATIVE("fxrstor64 (%[state])", "xrstor64 (%[state])", "%c[alternative]")
+        : : [state]"r"(state), "a"(low), "d"(high), ALTERNATIVE_FEATURE(cpu::Feature::Xsave)
+        : "memory");
+}
+
+}
@@ -21,6 +21,36 @@ PhysicalAddress PhysicalFrameMap::allocateFrame()
     return PhysicalAddress::Null;
 }
 
+PhysicalAddress PhysicalFrameMap::allocateFrames(size_t count)
+{
+    // first fit, good enough for the handful of contiguous buffers devices need
+    size_t runStart = 0;
+    size_t runLength = 0;
+
+    for (size_t i = 0; i < m_bitmapSize; i++) {
+        if (m_bitmap[i] > 0) {
+            runLength = 0;
+            continue;
+        }
+
+        if (runLength == 0) {
+            runStart = i;
+        }
+
+        if (++runLength == count) {
+            auto frame = m_memoryBase + runStart * PAGE_SIZE;
+
+            for (size_t j = 0; j < count; j++) {
+                markFrame(frame + j * PAGE_SIZE, true);
+            }
+
+            return frame;
+        }
+    }
+
+    return PhysicalAddress::Null;
+}
+
 void PhysicalFrameMap::freeFrame(PhysicalAddress frame)
 {
     // TODO: bounds checking
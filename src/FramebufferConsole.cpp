@@ -0,0 +1,348 @@
+#include <Simo/FramebufferConsole.h>
+#include <Simo/CPU.h>
+#include <Simo/Font.h>
+#include <Simo/FPU.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Multiboot.h>
+#include <Simo/Paging.h>
+#include <Simo/Spinlock.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+#include <printf.h>
+
+namespace framebuffer::console
+{
+
+namespace
+{
+
+const uint64_t FLUSH_INTERVAL_US = 10'000;
+const size_t GLYPH_COUNT = font::LAST - font::FIRST + 1;
+const size_t TAB_WIDTH = 8;
+
+// One scanline of a cell is 8 pixels, which is a whole number of qwords at 16, 24 and 32 bpp
+const size_t MAX_CELL_WORDS = 4;
+using CellLine = uint64_t[MAX_CELL_WORDS];
+
+struct Framebuffer
+{
+    char* pixels;           // mapped write-combining, never read from
+    size_t pitch;
+    size_t bytesPerPixel;
+    size_t cellWords;       // qwords in one scanline of a cell
+    size_t columns;
+    size_t rows;
+    size_t lineBytes;       // one scanline of a text row in the shadow
+    size_t rowBytes;        // a whole text row in the shadow
+};
+
+Framebuffer g_fb = {};
+
+// Every glyph scanline pre-expanded into the framebuffer's pixel format, all ones where the
+// glyph is set and all zeroes where it isn't. Drawing a cell is then just and/andn/or on qwords.
+CellLine g_glyphs[GLYPH_COUNT][font::HEIGHT];
+CellLine g_foreground;
+CellLine g_background;
+
+// Text is drawn into RAM first, the framebuffer only ever sees whole scanlines from flush().
+// Screen row r lives in shadow row (g_top + r) % rows, so scrolling just moves g_top.
+char* g_shadow = nullptr;
+size_t g_top = 0;
+size_t x = 0;
+size_t y = 0;
+
+// screen rows [g_dirtyBegin, g_dirtyEnd) changed since the last flush
+size_t g_dirtyBegin = 0;
+size_t g_dirtyEnd = 0;
+uint64_t g_lastFlush = 0;
+
+bool g_hasAvx = false;
+bool g_initialized = false;
+
+// protects the cursor and the shadow
+TrackedSpinlock g_lock{"fbconsole"};
+REGISTER_LOCK_STATS(g_lock);
+
+// 64 bytes per iteration through the borrowed registers, whatever's left with rep movsb
+void copyLine(char* dst, const char* src, size_t bytes)
+{
+    auto blocks = bytes / 64;
+    auto rest = bytes % 64;
+
+    if (blocks > 0 && g_hasAvx) {
+        asm volatile(R"(
+        1:
+            vmovdqu (%[src]), %%ymm0
+            vmovdqu 32(%[src]), %%ymm1
+            vmovdqu %%ymm0, (%[dst])
+            vmovdqu %%ymm1, 32(%[dst])
+            addq $64, %[src]
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else if (blocks > 0) {
+        asm volatile(R"(
+        1:
+            movdqu (%[src]), %%xmm0
+            movdqu 16(%[src]), %%xmm1
+            movdqu %%xmm0, (%[dst])
+            movdqu %%xmm1, 16(%[dst])
+            movdqu 32(%[src]), %%xmm0
+            movdqu 48(%[src]), %%xmm1
+            movdqu %%xmm0, 32(%[dst])
+            movdqu %%xmm1, 48(%[dst])
+            addq $64, %[src]
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    }
+
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(rest) : : "memory");
+}
+
+char* shadowRow(size_t row)
+{
+    return g_shadow + ((g_top + row) % g_fb.rows) * g_fb.rowBytes;
+}
+
+void markDirty(size_t first, size_t end)
+{
+    if (g_dirtyEnd == 0 || first < g_dirtyBegin) {
+        g_dirtyBegin = first;
+    }
+
+    if (end > g_dirtyEnd) {
+        __atomic_store_n(&g_dirtyEnd, end, __ATOMIC_RELAXED);
+    }
+}
+
+void drawCell(size_t column, size_t row, char value)
+{
+    auto glyph = (value >= font::FIRST && value <= font::LAST) ? value - font::FIRST : '?' - font::FIRST;
+    auto dst = reinterpret_cast<uint64_t*>(shadowRow(row) + column * g_fb.cellWords * sizeof(uint64_t));
+
+    for (size_t line = 0; line < font::HEIGHT; line++) {
+        const auto& mask = g_glyphs[glyph][line];
+
+        for (size_t i = 0; i < g_fb.cellWords; i++) {
+            dst[i] = (g_foreground[i] & mask[i]) | (g_background[i] & ~mask[i]);
+        }
+
+        dst += g_fb.lineBytes / sizeof(uint64_t);
+    }
+}
+
+void clearRow(char* row)
+{
+    auto dst = reinterpret_cast<uint64_t*>(row);
+    auto cells = g_fb.rowBytes / (g_fb.cellWords * sizeof(uint64_t));
+
+    for (size_t cell = 0; cell < cells; cell++) {
+        for (size_t i = 0; i < g_fb.cellWords; i++) {
+            *dst++ = g_background[i];
+        }
+    }
+}
+
+void newLine()
+{
+    x = 0;
+
+    if (y + 1 < g_fb.rows) {
+        y++;
+        return;
+    }
+
+    // the old top row becomes the new bottom one, and every row on screen changed
+    clearRow(shadowRow(0));
+    g_top = (g_top + 1) % g_fb.rows;
+    markDirty(0, g_fb.rows);
+}
+
+void flushLocked()
+{
+    {
+        fpu::BorrowedRegisters registers;
+
+        for (auto row = g_dirtyBegin; row < g_dirtyEnd; row++) {
+            auto src = shadowRow(row);
+            auto dst = g_fb.pixels + row * font::HEIGHT * g_fb.pitch;
+
+            for (size_t line = 0; line < font::HEIGHT; line++) {
+                copyLine(dst + line * g_fb.pitch, src + line * g_fb.lineBytes, g_fb.lineBytes);
+            }
+        }
+    }
+
+    // drain the write-combining buffers instead of leaving partial lines sitting in them
+    asm volatile("sfence" : : : "memory");
+
+    g_dirtyBegin = 0;
+    __atomic_store_n(&g_dirtyEnd, 0, __ATOMIC_RELAXED);
+    g_lastFlush = cpu::rdtsc();
+}
+
+uint32_t makePixel(const multiboot::FramebufferTag& tag, uint8_t red, uint8_t green, uint8_t blue)
+{
+    auto channel = [](uint8_t value, uint8_t position, uint8_t size) {
+        return (uint32_t(value) >> (8 - size)) << position;
+    };
+
+    return channel(red, tag.framebufferRedFieldPosition, tag.framebufferRedMaskSize)
+        | channel(green, tag.framebufferGreenFieldPosition, tag.framebufferGreenMaskSize)
+        | channel(blue, tag.framebufferBlueFieldPosition, tag.framebufferBlueMaskSize);
+}
+
+void expandColor(CellLine& line, uint32_t pixel)
+{
+    auto bytes = reinterpret_cast<uint8_t*>(line);
+
+    for (size_t i = 0; i < font::WIDTH; i++) {
+        for (size_t b = 0; b < g_fb.bytesPerPixel; b++) {
+            bytes[i * g_fb.bytesPerPixel + b] = static_cast<uint8_t>(pixel >> (8 * b));
+        }
+    }
+}
+
+void buildGlyphCache()
+{
+    for (size_t glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+        for (size_t line = 0; line < font::HEIGHT; line++) {
+            auto bits = font::glyphs[glyph][line];
+            auto bytes = reinterpret_cast<uint8_t*>(g_glyphs[glyph][line]);
+
+            for (size_t i = 0; i < font::WIDTH; i++) {
+                if (bits & (0x80 >> i)) {
+                    memset(bytes + i * g_fb.bytesPerPixel, 0xFF, g_fb.bytesPerPixel);
+                }
+            }
+        }
+    }
+}
+
+const multiboot::FramebufferTag* findFramebuffer(const multiboot::Info* info)
+{
+    for (const auto& tag : info) {
+        if (tag.type == multiboot::TagType::Framebuffer) {
+            return static_cast<const multiboot::FramebufferTag*>(&tag);
+        }
+    }
+
+    return nullptr;
+}
+
+}
+
+bool init(const multiboot::Info* info)
+{
+    auto tag = findFramebuffer(info);
+    if (!tag || tag->framebufferType != static_cast<uint8_t>(multiboot::FramebufferType::Rgb)) {
+        return false;
+    }
+
+    auto bpp = tag->framebufferBpp;
+    if (bpp != 16 && bpp != 24 && bpp != 32) {
+        printf("framebuffer: %u bpp isn't supported\n", bpp);
+        return false;
+    }
+
+    if (tag->framebufferRedMaskSize > 8 || tag->framebufferGreenMaskSize > 8 || tag->framebufferBlueMaskSize > 8) {
+        printf("framebuffer: more than 8 bits per channel isn't supported\n");
+        return false;
+    }
+
+    g_fb.bytesPerPixel = bpp / 8;
+    g_fb.cellWords = font::WIDTH * g_fb.bytesPerPixel / sizeof(uint64_t);
+    g_fb.pitch = tag->framebufferPitch;
+    g_fb.columns = tag->framebufferWidth / font::WIDTH;
+    g_fb.rows = tag->framebufferHeight / font::HEIGHT;
+    g_fb.lineBytes = g_fb.columns * g_fb.cellWords * sizeof(uint64_t);
+    g_fb.rowBytes = g_fb.lineBytes * font::HEIGHT;
+
+    auto framebufferPA = paging::PhysicalAddress{tag->framebufferAddr};
+    auto framebufferSize = size_t(g_fb.pitch) * tag->framebufferHeight;
+    g_fb.pixels = static_cast<char*>(paging::mapPhysical(framebufferPA, framebufferSize,
+        paging::PMEFlags::Present | paging::PMEFlags::Write | paging::PMEFlags::WriteCombining));
+
+    auto shadowPages = stl::align(paging::PAGE_SIZE, g_fb.rows * g_fb.rowBytes) / paging::PAGE_SIZE;
+    g_shadow = static_cast<char*>(paging::allocatePages(shadowPages));
+
+    g_hasAvx = fpu::hasAvx();
+
+    // VGA light grey on black, same as the text console
+    expandColor(g_foreground, makePixel(*tag, 0xAA, 0xAA, 0xAA));
+    expandColor(g_background, makePixel(*tag, 0x00, 0x00, 0x00));
+    buildGlyphCache();
+
+    {
+        OutputLockGuard guard(g_lock);
+
+        for (size_t row = 0; row < g_fb.rows; row++) {
+            clearRow(shadowRow(row));
+        }
+
+        markDirty(0, g_fb.rows);
+        flushLocked();
+        g_initialized = true;
+    }
+
+    printf("framebuffer at %016lx: %ux%u, %u bpp, %lux%lu text, %s blits\n",
+        tag->framebufferAddr, tag->framebufferWidth, tag->framebufferHeight, bpp,
+        g_fb.columns, g_fb.rows, g_hasAvx ? "AVX" : "SSE");
+
+    return true;
+}
+
+void write(const char* data, size_t length)
+{
+    if (!g_initialized) {
+        return;
+    }
+
+    OutputLockGuard guard(g_lock);
+    bool newline = false;
+
+    for (size_t i = 0; i < length; i++) {
+        auto value = data[i];
+
+        if (value == '\n') {
+            newLine();
+            newline = true;
+        } else if (value == '\t') {
+            auto nextX = (x & ~(TAB_WIDTH - 1)) + TAB_WIDTH;
+            if (nextX >= g_fb.columns) {
+                newLine();
+            } else {
+                x = nextX;
+            }
+        } else {
+            drawCell(x, y, value);
+            markDirty(y, y + 1);
+
+            if (++x == g_fb.columns) {
+                newLine();
+            }
+        }
+    }
+
+    // a burst of output goes out in one go, the timer picks up whatever's left
+    if (newline && cpu::rdtsc() - g_lastFlush >= tsc::frequency() * FLUSH_INTERVAL_US / 1'000'000) {
+        flushLocked();
+    }
+}
+
+void flush()
+{
+    // the timer calls this on every tick, make the common case cheap
+    if (!g_initialized || __atomic_load_n(&g_dirtyEnd, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    OutputLockGuard guard(g_lock);
+    flushLocked();
+}
+
+}
@@ -0,0 +1,137 @@
+#include <Simo/Futex.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Scheduler.h>
+#include <Simo/Spinlock.h>
+
+namespace futex
+{
+
+namespace
+{
+
+const size_t BUCKET_COUNT = 256;
+static_assert((BUCKET_COUNT & (BUCKET_COUNT - 1)) == 0);
+
+// Lives on the waiting thread's stack for as long as it's queued.
+struct Waiter
+{
+    const uint32_t* address;
+    sched::Thread* thread;
+    Waiter* next;
+    bool woken;
+};
+
+struct alignas(64) Bucket
+{
+    Spinlock lock;
+    Waiter* head = nullptr;
+    Waiter* tail = nullptr;
+};
+
+Bucket g_buckets[BUCKET_COUNT];
+
+Bucket& bucketFor(const uint32_t* address)
+{
+    // Fibonacci hashing, the low bits of addresses are mostly alignment
+    auto hash = (reinterpret_cast<uint64_t>(address) >> 2) * 0x9e37'79b9'7f4a'7c15ull;
+    return g_buckets[hash >> (64 - __builtin_ctzll(BUCKET_COUNT))];
+}
+
+void remove(Bucket& bucket, Waiter* waiter, Waiter* previous)
+{
+    if (previous) {
+        previous->next = waiter->next;
+    } else {
+        bucket.head = waiter->next;
+    }
+
+    if (bucket.tail == waiter) {
+        bucket.tail = previous;
+    }
+}
+
+void removeSelf(Bucket& bucket, Waiter* waiter)
+{
+    Waiter* previous = nullptr;
+
+    for (auto current = bucket.head; current; previous = current, current = current->next) {
+        if (current == waiter) {
+            remove(bucket, waiter, previous);
+            return;
+        }
+    }
+}
+
+}
+
+bool wait(const uint32_t* address, uint32_t expected)
+{
+    auto& bucket = bucketFor(address);
+    auto thread = sched::currentThread();
+    Waiter waiter{address, thread, nullptr, false};
+
+    interrupts::InterruptGuard guard;
+
+    {
+        LockGuard lockGuard(bucket.lock);
+
+        // wake() takes the bucket lock after changing the value, so either we see the change
+        // here or it sees us in the queue
+        if (__atomic_load_n(address, __ATOMIC_RELAXED) != expected) {
+            return false;
+        }
+
+        if (bucket.tail) {
+            bucket.tail->next = &waiter;
+        } else {
+            bucket.head = &waiter;
+        }
+
+        bucket.tail = &waiter;
+        thread->state = sched::ThreadState::Blocked;
+    }
+
+    sched::block();
+
+    // someone else may have woken us, and the node has to be gone before we return
+    LockGuard lockGuard(bucket.lock);
+    if (!waiter.woken) {
+        removeSelf(bucket, &waiter);
+    }
+
+    return true;
+}
+
+uint32_t wake(const uint32_t* address, uint32_t count)
+{
+    auto& bucket = bucketFor(address);
+    uint32_t woken = 0;
+
+    IrqLockGuard lockGuard(bucket.lock);
+
+    Waiter* previous = nullptr;
+    auto current = bucket.head;
+
+    while (current && woken < count) {
+        auto next = current->next;
+
+        if (current->address != address) {
+            previous = current;
+            current = next;
+            continue;
+        }
+
+        remove(bucket, current, previous);
+
+        // still under the lock: the waiter can't return, and its thread can't exit, until we let go
+        current->woken = true;
+        sched::wake(current->thread);
+
+        woken++;
+        current = next;
+    }
+
+    return woken;
+}
+
+}
@@ -1,4 +1,5 @@
 #include <Simo/GDT.h>
+#include <Simo/Utils.h>
 #include <STL/Bit.h>
 
 namespace gdt
@@ -12,31 +13,56 @@ enum SegmentDescriptorFlags : uint64_t
     CodeSegment = stl::bit(43),
     DataWritable = stl::bit(41),
     CodeReadable = stl::bit(41),
+    AvailableTss = stl::bit(43) | stl::bit(40),
+    UserPrivilege = stl::bit(46) | stl::bit(45),
 };
 
-uint64_t g_GDT[] = {
+const uint64_t g_templateGDT[] = {
     0,  // null descriptor
-    LongMode | Present | CodeOrData | CodeSegment | CodeReadable,   // kernel code segment
-    LongMode | Present | CodeOrData | DataWritable,                 // kernel data segment
+    LongMode | Present | CodeOrData | CodeSegment | CodeReadable,                   // kernel code segment
+    LongMode | Present | CodeOrData | DataWritable,                                 // kernel data segment
+    LongMode | Present | CodeOrData | DataWritable | UserPrivilege,                 // user data segment
+    LongMode | Present | CodeOrData | CodeSegment | CodeReadable | UserPrivilege,   // user code segment
 };
 
-void init()
+// 64-bit TSS descriptors take up two slots
+void setTaskStateDescriptor(Tables& tables)
 {
+    auto base = reinterpret_cast<uint64_t>(&tables.tss);
+    uint64_t limit = sizeof(tables.tss) - 1;
+
+    tables.descriptors[5] = (limit & 0xffff)
+        | ((base & 0xff'ffff) << 16)
+        | AvailableTss
+        | Present
+        | (((base >> 24) & 0xff) << 56);
+    tables.descriptors[6] = base >> 32;
+}
+
+void init(Tables& tables)
+{
+    memcpy(tables.descriptors, g_templateGDT, sizeof(g_templateGDT));
+    memset(&tables.tss, 0, sizeof(tables.tss));
+
+    // no I/O permission bitmap
+    tables.tss.ioMapBase = sizeof(tables.tss);
+    setTaskStateDescriptor(tables);
+
     struct [[gnu::packed]] {
         uint16_t limit;
         void* gdt;
     } gdtr = {
-        .limit = sizeof(g_GDT) - 1,
-        .gdt = g_GDT
+        .limit = sizeof(tables.descriptors) - 1,
+        .gdt = tables.descriptors
     };
 
     asm volatile(R"(
             lgdt %[gdtr]
             pushw $0x8
-            push $next
+            push $1f
             .byte 0x48  # need to emit rex.W prefix manually
             ljmpl *(%%rsp)
-        next:
+        1:
             add $10, %%rsp
             mov $0x10, %%ax
             mov %%ax, %%ds
@@ -44,7 +70,9 @@ void init()
             mov %%ax, %%fs
             mov %%ax, %%gs
             mov %%ax, %%ss
-        )" : : [gdtr]"m"(gdtr) : "%rax"); 
+            mov %[tss], %%ax
+            ltr %%ax
+        )" : : [gdtr]"m"(gdtr), [tss]"i"(Selector::TaskState) : "%rax", "memory");
 }
 
-}
\ No newline at end of file
+}
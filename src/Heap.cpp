@@ -0,0 +1,155 @@
+#include <Simo/Heap.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Kernel.h>
+#include <Simo/Paging.h>
+#include <Simo/Spinlock.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+
+namespace heap
+{
+
+namespace
+{
+
+// Small allocations come from power-of-two size classes carved out of single pages,
+// anything bigger gets its own run of pages. Freed page runs are cached by length
+// and reused, since nothing can give pages back to the frame map yet.
+const size_t MIN_CLASS_SHIFT = 4;
+const size_t MAX_CLASS_SHIFT = 11;
+const size_t NUM_CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+const uint32_t MAGIC = 0x5133'6f00;
+
+struct alignas(16) Header
+{
+    uint32_t magic;
+    uint32_t sizeClass;     // NUM_CLASSES for page runs
+    size_t pages;
+};
+
+static_assert(sizeof(Header) == 16);
+
+struct FreeBlock
+{
+    FreeBlock* next;
+};
+
+struct FreeRun
+{
+    FreeRun* next;
+    size_t pages;
+};
+
+FreeBlock* g_freeLists[NUM_CLASSES];
+FreeRun* g_freeRuns = nullptr;
+TrackedSpinlock g_lock{"heap"};
+REGISTER_LOCK_STATS(g_lock);
+
+size_t classFromSize(size_t size)
+{
+    size_t cls = 0;
+
+    while ((size_t(1) << (cls + MIN_CLASS_SHIFT)) < size) {
+        cls++;
+    }
+
+    return cls;
+}
+
+size_t classBlockSize(size_t cls)
+{
+    return size_t(1) << (cls + MIN_CLASS_SHIFT);
+}
+
+void refill(size_t cls)
+{
+    auto page = static_cast<char*>(paging::allocatePages(1));
+    auto blockSize = classBlockSize(cls);
+
+    for (size_t offset = 0; offset + blockSize <= paging::PAGE_SIZE; offset += blockSize) {
+        auto block = reinterpret_cast<FreeBlock*>(page + offset);
+        block->next = g_freeLists[cls];
+        g_freeLists[cls] = block;
+    }
+}
+
+Header* allocateSmall(size_t cls)
+{
+    if (!g_freeLists[cls]) {
+        refill(cls);
+    }
+
+    auto block = g_freeLists[cls];
+    g_freeLists[cls] = block->next;
+
+    return reinterpret_cast<Header*>(block);
+}
+
+Header* allocateRun(size_t pages)
+{
+    for (auto prev = &g_freeRuns; *prev; prev = &(*prev)->next) {
+        if ((*prev)->pages == pages) {
+            auto run = *prev;
+            *prev = run->next;
+            return reinterpret_cast<Header*>(run);
+        }
+    }
+
+    return static_cast<Header*>(paging::allocatePages(pages));
+}
+
+}
+
+void* allocate(size_t size)
+{
+    auto total = size + sizeof(Header);
+
+    IrqLockGuard guard(g_lock);
+
+    Header* header;
+
+    if (total <= classBlockSize(NUM_CLASSES - 1)) {
+        auto cls = classFromSize(total);
+        header = allocateSmall(cls);
+        header->sizeClass = static_cast<uint32_t>(cls);
+        header->pages = 0;
+    } else {
+        auto pages = stl::align(paging::PAGE_SIZE, total) / paging::PAGE_SIZE;
+        header = allocateRun(pages);
+        header->sizeClass = NUM_CLASSES;
+        header->pages = pages;
+    }
+
+    header->magic = MAGIC;
+
+    return header + 1;
+}
+
+void free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    auto header = static_cast<Header*>(ptr) - 1;
+    ASSERT(header->magic == MAGIC);
+    header->magic = 0;
+
+    IrqLockGuard guard(g_lock);
+
+    if (header->sizeClass < NUM_CLASSES) {
+        auto block = reinterpret_cast<FreeBlock*>(header);
+        block->next = g_freeLists[header->sizeClass];
+        g_freeLists[header->sizeClass] = block;
+    } else {
+        auto run = reinterpret_cast<FreeRun*>(header);
+        run->pages = header->pages;
+        run->next = g_freeRuns;
+        g_freeRuns = run;
+    }
+}
+
+}
+
+void* operator new  (size_t size) { return heap::allocate(size); }
+void* operator new[](size_t size) { return heap::allocate(size); }
@@ -0,0 +1,161 @@
+#include <Simo/Idle.h>
+#include <Simo/APIC.h>
+#include <Simo/CPU.h>
+#include <Simo/Interrupt.h>
+#include <Simo/SMP.h>
+#include <Simo/TSC.h>
+#include <printf.h>
+
+namespace idle
+{
+
+namespace
+{
+
+enum class Mode : uint32_t
+{
+    Running,
+    Mwait,
+    Halt,
+};
+
+struct alignas(64) CpuState
+{
+    // the line MWAIT monitors, only remote CPUs write to it
+    alignas(64) uint32_t wakeup = 0;
+    Mode mode = Mode::Running;
+    uint64_t kickedAt = 0;
+
+    alignas(64) uint64_t enteredAt = 0;
+    Stats stats = {};
+};
+
+CpuState g_cpus[smp::MAX_CPUS];
+bool g_hasMwait = false;
+bool g_useMwait = false;
+
+[[gnu::interrupt]] void wakeupHandler(interrupts::InterruptContext*)
+{
+    // all the work happens when the idle loop goes around again
+    apic::sendEOI();
+}
+
+void monitor(const void* address)
+{
+    asm volatile("monitor" : : "a"(address), "c"(0), "d"(0));
+}
+
+}
+
+void init()
+{
+    // only the BSP decides, the APs are assumed to match
+    if (smp::current().index == 0) {
+        g_hasMwait = cpu::hasFeature(cpu::Feature::Monitor);
+        g_useMwait = g_hasMwait;
+
+        interrupts::setHandler(apic::WAKEUP_VECTOR, &wakeupHandler);
+        printf("idle: %s\n", g_hasMwait ? "MWAIT" : "HLT and wakeup IPIs");
+    }
+}
+
+void enter()
+{
+    auto& state = g_cpus[smp::current().index];
+    auto mode = __atomic_load_n(&g_useMwait, __ATOMIC_RELAXED) ? Mode::Mwait : Mode::Halt;
+
+    state.enteredAt = cpu::rdtsc();
+    state.stats.entries++;
+
+    if (mode == Mode::Mwait) {
+        // arm the monitor before the last check, so a kick in between still ends the MWAIT right away
+        monitor(&state.wakeup);
+    }
+
+    // pairs with kick(): either it sees us idle, or we see its wakeup
+    __atomic_store_n(&state.mode, mode, __ATOMIC_SEQ_CST);
+
+    bool slept = !__atomic_load_n(&state.wakeup, __ATOMIC_SEQ_CST);
+    if (slept) {
+        // sti only takes effect after the next instruction, so no interrupt can slip in before we sleep
+        if (mode == Mode::Mwait) {
+            asm volatile("sti; mwait" : : "a"(0), "c"(0) : "memory");
+        } else {
+            asm volatile("sti; hlt" : : : "memory");
+        }
+
+        interrupts::disable();
+    }
+
+    __atomic_store_n(&state.mode, Mode::Running, __ATOMIC_SEQ_CST);
+
+    auto now = cpu::rdtsc();
+    state.stats.idleCycles += now - state.enteredAt;
+
+    // a kick that came in before we even got to sleep doesn't say anything about wakeup latency
+    if (__atomic_exchange_n(&state.wakeup, 0, __ATOMIC_ACQ_REL) && slept) {
+        auto kickedAt = __atomic_load_n(&state.kickedAt, __ATOMIC_RELAXED);
+        auto latency = (now > kickedAt) ? now - kickedAt : 0;
+
+        if (mode == Mode::Mwait) {
+            state.stats.mwaitWakeups++;
+        } else {
+            state.stats.ipiWakeups++;
+        }
+
+        state.stats.wakeupCycles += latency;
+        if (latency > state.stats.maxWakeupCycles) {
+            state.stats.maxWakeupCycles = latency;
+        }
+    }
+}
+
+void kick(uint32_t cpu)
+{
+    auto& state = g_cpus[cpu];
+
+    // someone else already did it, or the CPU hasn't gone back to sleep since
+    if (__atomic_load_n(&state.wakeup, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    __atomic_store_n(&state.kickedAt, cpu::rdtsc(), __ATOMIC_RELAXED);
+    if (__atomic_exchange_n(&state.wakeup, 1, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    // MWAIT already woke up from the store, and a running CPU checks the flag before it sleeps
+    if (__atomic_load_n(&state.mode, __ATOMIC_SEQ_CST) == Mode::Halt) {
+        apic::sendIpi(smp::cpu(cpu).apicId, apic::WAKEUP_VECTOR);
+    }
+}
+
+bool hasMwait()
+{
+    return g_hasMwait;
+}
+
+void setMwaitEnabled(bool enabled)
+{
+    __atomic_store_n(&g_useMwait, enabled && g_hasMwait, __ATOMIC_RELAXED);
+}
+
+const Stats& stats(uint32_t cpu)
+{
+    return g_cpus[cpu].stats;
+}
+
+void dumpStats()
+{
+    for (uint32_t i = 0; i < smp::cpuCount(); i++) {
+        const auto& s = g_cpus[i].stats;
+        auto wakeups = s.mwaitWakeups + s.ipiWakeups;
+        auto averageWakeup = wakeups ? s.wakeupCycles / wakeups : 0;
+
+        printf("CPU %u: %lu ms idle over %lu entries, %lu MWAIT + %lu IPI wakeups, avg %lu ns, max %lu ns\n",
+            i, tsc::cyclesToNanoseconds(s.idleCycles) / 1'000'000, s.entries, s.mwaitWakeups, s.ipiWakeups,
+            tsc::cyclesToNanoseconds(averageWakeup), tsc::cyclesToNanoseconds(s.maxWakeupCycles));
+    }
+}
+
+}
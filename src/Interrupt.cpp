@@ -1,24 +1,31 @@
+#include <STL/Flags.h>
 #include <STL/Tuple.h>
 #include <Simo/Interrupt.h>
+#include <Simo/CPU.h>
+#include <Simo/Console.h>
+#include <Simo/FramebufferConsole.h>
 #include <Simo/GDT.h>
+#include <Simo/Log.h>
+#include <Simo/PIC.h>
+#include <Simo/Scheduler.h>
+#include <Simo/Serial.h>
 #include <Simo/Utils.h>
+#include <Simo/VirtioConsole.h>
 #include <printf.h>
 
-namespace interrupts
-{
+extern "C" const char interruptStubs[];
+extern "C" void divideErrorEntry(interrupts::InterruptContext*);
+extern "C" void invalidOpcodeEntry(interrupts::InterruptContext*);
+extern "C" void generalProtectionEntry(interrupts::InterruptContext*, uint64_t);
+extern "C" void pageFaultEntry(interrupts::InterruptContext*, uint64_t);
 
-struct InterruptContext
+namespace interrupts
 {
-    uint64_t ip;
-    uint64_t cs;
-    uint64_t flags;
-    uint64_t sp;
-    uint64_t ss;
-};
 
-// TODO: how to ensure [[gnu::interrupt]]?
-using InterruptHandler = void (*)(InterruptContext*);
-using ExceptionHandler = void (*)(InterruptContext*, uint64_t);
+// InterruptEntry.S hardcodes these
+const size_t INTERRUPT_STUB_SIZE = 32;
+static_assert(static_cast<uint16_t>(gdt::Selector::KernelCode) == 0x08);
+static_assert(static_cast<uint16_t>(gdt::Selector::KernelData) == 0x10);
 
 enum IDTFlags : uint8_t
 {
@@ -41,12 +48,12 @@ struct [[gnu::packed]] InterruptDescriptor
     InterruptDescriptor() = default;
 
     InterruptDescriptor(InterruptHandler handler, gdt::Selector selector,
-                        uint8_t stackTableOffset, uint8_t typeAndAttributes) :
-        InterruptDescriptor(reinterpret_cast<uint64_t>(handler), selector, stackTableOffset, typeAndAttributes) {}
+                        uint8_t stackTableOffset, stl::Flags<IDTFlags> typeAndAttributes) :
+        InterruptDescriptor(reinterpret_cast<uint64_t>(handler), selector, stackTableOffset, typeAndAttributes.value()) {}
 
     InterruptDescriptor(ExceptionHandler handler, gdt::Selector selector,
-                        uint8_t stackTableOffset, uint8_t typeAndAttributes) :
-        InterruptDescriptor(reinterpret_cast<uint64_t>(handler), selector, stackTableOffset, typeAndAttributes) {}
+                        uint8_t stackTableOffset, stl::Flags<IDTFlags> typeAndAttributes) :
+        InterruptDescriptor(reinterpret_cast<uint64_t>(handler), selector, stackTableOffset, typeAndAttributes.value()) {}
 
 private:
     static stl::Tuple<uint16_t, uint16_t, uint32_t> extractOffsets(uint64_t v)
@@ -75,20 +82,73 @@ private:
 
 InterruptDescriptor g_IDT[256] = {};
 
+// what the stubs in InterruptEntry.S jump to, indexed by vector
+extern "C" {
+InterruptHandler interruptHandlers[256] = {};
+}
+
 void dumpInterruptContext(const InterruptContext* ctx)
 {
-    printf(R"(context:
-  rip:    %016lx
-  cs:     %04lx
-  flags:  %08lx
-  rsp:    %016lx
-  ss:     %04lx)""\n\n", ctx->ip, ctx->cs, ctx->flags, ctx->sp, ctx->ss);
+    print<CONTEXT_FORMAT>(ctx->ip, ctx->cs, ctx->flags, ctx->sp, ctx->ss);
 }
 
 [[gnu::interrupt]] void int3Handler(InterruptContext* ctx)
 {
-    printf("\n[int3]\n");
+    print<"\n[int3]\n">();
+    dumpInterruptContext(ctx);
+}
+
+bool fromUser(const InterruptContext* ctx)
+{
+    return (ctx->cs & gdt::USER_RPL) != 0;
+}
+
+// A fault in ring 3 only takes down the thread that caused it.
+[[noreturn]] void killCurrentThread(const char* fault, const InterruptContext* ctx, uint64_t errorCode)
+{
+    auto thread = sched::currentThread();
+    print<"%s (error %lx) in ring 3 at %016lx, killing thread %u (%s)\n">(fault, errorCode, ctx->ip, thread->id, thread->name);
+
+    sched::exit();
+}
+
+// In ring 0 it's a kernel bug, so everything stops.
+[[noreturn]] void kernelFault(const char* fault, const InterruptContext* ctx, uint64_t errorCode)
+{
+    panic::enter();
+
+    print<"\n[omg %s]\n">(fault);
+    print<"error:      %04lx\n">(errorCode);
     dumpInterruptContext(ctx);
+
+    console::flush();
+    framebuffer::console::flush();
+    virtio::console::flush();
+    cpu::halt();
+}
+
+[[noreturn]] void fault(const char* name, const InterruptContext* ctx, uint64_t errorCode)
+{
+    if (fromUser(ctx)) {
+        killCurrentThread(name, ctx, errorCode);
+    }
+
+    kernelFault(name, ctx, errorCode);
+}
+
+[[gnu::interrupt]] void divideErrorHandler(InterruptContext* ctx)
+{
+    fault("divide error", ctx, 0);
+}
+
+[[gnu::interrupt]] void invalidOpcodeHandler(InterruptContext* ctx)
+{
+    fault("invalid opcode", ctx, 0);
+}
+
+[[gnu::interrupt]] void generalProtectionHandler(InterruptContext* ctx, uint64_t errorCode)
+{
+    fault("general protection fault", ctx, errorCode);
 }
 
 [[gnu::interrupt]] void pageFaultHandler(InterruptContext* ctx, uint64_t errorCode)
@@ -96,24 +156,81 @@ void dumpInterruptContext(const InterruptContext* ctx)
     uint64_t faultAddr;
     asm volatile("movq %[faultAddr], %%cr2" : [faultAddr]"=a"(faultAddr));
 
-    printf("\n[omg pagefault]\n");
-    printf("error:      %04lx\n", errorCode);
-    printf("address:    %016lx\n", faultAddr);
-    printf("present:    %s\n", (errorCode & 1) ? "yes" : "no");
-    printf("access:     %s\n", (errorCode & 2) ? "write" : "read");
+    if (fromUser(ctx)) {
+        print<"page fault on %016lx\n">(faultAddr);
+        killCurrentThread("page fault", ctx, errorCode);
+    }
+
+    // we're going to halt anyway, so make sure the output actually gets out
+    panic::enter();
+
+    print<"\n[omg pagefault]\n">();
+    print<"error:      %04lx\n">(errorCode);
+    print<"address:    %016lx\n">(faultAddr);
+    print<"present:    %s\n">((errorCode & 1) ? "yes" : "no");
+    print<"access:     %s\n">((errorCode & 2) ? "write" : "read");
 
     dumpInterruptContext(ctx);
 
-    asm volatile("hlt");
+    console::flush();
+    framebuffer::console::flush();
+    virtio::console::flush();
+    cpu::halt();
 }
 
+[[gnu::interrupt]] void spuriousMasterIrqHandler(InterruptContext*)
+{
+    // a spurious IRQ7 must not be acknowledged
+    if (!pic::isSpurious(pic::Irq::Spurious)) {
+        pic::sendEOI(pic::Irq::Spurious);
+    }
+}
+
+[[gnu::interrupt]] void spuriousSlaveIrqHandler(InterruptContext*)
+{
+    // the master still saw the cascade IRQ, so it needs an EOI either way
+    if (pic::isSpurious(pic::Irq::SpuriousSlave)) {
+        pic::sendEOI(pic::Irq::Cascade);
+    } else {
+        pic::sendEOI(pic::Irq::SpuriousSlave);
+    }
+}
+
+void setHandler(uint8_t vector, InterruptHandler handler)
+{
+    interruptHandlers[vector] = handler;
+
+    auto stub = reinterpret_cast<InterruptHandler>(interruptStubs + vector * INTERRUPT_STUB_SIZE);
+    g_IDT[vector] = InterruptDescriptor(stub, gdt::Selector::KernelCode, 0, Present | InterruptGate);
+}
+
+// what the fault entries in InterruptEntry.S jump to
+extern "C" const InterruptHandler divideErrorHandlerPointer = &divideErrorHandler;
+extern "C" const InterruptHandler invalidOpcodeHandlerPointer = &invalidOpcodeHandler;
+extern "C" const ExceptionHandler generalProtectionHandlerPointer = &generalProtectionHandler;
+extern "C" const ExceptionHandler pageFaultHandlerPointer = &pageFaultHandler;
+
 void init()
 {
-    g_IDT[3] = InterruptDescriptor(int3Handler, gdt::Selector::KernelCode, 0, Present | InterruptGate);
-    g_IDT[0xE] = InterruptDescriptor(pageFaultHandler, gdt::Selector::KernelCode, 0, Present | TrapGate);
+    setHandler(3, int3Handler);
+
+    // not trap gates, an interrupt before the entry's swapgs would see the user GS base
+    g_IDT[0x0] = InterruptDescriptor(divideErrorEntry, gdt::Selector::KernelCode, 0, Present | InterruptGate);
+    g_IDT[0x6] = InterruptDescriptor(invalidOpcodeEntry, gdt::Selector::KernelCode, 0, Present | InterruptGate);
+    g_IDT[0xD] = InterruptDescriptor(generalProtectionEntry, gdt::Selector::KernelCode, 0, Present | InterruptGate);
+    g_IDT[0xE] = InterruptDescriptor(pageFaultEntry, gdt::Selector::KernelCode, 0, Present | InterruptGate);
+
+    pic::init();
+    setHandler(pic::vectorFromIrq(pic::Irq::Spurious), spuriousMasterIrqHandler);
+    setHandler(pic::vectorFromIrq(pic::Irq::SpuriousSlave), spuriousSlaveIrqHandler);
 
     printf("loading IDT\n");
+    load();
+    printf("done\n");
+}
 
+void load()
+{
     struct [[gnu::packed]] {
         uint16_t size;
         void* offset;
@@ -127,8 +244,6 @@ void init()
         )"
         : : [idtr]"m"(idtr) //: "%rax"
     );
-    
-    printf("done\n");
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include <Simo/IoRing.h>
+#include <Simo/Console.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Paging.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <Simo/Spinlock.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+#include <printf.h>
+
+namespace ioring
+{
+
+namespace
+{
+
+// bounds how long one enter() or one polling round can keep going
+const size_t SUBMIT_BATCH = SUBMISSION_ENTRIES;
+const uint64_t POLL_IDLE_US = 1000;
+
+// lower-half pages the kernel maps for itself, setup() never hands them out even when they're
+// not mapped at the moment
+const uint64_t KERNEL_LOWER_HALF_PAGES[] = {
+    smp::TRAMPOLINE_BASE,
+    console::VGA_BUFFER_ADDRESS,
+    tsc::TIME_PAGE_ADDRESS,
+};
+
+struct Ring
+{
+    SharedRings* shared = nullptr;      // the kernel's own mapping, user space can't pull it away; set last
+    uint32_t owner = 0;                 // id of the thread that set it up, the only one that may enter()
+    bool kernelPoll = false;
+    sched::Thread* poller = nullptr;
+    Spinlock lock;                      // one consumer at a time
+};
+
+Ring g_rings[MAX_RINGS];
+size_t g_ringCount = 0;
+Spinlock g_setupLock;
+
+int64_t execute(const SubmissionEntry& entry)
+{
+    switch (entry.opcode) {
+    case Opcode::Nop:
+        return 0;
+
+    case Opcode::Write:
+        // there's no fault recovery, so anything the kernel can't read on the user's behalf
+        // has to be caught here
+        if (entry.args[1] > INT32_MAX || !paging::isUserAccessible(entry.args[0], entry.args[1])) {
+            return -1;
+        }
+
+        printf("%.*s", static_cast<int>(entry.args[1]), reinterpret_cast<const char*>(entry.args[0]));
+        return static_cast<int64_t>(entry.args[1]);
+
+    case Opcode::ReadClock:
+        return static_cast<int64_t>(tsc::now());
+    }
+
+    return -1;
+}
+
+// Stops early when the completion ring is full, the rest stays queued for the next round.
+size_t processSubmissions(Ring& ring, size_t limit)
+{
+    auto& shared = *ring.shared;
+    size_t done = 0;
+
+    while (done < limit && !shared.completions.full()) {
+        SubmissionEntry entry;
+        if (!shared.submissions.pop(entry)) {
+            break;
+        }
+
+        shared.completions.push(CompletionEntry{entry.userData, execute(entry)});
+        done++;
+    }
+
+    return done;
+}
+
+void pollerMain(void* arg)
+{
+    auto& ring = *static_cast<Ring*>(arg);
+    auto& shared = *ring.shared;
+    auto self = sched::currentThread();
+    auto idleCycles = tsc::frequency() * POLL_IDLE_US / 1'000'000;
+    auto lastWork = cpu::rdtsc();
+
+    while (true) {
+        if (processSubmissions(ring, SUBMIT_BATCH) > 0) {
+            lastWork = cpu::rdtsc();
+            continue;
+        }
+
+        if (cpu::rdtsc() - lastWork < idleCycles) {
+            sched::yield();
+            continue;
+        }
+
+        // Blocked goes first: an enter() that sees NeedWakeup can only wake us after this.
+        // Pairs with the fence user space does between pushing and checking flags.
+        {
+            interrupts::InterruptGuard guard;
+
+            self->state = sched::ThreadState::Blocked;
+            __atomic_store_n(&shared.flags, shared.flags | NeedWakeup, __ATOMIC_SEQ_CST);
+
+            if (!shared.submissions.empty()) {
+                sched::wake(self);
+            }
+
+            sched::block();
+        }
+
+        __atomic_and_fetch(&shared.flags, ~NeedWakeup, __ATOMIC_RELAXED);
+        lastWork = cpu::rdtsc();
+    }
+}
+
+bool overlapsKernelPage(uint64_t address, size_t length)
+{
+    for (auto page : KERNEL_LOWER_HALF_PAGES) {
+        if (page + paging::PAGE_SIZE > address && page < address + length) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
+
+size_t sharedPages()
+{
+    return (sizeof(SharedRings) + paging::PAGE_SIZE - 1) / paging::PAGE_SIZE;
+}
+
+int64_t setup(uint64_t userAddress, uint32_t flags, uint32_t pollCpu)
+{
+    auto pages = sharedPages();
+    auto length = pages * paging::PAGE_SIZE;
+
+    if (userAddress == 0 || userAddress % paging::PAGE_SIZE != 0 || !paging::isUserRange(userAddress, length)
+        || overlapsKernelPage(userAddress, length)) {
+        return -1;
+    }
+
+    if ((flags & KernelPoll) && pollCpu >= smp::cpuCount()) {
+        return -1;
+    }
+
+    // held throughout, so a failed setup doesn't use up an id
+    IrqLockGuard guard(g_setupLock);
+
+    if (g_ringCount == MAX_RINGS) {
+        return -1;
+    }
+
+    // physically contiguous, so the kernel mapping and the user one line up page by page
+    paging::PhysicalAddress physAddr;
+    auto shared = new (paging::allocatePages(pages, &physAddr)) SharedRings{};
+
+    // Never mapped over whatever is there already. Kernel pages can't be freed yet, so the
+    // rings leak if that happens.
+    if (!paging::mapUnusedRangeUntracked(reinterpret_cast<void*>(userAddress), physAddr, pages,
+            paging::PMEFlags::Present | paging::PMEFlags::Write | paging::PMEFlags::User)) {
+        return -1;
+    }
+
+    auto id = g_ringCount++;
+    auto& ring = g_rings[id];
+    ring.kernelPoll = flags & KernelPoll;
+    ring.owner = sched::currentThread()->id;
+    __atomic_store_n(&ring.shared, shared, __ATOMIC_RELEASE);
+
+    if (ring.kernelPoll) {
+        auto poller = sched::createThread("ioring-poll", &pollerMain, &ring, static_cast<int>(pollCpu),
+            sched::ThreadFlags::Pinned);
+        __atomic_store_n(&ring.poller, poller, __ATOMIC_RELEASE);
+    }
+
+    return static_cast<int64_t>(id);
+}
+
+int64_t enter(uint64_t id, uint32_t toSubmit, uint32_t flags)
+{
+    if (id >= MAX_RINGS) {
+        return -1;
+    }
+
+    auto& ring = g_rings[id];
+
+    // still being set up, or somebody else's
+    if (!__atomic_load_n(&ring.shared, __ATOMIC_ACQUIRE) || ring.owner != sched::currentThread()->id) {
+        return -1;
+    }
+
+    if (ring.kernelPoll) {
+        auto poller = __atomic_load_n(&ring.poller, __ATOMIC_ACQUIRE);
+        if (poller && (flags & Wakeup)) {
+            sched::wake(poller);
+        }
+
+        return 0;
+    }
+
+    LockGuard guard(ring.lock);
+    return static_cast<int64_t>(processSubmissions(ring, toSubmit < SUBMIT_BATCH ? toSubmit : SUBMIT_BATCH));
+}
+
+}
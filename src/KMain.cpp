@@ -3,15 +3,30 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <Simo/Multiboot.h>
+#include <Simo/Alternatives.h>
+#include <Simo/CPU.h>
 #include <printf.h>
 #include <Simo/Console.h>
 #include <Simo/ELF.h>
+#include <Simo/FPU.h>
+#include <Simo/FramebufferConsole.h>
 #include <Simo/Paging.h>
 #include <STL/Lambda.h>
 #include <STL/Bit.h>
 #include <Simo/Interrupt.h>
-#include <Simo/GDT.h>
+#include <Simo/Log.h>
+#include <Simo/Memory.h>
 #include <Simo/Serial.h>
+#include <Simo/ACPI.h>
+#include <Simo/Benchmark.h>
+#include <Simo/APIC.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <Simo/Syscall.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <Simo/VirtioConsole.h>
+#include <Simo/WorkQueue.h>
 
 void dumpTag(const multiboot::MmapTag& mmapTag)
 {
@@ -80,13 +95,53 @@ extern "C" void kmain(const multiboot::Info* info)
     auto infoSize = 0x2000;//info->totalSize;
 
     console::init();
+    addOutputHandler(&klog::memorySink);
+    cpu::detectFeatures();
     paging::init(info);
-    gdt::init();
+    alternatives::apply();
+    smp::initBsp();
     interrupts::init();
+    serial::init();
+    interrupts::enable();
+
+    // every outb to COM1 is a VM exit, so prefer virtio-console when QEMU gives us one
+    if (virtio::console::init()) {
+        printf("kernel log continues on virtio-console\n");
+        removeOutputHandler(&serial::write);
+        addOutputHandler(&virtio::console::write);
+    }
 
     auto infoPA = paging::PhysicalAddress{reinterpret_cast<uint64_t>(info)};
     paging::mapRange(const_cast<multiboot::Info*>(info), infoPA, infoSize, paging::PMEFlags::Present);
     dumpMultibootInfo(info);
+    virtio::console::flush();
+
+    tsc::init();
+    fpu::init();
+    memory::init();
+    syscalls::init();
+
+    // the VGA text console is no use once GRUB switched to graphics
+    if (framebuffer::console::init(info)) {
+        addOutputHandler(&framebuffer::console::write);
+    } else {
+        addOutputHandler(&console::write);
+    }
+
+    apic::init();
+    apic::calibrateTimer();
+
+    if (acpi::init(info)) {
+        smp::startAps();
+    }
+
+    work::init();
+    klog::init();
+
+#ifdef SIMO_BENCHMARKS
+    sched::createThread("benchmarks", &bench::run, nullptr, 0, sched::ThreadFlags::Pinned);
+#endif
 
-    asm volatile("hlt");
+    // from here on the boot stack is just the BSP's idle thread
+    sched::start();
 }
\ No newline at end of file
@@ -0,0 +1,352 @@
+#include <Simo/Log.h>
+#include <Simo/CPU.h>
+#include <Simo/Interrupt.h>
+#include <Simo/LogFrame.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <Simo/Spinlock.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <printf.h>
+#include <stdarg.h>
+
+namespace klog
+{
+
+namespace
+{
+
+const size_t RING_SIZE = 1024;          // records, has to be a power of two
+const size_t TEXT_SIZE = 104;
+const size_t MAX_LINE = TEXT_SIZE + 48; // the text plus the "[    1.234567] 0 I " prefix
+const size_t DRAIN_BATCH = 1024;        // bytes handed to the output handlers at once
+
+const char LEVEL_TAGS[] = {'D', 'I', 'W', 'E'};
+
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
+static_assert(MAX_ARGUMENTS * sizeof(uint64_t) <= TEXT_SIZE);
+static_assert(sizeof(FrameHeader) + TEXT_SIZE <= MAX_LINE);
+
+// Producers and the consumer take turns on every record: on lap n of the ring it's free for a
+// producer while turn == 2n and ready for the consumer once turn == 2n + 1. That way the
+// all-zeroes .bss is a valid empty ring and nothing has to run at boot.
+struct alignas(64) Record
+{
+    uint64_t turn;
+    uint64_t timestamp;     // raw TSC, only converted when drained
+    uint16_t cpu;
+    Level level;
+    uint8_t length;         // of the text, or the number of arguments for binary records
+    uint32_t format;        // offset into .klog.formats, 0 (the empty string there) for text records
+
+    union
+    {
+        char text[TEXT_SIZE];
+        uint64_t arguments[MAX_ARGUMENTS];
+    };
+};
+
+static_assert(sizeof(Record) == 128);
+
+Record g_records[RING_SIZE];
+
+alignas(64) uint64_t g_head = 0;        // next position a producer reserves
+alignas(64) uint64_t g_tail = 0;        // next position to drain, only touched under g_drainLock
+uint64_t g_dropped = 0;
+
+Spinlock g_drainLock;
+
+sched::Thread* g_drainer = nullptr;
+bool g_drainerSleeping = false;
+
+// protects the history ring, readers and the output handler can be on different CPUs
+Spinlock g_historyLock;
+char g_history[HISTORY_SIZE];
+uint64_t g_historyEnd = 0;              // free-running, like the ring positions
+
+uint64_t lapOf(uint64_t position)
+{
+    return position / RING_SIZE;
+}
+
+bool pending()
+{
+    // only a hint when it doesn't come from the consumer
+    return __atomic_load_n(&g_head, __ATOMIC_RELAXED) != __atomic_load_n(&g_tail, __ATOMIC_RELAXED);
+}
+
+uint64_t nanosecondsOf(const Record& record)
+{
+    return tsc::frequency() ? tsc::cyclesToNanoseconds(record.timestamp) : 0;
+}
+
+size_t formatRecord(char* buffer, size_t size, const Record& record)
+{
+    auto nanoseconds = nanosecondsOf(record);
+
+    auto length = stl::format<"[%5lu.%06lu] %u %c %.*s">(buffer, size,
+        nanoseconds / 1'000'000'000, nanoseconds / 1'000 % 1'000'000, record.cpu,
+        LEVEL_TAGS[static_cast<uint8_t>(record.level)], int(record.length), record.text);
+
+    if (record.length == 0 || record.text[record.length - 1] != '\n') {
+        buffer[length++] = '\n';
+    }
+
+    return length;
+}
+
+size_t encodeFrame(char* buffer, const Record& record)
+{
+    FrameHeader header{FRAME_MAGIC, static_cast<uint8_t>(record.level), record.length, record.cpu,
+        record.format, nanosecondsOf(record)};
+
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), record.arguments, record.length * sizeof(uint64_t));
+
+    return sizeof(header) + record.length * sizeof(uint64_t);
+}
+
+void flushBatch(const char* batch, size_t length, bool binary)
+{
+    if (length == 0) {
+        return;
+    }
+
+    if (binary) {
+        writeSerialOutput(batch, length);
+    } else {
+        writeOutput(batch, length);
+    }
+}
+
+void drainLocked()
+{
+    char batch[DRAIN_BATCH];
+    size_t used = 0;
+    bool binary = false;    // frames only make sense to the decoder, they don't go to the screen
+
+    if (auto dropped = __atomic_exchange_n(&g_dropped, 0, __ATOMIC_RELAXED)) {
+        used += stl::format<"[klog: %lu messages dropped]\n">(batch, sizeof(batch), dropped);
+    }
+
+    while (true) {
+        auto position = g_tail;
+        auto& record = g_records[position & (RING_SIZE - 1)];
+
+        if (__atomic_load_n(&record.turn, __ATOMIC_ACQUIRE) != 2 * lapOf(position) + 1) {
+            break;
+        }
+
+        if (sizeof(batch) - used < MAX_LINE || (record.format != 0) != binary) {
+            flushBatch(batch, used, binary);
+            used = 0;
+            binary = record.format != 0;
+        }
+
+        if (binary) {
+            used += encodeFrame(batch + used, record);
+        } else {
+            used += formatRecord(batch + used, sizeof(batch) - used, record);
+        }
+
+        // hand the record back to the producers for the next lap
+        __atomic_store_n(&record.turn, 2 * lapOf(position) + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&g_tail, position + 1, __ATOMIC_RELAXED);
+    }
+
+    flushBatch(batch, used, binary);
+}
+
+void drain()
+{
+    IrqLockGuard guard(g_drainLock);
+    drainLocked();
+}
+
+void wakeDrainer()
+{
+    if (__atomic_load_n(&g_drainerSleeping, __ATOMIC_RELAXED) && __atomic_exchange_n(&g_drainerSleeping, false, __ATOMIC_ACQ_REL)) {
+        sched::wake(g_drainer);
+    }
+}
+
+// Claims the next free record, or counts a drop and returns nullptr when the ring is full.
+// Interrupts have to stay off until publish(), the drainer can't get past a record that's
+// still being written.
+Record* reserve(uint64_t& position)
+{
+    position = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+
+    while (true) {
+        auto record = &g_records[position & (RING_SIZE - 1)];
+
+        auto turn = __atomic_load_n(&record->turn, __ATOMIC_ACQUIRE);
+        auto difference = static_cast<int64_t>(turn - 2 * lapOf(position));
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&g_head, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                record->timestamp = cpu::rdtsc();
+                record->cpu = static_cast<uint16_t>(smp::cpuCount() ? smp::current().index : 0);
+                return record;
+            }
+        } else if (difference < 0) {
+            // still holds last lap's record, so the ring is full
+            __atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+            return nullptr;
+        } else {
+            position = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void publish(Record* record, uint64_t position)
+{
+    __atomic_store_n(&record->turn, 2 * lapOf(position) + 1, __ATOMIC_RELEASE);
+}
+
+void kickDrainer(Level level, uint64_t position)
+{
+    if (!__atomic_load_n(&g_drainer, __ATOMIC_ACQUIRE)) {
+        drain();
+        return;
+    }
+
+    // everything else waits for the next tick, so the drainer gets a batch
+    if (level >= Level::Warning || position - __atomic_load_n(&g_tail, __ATOMIC_RELAXED) >= RING_SIZE / 4) {
+        wakeDrainer();
+    }
+}
+
+void drainerMain(void*)
+{
+    auto self = sched::currentThread();
+
+    while (true) {
+        drain();
+
+        // Blocked goes first, so a wakeup between the check and block() isn't lost
+        {
+            interrupts::InterruptGuard guard;
+
+            self->state = sched::ThreadState::Blocked;
+            __atomic_store_n(&g_drainerSleeping, true, __ATOMIC_SEQ_CST);
+
+            if (pending()) {
+                sched::wake(self);
+            }
+
+            sched::block();
+        }
+
+        __atomic_store_n(&g_drainerSleeping, false, __ATOMIC_RELAXED);
+    }
+}
+
+}
+
+void init()
+{
+    __atomic_store_n(&g_drainer, sched::createThread("klog", &drainerMain, nullptr), __ATOMIC_RELEASE);
+}
+
+void write(Level level, const char* format, ...)
+{
+    uint64_t position;
+
+    {
+        interrupts::InterruptGuard guard;
+
+        auto record = reserve(position);
+        if (!record) {
+            return;
+        }
+
+        record->level = level;
+        record->format = 0;
+
+        va_list args;
+        va_start(args, format);
+        auto length = static_cast<size_t>(vsnprintf(record->text, TEXT_SIZE, format, args));
+        va_end(args);
+
+        record->length = static_cast<uint8_t>((length < TEXT_SIZE) ? length : TEXT_SIZE - 1);
+
+        publish(record, position);
+    }
+
+    kickDrainer(level, position);
+}
+
+void writeWords(Level level, uint32_t format, const uint64_t* arguments, size_t count)
+{
+    uint64_t position;
+
+    {
+        interrupts::InterruptGuard guard;
+
+        auto record = reserve(position);
+        if (!record) {
+            return;
+        }
+
+        record->level = level;
+        record->format = format;
+        record->length = static_cast<uint8_t>(count);
+
+        for (size_t i = 0; i < count; i++) {
+            record->arguments[i] = arguments[i];
+        }
+
+        publish(record, position);
+    }
+
+    kickDrainer(level, position);
+}
+
+void poll()
+{
+    if (__atomic_load_n(&g_drainer, __ATOMIC_RELAXED) && pending()) {
+        wakeDrainer();
+    }
+}
+
+void panicFlush()
+{
+    // the drainer might hold the lock on a CPU that's never coming back
+    OutputLockGuard guard(g_drainLock);
+    drainLocked();
+}
+
+void memorySink(const char* data, size_t length)
+{
+    OutputLockGuard guard(g_historyLock);
+
+    if (length > HISTORY_SIZE) {
+        data += length - HISTORY_SIZE;
+        length = HISTORY_SIZE;
+    }
+
+    auto offset = g_historyEnd % HISTORY_SIZE;
+    auto first = (length < HISTORY_SIZE - offset) ? length : HISTORY_SIZE - offset;
+
+    memcpy(g_history + offset, data, first);
+    memcpy(g_history, data + first, length - first);
+    g_historyEnd += length;
+}
+
+size_t readHistory(char* buffer, size_t size)
+{
+    IrqLockGuard guard(g_historyLock);
+
+    auto available = (g_historyEnd < HISTORY_SIZE) ? g_historyEnd : HISTORY_SIZE;
+    auto count = (size < available) ? size : available;
+    auto start = g_historyEnd - count;
+
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = g_history[(start + i) % HISTORY_SIZE];
+    }
+
+    return count;
+}
+
+}
@@ -0,0 +1,656 @@
+#include <Simo/Memory.h>
+#include <Simo/Alternatives.h>
+#include <Simo/CPU.h>
+#include <Simo/FPU.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Literals.h>
+#include <Simo/Scheduler.h>
+#include <printf.h>
+#include <stdint.h>
+
+// these are #defined to the gcc builtins in Utils.h
+#undef memcpy
+#undef memset
+#undef memmove
+
+// Nothing in here may compile to a call to memcpy() or memset(), so every loop is written in
+// assembly and everything else sticks to fixed-size __builtin_memcpy()s that gcc inlines.
+
+namespace memory
+{
+
+namespace
+{
+
+// up to here, a couple of overlapping loads and stores do it without a loop
+const size_t SMALL_SIZE = 64;
+
+// From here on the vector loops win, borrowing the registers and cli/popf cost about as much
+// as a few iterations
+const size_t VECTOR_SIZE = 256;
+
+// and from here on rep movsb/stosb does as well as they do, on CPUs that have ERMS
+const size_t ERMS_SIZE = 2_KiB;
+
+// interrupts are off while vector registers are borrowed, so big copies go in pieces unless
+// they can have a sched::FpuScope
+const size_t VECTOR_PIECE = 64_KiB;
+
+// without cache information in CPUID
+const size_t DEFAULT_NON_TEMPORAL_SIZE = 4_MiB;
+const size_t MIN_NON_TEMPORAL_SIZE = 1_MiB;
+
+enum class Vector : uint8_t
+{
+    None,
+    Sse2,
+    Avx2,
+};
+
+// ERMS and FSRM aren't in here, memcpy() and memset() test them through alternatives, patched
+// in at boot
+struct Strategy
+{
+    Vector vector;
+    size_t nonTemporalSize;     // bigger than this bypasses the cache instead of flushing it
+};
+
+// until init(), nothing that needs CPUID or fpu::init()
+Strategy g_strategy = {Vector::None, SIZE_MAX};
+
+uint16_t load16(const char* p)
+{
+    uint16_t value;
+    __builtin_memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t load32(const char* p)
+{
+    uint32_t value;
+    __builtin_memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t load64(const char* p)
+{
+    uint64_t value;
+    __builtin_memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+void store16(char* p, uint16_t value)
+{
+    __builtin_memcpy(p, &value, sizeof(value));
+}
+
+void store32(char* p, uint32_t value)
+{
+    __builtin_memcpy(p, &value, sizeof(value));
+}
+
+void store64(char* p, uint64_t value)
+{
+    __builtin_memcpy(p, &value, sizeof(value));
+}
+
+// Up to 64 bytes as a head and a tail that overlap in the middle. Everything is loaded before
+// anything is stored, so this works for memmove() too.
+void copySmall(char* dst, const char* src, size_t n)
+{
+    auto end = src + n;
+
+    if (n >= 32) {
+        auto a = load64(src), b = load64(src + 8), c = load64(src + 16), d = load64(src + 24);
+        auto e = load64(end - 32), f = load64(end - 24), g = load64(end - 16), h = load64(end - 8);
+
+        store64(dst, a);
+        store64(dst + 8, b);
+        store64(dst + 16, c);
+        store64(dst + 24, d);
+        store64(dst + n - 32, e);
+        store64(dst + n - 24, f);
+        store64(dst + n - 16, g);
+        store64(dst + n - 8, h);
+    } else if (n >= 16) {
+        auto a = load64(src), b = load64(src + 8), c = load64(end - 16), d = load64(end - 8);
+
+        store64(dst, a);
+        store64(dst + 8, b);
+        store64(dst + n - 16, c);
+        store64(dst + n - 8, d);
+    } else if (n >= 8) {
+        auto a = load64(src), b = load64(end - 8);
+
+        store64(dst, a);
+        store64(dst + n - 8, b);
+    } else if (n >= 4) {
+        auto a = load32(src), b = load32(end - 4);
+
+        store32(dst, a);
+        store32(dst + n - 4, b);
+    } else if (n >= 2) {
+        auto a = load16(src), b = load16(end - 2);
+
+        store16(dst, a);
+        store16(dst + n - 2, b);
+    } else if (n == 1) {
+        *dst = *src;
+    }
+}
+
+void setSmall(char* dst, uint64_t pattern, size_t n)
+{
+    if (n >= 32) {
+        store64(dst, pattern);
+        store64(dst + 8, pattern);
+        store64(dst + 16, pattern);
+        store64(dst + 24, pattern);
+        store64(dst + n - 32, pattern);
+        store64(dst + n - 24, pattern);
+        store64(dst + n - 16, pattern);
+        store64(dst + n - 8, pattern);
+    } else if (n >= 16) {
+        store64(dst, pattern);
+        store64(dst + 8, pattern);
+        store64(dst + n - 16, pattern);
+        store64(dst + n - 8, pattern);
+    } else if (n >= 8) {
+        store64(dst, pattern);
+        store64(dst + n - 8, pattern);
+    } else if (n >= 4) {
+        store32(dst, static_cast<uint32_t>(pattern));
+        store32(dst + n - 4, static_cast<uint32_t>(pattern));
+    } else if (n >= 2) {
+        store16(dst, static_cast<uint16_t>(pattern));
+        store16(dst + n - 2, static_cast<uint16_t>(pattern));
+    } else if (n == 1) {
+        *dst = static_cast<char>(pattern);
+    }
+}
+
+// More than 64 bytes through general registers: whole 32-byte blocks, then the last 32 bytes,
+// overlapping the last block. The last 32 bytes are read up front and every block is read
+// before it's written, so this also works for memmove() with the destination below the source.
+void copyMedium(char* dst, const char* src, size_t n)
+{
+    auto end = src + n;
+    auto e = load64(end - 32), f = load64(end - 24), g = load64(end - 16), h = load64(end - 8);
+    auto blocks = (n - 1) / 32;
+    auto tail = dst + n - 32;
+
+    asm volatile(R"(
+    1:
+        movq (%[src]), %%r8
+        movq 8(%[src]), %%r9
+        movq 16(%[src]), %%r10
+        movq 24(%[src]), %%r11
+        movq %%r8, (%[dst])
+        movq %%r9, 8(%[dst])
+        movq %%r10, 16(%[dst])
+        movq %%r11, 24(%[dst])
+        addq $32, %[src]
+        addq $32, %[dst]
+        decq %[blocks]
+        jnz 1b
+        )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "r8", "r9", "r10", "r11", "memory");
+
+    store64(tail, e);
+    store64(tail + 8, f);
+    store64(tail + 16, g);
+    store64(tail + 24, h);
+}
+
+void setMedium(char* dst, uint64_t pattern, size_t n)
+{
+    auto blocks = (n - 1) / 32;
+    auto tail = dst + n - 32;
+
+    asm volatile(R"(
+    1:
+        movq %[pattern], (%[dst])
+        movq %[pattern], 8(%[dst])
+        movq %[pattern], 16(%[dst])
+        movq %[pattern], 24(%[dst])
+        addq $32, %[dst]
+        decq %[blocks]
+        jnz 1b
+        )" : [dst]"+r"(dst), [blocks]"+r"(blocks) : [pattern]"r"(pattern) : "memory");
+
+    setSmall(tail, pattern, 32);
+}
+
+// memmove() with the destination above the source: 32-byte blocks from the top down, and the
+// first 32 bytes, read before anything got overwritten, go last.
+void copyBackward(char* dst, const char* src, size_t n)
+{
+    auto a = load64(src), b = load64(src + 8), c = load64(src + 16), d = load64(src + 24);
+    auto blocks = (n - 1) / 32;
+    auto dstEnd = dst + n;
+    auto srcEnd = src + n;
+
+    asm volatile(R"(
+    1:
+        subq $32, %[src]
+        subq $32, %[dst]
+        movq (%[src]), %%r8
+        movq 8(%[src]), %%r9
+        movq 16(%[src]), %%r10
+        movq 24(%[src]), %%r11
+        movq %%r8, (%[dst])
+        movq %%r9, 8(%[dst])
+        movq %%r10, 16(%[dst])
+        movq %%r11, 24(%[dst])
+        decq %[blocks]
+        jnz 1b
+        )" : [src]"+r"(srcEnd), [dst]"+r"(dstEnd), [blocks]"+r"(blocks) : : "r8", "r9", "r10", "r11", "memory");
+
+    store64(dst, a);
+    store64(dst + 8, b);
+    store64(dst + 16, c);
+    store64(dst + 24, d);
+}
+
+void repMovsb(char* dst, const char* src, size_t n)
+{
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+void repStosb(char* dst, uint8_t value, size_t n)
+{
+    asm volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+}
+
+// 64 bytes with unaligned loads and stores, for the ragged ends of the vector loops
+void copyUnaligned64(char* dst, const char* src)
+{
+    if (g_strategy.vector == Vector::Avx2) {
+        asm volatile(R"(
+            vmovdqu (%[src]), %%ymm0
+            vmovdqu 32(%[src]), %%ymm1
+            vmovdqu %%ymm0, (%[dst])
+            vmovdqu %%ymm1, 32(%[dst])
+            )" : : [src]"r"(src), [dst]"r"(dst) : "memory");
+    } else {
+        asm volatile(R"(
+            movdqu (%[src]), %%xmm0
+            movdqu 16(%[src]), %%xmm1
+            movdqu %%xmm0, (%[dst])
+            movdqu %%xmm1, 16(%[dst])
+            movdqu 32(%[src]), %%xmm0
+            movdqu 48(%[src]), %%xmm1
+            movdqu %%xmm0, 32(%[dst])
+            movdqu %%xmm1, 48(%[dst])
+            )" : : [src]"r"(src), [dst]"r"(dst) : "memory");
+    }
+}
+
+// Whole 64-byte blocks to a 64-byte aligned destination. Non-temporal stores go around the
+// cache through the write-combining buffers, a full line at a time.
+void copyBlocks(char* dst, const char* src, size_t blocks, bool nonTemporal)
+{
+    if (g_strategy.vector == Vector::Avx2 && nonTemporal) {
+        asm volatile(R"(
+        1:
+            vmovdqu (%[src]), %%ymm0
+            vmovdqu 32(%[src]), %%ymm1
+            vmovntdq %%ymm0, (%[dst])
+            vmovntdq %%ymm1, 32(%[dst])
+            addq $64, %[src]
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else if (g_strategy.vector == Vector::Avx2) {
+        asm volatile(R"(
+        1:
+            vmovdqu (%[src]), %%ymm0
+            vmovdqu 32(%[src]), %%ymm1
+            vmovdqa %%ymm0, (%[dst])
+            vmovdqa %%ymm1, 32(%[dst])
+            addq $64, %[src]
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else if (nonTemporal) {
+        asm volatile(R"(
+        1:
+            movdqu (%[src]), %%xmm0
+            movdqu 16(%[src]), %%xmm1
+            movntdq %%xmm0, (%[dst])
+            movntdq %%xmm1, 16(%[dst])
+            movdqu 32(%[src]), %%xmm0
+            movdqu 48(%[src]), %%xmm1
+            movntdq %%xmm0, 32(%[dst])
+            movntdq %%xmm1, 48(%[dst])
+            addq $64, %[src]
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else {
+        asm volatile(R"(
+        1:
+            movdqu (%[src]), %%xmm0
+            movdqu 16(%[src]), %%xmm1
+            movdqa %%xmm0, (%[dst])
+            movdqa %%xmm1, 16(%[dst])
+            movdqu 32(%[src]), %%xmm0
+            movdqu 48(%[src]), %%xmm1
+            movdqa %%xmm0, 32(%[dst])
+            movdqa %%xmm1, 48(%[dst])
+            addq $64, %[src]
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [src]"+r"(src), [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    }
+}
+
+// Fills xmm0/ymm0 with the pattern, the set loops store from there.
+void loadPattern(uint64_t pattern)
+{
+    uint64_t patterns[4] = {pattern, pattern, pattern, pattern};
+
+    if (g_strategy.vector == Vector::Avx2) {
+        asm volatile("vmovdqu (%0), %%ymm0" : : "r"(patterns) : "memory");
+    } else {
+        asm volatile("movdqu (%0), %%xmm0" : : "r"(patterns) : "memory");
+    }
+}
+
+void setUnaligned64(char* dst)
+{
+    if (g_strategy.vector == Vector::Avx2) {
+        asm volatile("vmovdqu %%ymm0, (%0); vmovdqu %%ymm0, 32(%0)" : : "r"(dst) : "memory");
+    } else {
+        asm volatile("movdqu %%xmm0, (%0); movdqu %%xmm0, 16(%0); movdqu %%xmm0, 32(%0); movdqu %%xmm0, 48(%0)"
+            : : "r"(dst) : "memory");
+    }
+}
+
+void setBlocks(char* dst, size_t blocks, bool nonTemporal)
+{
+    if (g_strategy.vector == Vector::Avx2 && nonTemporal) {
+        asm volatile(R"(
+        1:
+            vmovntdq %%ymm0, (%[dst])
+            vmovntdq %%ymm0, 32(%[dst])
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else if (g_strategy.vector == Vector::Avx2) {
+        asm volatile(R"(
+        1:
+            vmovdqa %%ymm0, (%[dst])
+            vmovdqa %%ymm0, 32(%[dst])
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else if (nonTemporal) {
+        asm volatile(R"(
+        1:
+            movntdq %%xmm0, (%[dst])
+            movntdq %%xmm0, 16(%[dst])
+            movntdq %%xmm0, 32(%[dst])
+            movntdq %%xmm0, 48(%[dst])
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    } else {
+        asm volatile(R"(
+        1:
+            movdqa %%xmm0, (%[dst])
+            movdqa %%xmm0, 16(%[dst])
+            movdqa %%xmm0, 32(%[dst])
+            movdqa %%xmm0, 48(%[dst])
+            addq $64, %[dst]
+            decq %[blocks]
+            jnz 1b
+            )" : [dst]"+r"(dst), [blocks]"+r"(blocks) : : "memory");
+    }
+}
+
+// A piece is at least 128 bytes: an unaligned head up to the next 64-byte boundary, aligned
+// blocks, and an unaligned tail that overlaps the last block.
+void copyPiece(char* dst, const char* src, size_t n, bool nonTemporal)
+{
+    copyUnaligned64(dst, src);
+
+    auto skew = 64 - (reinterpret_cast<uintptr_t>(dst) & 63);
+    auto blocks = (n - skew) / 64;
+
+    if (blocks > 0) {
+        copyBlocks(dst + skew, src + skew, blocks, nonTemporal);
+    }
+
+    copyUnaligned64(dst + n - 64, src + n - 64);
+}
+
+void setPiece(char* dst, size_t n, bool nonTemporal)
+{
+    setUnaligned64(dst);
+
+    auto skew = 64 - (reinterpret_cast<uintptr_t>(dst) & 63);
+    auto blocks = (n - skew) / 64;
+
+    if (blocks > 0) {
+        setBlocks(dst + skew, blocks, nonTemporal);
+    }
+
+    setUnaligned64(dst + n - 64);
+}
+
+void copyVector(char* dst, const char* src, size_t n, bool nonTemporal)
+{
+    // from preemptible code a big copy goes in one piece with interrupts on, a handler that
+    // copies something itself only borrows registers and puts them back
+    if (n >= 2 * VECTOR_PIECE && sched::canUseFpuScope()) {
+        sched::FpuScope scope;
+
+        copyPiece(dst, src, n, nonTemporal);
+        n = 0;
+    }
+
+    while (n > 0) {
+        // the last piece takes whatever's left, so it's never too short for a head and a tail
+        auto piece = (n >= 2 * VECTOR_PIECE) ? VECTOR_PIECE : n;
+
+        {
+            interrupts::InterruptGuard guard;
+            fpu::BorrowedRegisters registers;
+
+            copyPiece(dst, src, piece, nonTemporal);
+        }
+
+        dst += piece;
+        src += piece;
+        n -= piece;
+    }
+
+    // non-temporal stores aren't ordered with anything else
+    if (nonTemporal) {
+        asm volatile("sfence" : : : "memory");
+    }
+}
+
+void setVector(char* dst, uint64_t pattern, size_t n, bool nonTemporal)
+{
+    if (n >= 2 * VECTOR_PIECE && sched::canUseFpuScope()) {
+        sched::FpuScope scope;
+
+        loadPattern(pattern);
+        setPiece(dst, n, nonTemporal);
+        n = 0;
+    }
+
+    while (n > 0) {
+        auto piece = (n >= 2 * VECTOR_PIECE) ? VECTOR_PIECE : n;
+
+        {
+            interrupts::InterruptGuard guard;
+            fpu::BorrowedRegisters registers;
+
+            loadPattern(pattern);
+            setPiece(dst, piece, nonTemporal);
+        }
+
+        dst += piece;
+        n -= piece;
+    }
+
+    if (nonTemporal) {
+        asm volatile("sfence" : : : "memory");
+    }
+}
+
+// Walks CPUID's cache descriptors (leaf 4 on Intel, 0x8000001D on AMD, same layout) and
+// returns the size of the outermost level, or 0 if neither is there.
+size_t lastLevelCacheSize()
+{
+    const uint32_t leaves[] = {4, 0x8000'001D};
+    const uint32_t maxLeaves[] = {cpu::cpuid(0).eax, cpu::cpuid(0x8000'0000).eax};
+
+    for (size_t i = 0; i < 2; i++) {
+        if (maxLeaves[i] < leaves[i]) {
+            continue;
+        }
+
+        size_t size = 0;
+        uint32_t level = 0;
+
+        for (uint32_t subleaf = 0; subleaf < 16; subleaf++) {
+            auto cache = cpu::cpuid(leaves[i], subleaf);
+
+            if ((cache.eax & 0x1f) == 0) {
+                break;
+            }
+
+            auto cacheLevel = (cache.eax >> 5) & 0x7;
+            auto ways = (cache.ebx >> 22) + 1;
+            auto partitions = ((cache.ebx >> 12) & 0x3ff) + 1;
+            auto lineSize = (cache.ebx & 0xfff) + 1;
+            auto sets = cache.ecx + 1;
+
+            if (cacheLevel >= level) {
+                level = cacheLevel;
+                size = size_t(ways) * partitions * lineSize * sets;
+            }
+        }
+
+        if (size > 0) {
+            return size;
+        }
+    }
+
+    return 0;
+}
+
+}
+
+void init()
+{
+    // 256-bit moves only need AVX, but before AVX2 (Sandy and Ivy Bridge) they're split in
+    // two and don't beat SSE
+    g_strategy.vector = (fpu::hasAvx() && cpu::hasFeature(cpu::Feature::Avx2)) ? Vector::Avx2 : Vector::Sse2;
+
+    // a copy through the cache this big would push out everything else: the source and the
+    // destination together fill the last level
+    auto cacheSize = lastLevelCacheSize();
+    if (cacheSize == 0) {
+        g_strategy.nonTemporalSize = DEFAULT_NON_TEMPORAL_SIZE;
+    } else {
+        g_strategy.nonTemporalSize = (cacheSize / 2 > MIN_NON_TEMPORAL_SIZE) ? cacheSize / 2 : MIN_NON_TEMPORAL_SIZE;
+    }
+
+    printf("memcpy: %s%s, %s loops, non-temporal from %lu KiB (%lu KiB last level cache)\n",
+        cpu::hasFeature(cpu::Feature::Erms) ? "ERMS" : "no ERMS", cpu::hasFeature(cpu::Feature::Fsrm) ? " and FSRM" : "",
+        (g_strategy.vector == Vector::Avx2) ? "AVX2" : "SSE2", g_strategy.nonTemporalSize / 1_KiB, cacheSize / 1_KiB);
+}
+
+}
+
+using memory::g_strategy;
+using memory::Vector;
+using memory::SMALL_SIZE;
+using memory::VECTOR_SIZE;
+using memory::ERMS_SIZE;
+
+extern "C" void* memcpy(void* dest, const void* src, size_t length)
+{
+    auto dst = static_cast<char*>(dest);
+    auto source = static_cast<const char*>(src);
+
+    if (length <= SMALL_SIZE) {
+        memory::copySmall(dst, source, length);
+    } else if (length >= g_strategy.nonTemporalSize) {
+        memory::copyVector(dst, source, length, true);
+    } else if (length < VECTOR_SIZE) {
+        if (alternatives::hasFeature<cpu::Feature::Fsrm>()) {
+            memory::repMovsb(dst, source, length);
+        } else {
+            memory::copyMedium(dst, source, length);
+        }
+    } else if (alternatives::hasFeature<cpu::Feature::Erms>() && (length >= ERMS_SIZE || g_strategy.vector == Vector::None)) {
+        memory::repMovsb(dst, source, length);
+    } else if (g_strategy.vector != Vector::None) {
+        memory::copyVector(dst, source, length, false);
+    } else {
+        memory::copyMedium(dst, source, length);
+    }
+
+    return dest;
+}
+
+extern "C" void* memmove(void* dest, const void* src, size_t length)
+{
+    auto dst = static_cast<char*>(dest);
+    auto source = static_cast<const char*>(src);
+
+    auto distance = reinterpret_cast<uintptr_t>(dst) - reinterpret_cast<uintptr_t>(source);
+
+    // memcpy() is fine as long as the two don't overlap at all
+    if (distance >= length && -distance >= length) {
+        return memcpy(dest, src, length);
+    }
+
+    if (length <= SMALL_SIZE) {
+        memory::copySmall(dst, source, length);
+    } else if (distance >= length) {
+        memory::copyMedium(dst, source, length);
+    } else {
+        memory::copyBackward(dst, source, length);
+    }
+
+    return dest;
+}
+
+extern "C" void* memset(void* dest, int value, size_t length)
+{
+    auto dst = static_cast<char*>(dest);
+    auto pattern = 0x0101'0101'0101'0101ul * static_cast<uint8_t>(value);
+
+    if (length <= SMALL_SIZE) {
+        memory::setSmall(dst, pattern, length);
+    } else if (length >= g_strategy.nonTemporalSize) {
+        memory::setVector(dst, pattern, length, true);
+    } else if (length < VECTOR_SIZE) {
+        if (alternatives::hasFeature<cpu::Feature::Fsrm>()) {
+            memory::repStosb(dst, static_cast<uint8_t>(value), length);
+        } else {
+            memory::setMedium(dst, pattern, length);
+        }
+    } else if (alternatives::hasFeature<cpu::Feature::Erms>() && (length >= ERMS_SIZE || g_strategy.vector == Vector::None)) {
+        memory::repStosb(dst, static_cast<uint8_t>(value), length);
+    } else if (g_strategy.vector != Vector::None) {
+        memory::setVector(dst, pattern, length, false);
+    } else {
+        memory::setMedium(dst, pattern, length);
+    }
+
+    return dest;
+}
@@ -0,0 +1,101 @@
+#include <Simo/PCI.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+
+namespace pci
+{
+
+namespace
+{
+
+const uint16_t CONFIG_ADDRESS = 0xCF8;
+const uint16_t CONFIG_DATA = 0xCFC;
+
+void selectRegister(Address address, uint8_t offset)
+{
+    auto value = static_cast<uint32_t>(stl::bit<uint32_t>(31)
+        | (uint32_t(address.bus) << 16)
+        | (uint32_t(address.device) << 11)
+        | (uint32_t(address.function) << 8)
+        | (offset & 0xfc));
+
+    outl(CONFIG_ADDRESS, value);
+}
+
+}
+
+uint32_t read32(Address address, uint8_t offset)
+{
+    selectRegister(address, offset);
+    return inl(CONFIG_DATA);
+}
+
+uint16_t read16(Address address, uint8_t offset)
+{
+    return static_cast<uint16_t>(read32(address, offset) >> ((offset & 2) * 8));
+}
+
+uint8_t read8(Address address, uint8_t offset)
+{
+    return static_cast<uint8_t>(read32(address, offset) >> ((offset & 3) * 8));
+}
+
+void write32(Address address, uint8_t offset, uint32_t value)
+{
+    selectRegister(address, offset);
+    outl(CONFIG_DATA, value);
+}
+
+void write16(Address address, uint8_t offset, uint16_t value)
+{
+    auto shift = (offset & 2) * 8;
+    auto old = read32(address, offset);
+    auto mask = uint32_t(0xffff) << shift;
+
+    write32(address, offset, (old & ~mask) | (uint32_t(value) << shift));
+}
+
+bool findDevice(uint16_t vendorId, uint16_t deviceId, Address* result)
+{
+    for (uint16_t bus = 0; bus < 256; bus++) {
+        for (uint8_t device = 0; device < 32; device++) {
+            for (uint8_t function = 0; function < 8; function++) {
+                Address address{static_cast<uint8_t>(bus), device, function};
+                auto vendor = read16(address, VendorId);
+
+                if (vendor == 0xffff) {
+                    if (function == 0) {
+                        break;
+                    }
+
+                    continue;
+                }
+
+                if (vendor == vendorId && read16(address, DeviceId) == deviceId) {
+                    *result = address;
+                    return true;
+                }
+
+                // single function devices only decode function 0
+                if (function == 0 && (read8(address, HeaderType) & 0x80) == 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+uint16_t getIoBar(Address address, uint8_t bar)
+{
+    auto value = read32(address, static_cast<uint8_t>(Bar0 + bar * 4));
+
+    if ((value & 1) == 0) {
+        return 0;
+    }
+
+    return static_cast<uint16_t>(value & ~0x3u);
+}
+
+}
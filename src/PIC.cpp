@@ -0,0 +1,108 @@
+#include <Simo/PIC.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+
+namespace pic
+{
+
+enum Ports : uint16_t
+{
+    MasterCommand = 0x20,
+    MasterData = 0x21,
+    SlaveCommand = 0xA0,
+    SlaveData = 0xA1,
+};
+
+enum Commands : uint8_t
+{
+    Icw1Init = 0x10,
+    Icw1Icw4 = 0x01,
+    Icw4x86Mode = 0x01,
+    ReadISR = 0x0B,
+    EndOfInterrupt = 0x20,
+};
+
+namespace
+{
+
+uint16_t g_mask = 0xffff;
+
+void ioWait()
+{
+    // writes to an unused port take long enough for the old PICs to keep up
+    outb(0x80, 0);
+}
+
+void writeMask()
+{
+    outb(MasterData, static_cast<uint8_t>(g_mask & 0xff));
+    outb(SlaveData, static_cast<uint8_t>(g_mask >> 8));
+}
+
+uint16_t readISR()
+{
+    outb(MasterCommand, ReadISR);
+    outb(SlaveCommand, ReadISR);
+
+    return static_cast<uint16_t>((inb(SlaveCommand) << 8) | inb(MasterCommand));
+}
+
+}
+
+void init()
+{
+    outb(MasterCommand, Icw1Init | Icw1Icw4);
+    ioWait();
+    outb(SlaveCommand, Icw1Init | Icw1Icw4);
+    ioWait();
+
+    // ICW2: vector offsets
+    outb(MasterData, IRQ_BASE);
+    ioWait();
+    outb(SlaveData, IRQ_BASE + 8);
+    ioWait();
+
+    // ICW3: slave is attached to the master's IRQ2
+    outb(MasterData, 1 << static_cast<uint8_t>(Irq::Cascade));
+    ioWait();
+    outb(SlaveData, static_cast<uint8_t>(Irq::Cascade));
+    ioWait();
+
+    outb(MasterData, Icw4x86Mode);
+    ioWait();
+    outb(SlaveData, Icw4x86Mode);
+    ioWait();
+
+    // everything stays masked until someone actually installs a handler,
+    // except the cascade line so slave IRQs can get through once unmasked
+    g_mask = static_cast<uint16_t>(~stl::bit<uint16_t>(static_cast<uint8_t>(Irq::Cascade)));
+    writeMask();
+}
+
+void mask(Irq irq)
+{
+    g_mask |= stl::bit<uint16_t>(static_cast<uint8_t>(irq));
+    writeMask();
+}
+
+void unmask(Irq irq)
+{
+    g_mask &= static_cast<uint16_t>(~stl::bit<uint16_t>(static_cast<uint8_t>(irq)));
+    writeMask();
+}
+
+void sendEOI(Irq irq)
+{
+    if (static_cast<uint8_t>(irq) >= 8) {
+        outb(SlaveCommand, EndOfInterrupt);
+    }
+
+    outb(MasterCommand, EndOfInterrupt);
+}
+
+bool isSpurious(Irq irq)
+{
+    return (readISR() & stl::bit<uint16_t>(static_cast<uint8_t>(irq))) == 0;
+}
+
+}
@@ -1,10 +1,12 @@
 #include <Simo/Kernel.h>
+#include <Simo/CPU.h>
 #include <Simo/Multiboot.h>
 #include <Simo/Paging.h>
 #include <Simo/PageMap.h>
 #include <Simo/Utils.h>
 #include <Simo/FrameMap.h>
 #include <Simo/Literals.h>
+#include <Simo/Spinlock.h>
 #include <printf.h>
 #include <STL/Tuple.h>
 #include <STL/Bit.h>
@@ -119,6 +121,22 @@ stl::Tuple<const ElfSectionsTag*, const MmapTag*> getMultibootTags(const multibo
 
 PhysicalFrameMap* g_physFrameMap = nullptr;
 
+// covers the frame map, the page tables and both bump allocators below
+TrackedTicketLock g_lock{"paging"};
+REGISTER_LOCK_STATS(g_lock);
+
+// PML4 slot 509, right below the recursive mapping
+const uint64_t KERNEL_PAGES_BASE = 0xffff'fe80'0000'0000;
+uint64_t g_nextKernelPage = KERNEL_PAGES_BASE;
+
+// PML4 slot 508, for physical memory we don't own
+const uint64_t PHYSICAL_WINDOW_BASE = 0xffff'fe00'0000'0000;
+uint64_t g_nextPhysicalWindowPage = PHYSICAL_WINDOW_BASE;
+
+// PAT entry 1 (just PWT) defaults to write-through, which nothing maps with
+const uint64_t PAT_ENTRY_1 = 0xFF00;
+const uint64_t PAT_WRITE_COMBINING_1 = 0x0100;
+
 PML4& getPML4()
 {
     return *reinterpret_cast<PML4*>(PML4::VirtualBaseAddress);
@@ -151,10 +169,21 @@ PT& getPT(const void* addr)
     );
 }
 
+// The U/S bit has to be set at every level for ring 3 to get through, so tables covering
+// the lower half get it. The leaf entries still decide what's actually accessible.
+stl::Flags<PMEFlags> tableFlagsForAddress(const void* addr)
+{
+    if (reinterpret_cast<uint64_t>(addr) < USER_SPACE_END) {
+        return PMEFlags::Present | PMEFlags::Write | PMEFlags::User;
+    }
+
+    return PMEFlags::Present | PMEFlags::Write;
+}
+
 void initPDPTForAddress(PML4E* entry, const void* addr)
 {
     auto pdptPA = g_physFrameMap->allocateFrame();
-    entry->set(pdptPA, PMEFlags::Present | PMEFlags::Write);
+    entry->set(pdptPA, tableFlagsForAddress(addr));
     //printf("creating new PDPT at %016lx (va %p)\n", uint64_t(pdptPA), virtualAddr);
 
     new (&getPDPT(addr)) PDPT();
@@ -163,7 +192,7 @@ void initPDPTForAddress(PML4E* entry, const void* addr)
 void initPDForAddress(PDPTE* entry, const void* addr)
 {
     auto pdPA = g_physFrameMap->allocateFrame();
-    entry->set(pdPA, PMEFlags::Present | PMEFlags::Write);
+    entry->set(pdPA, tableFlagsForAddress(addr));
     //printf("creating new PD at %016lx (va %p)\n", uint64_t(pdPA), virtualAddr);
 
     new (&getPD(addr)) PD();
@@ -172,14 +201,17 @@ void initPDForAddress(PDPTE* entry, const void* addr)
 void initPTForAddress(PDE* entry, const void* addr)
 {
     auto ptPA = g_physFrameMap->allocateFrame();
-    entry->set(ptPA, PMEFlags::Present | PMEFlags::Write);
+    entry->set(ptPA, tableFlagsForAddress(addr));
     //printf("creating new PT at %016lx (va %p)\n", uint64_t(ptPA), virtualAddr);
 
     new (&getPT(addr)) PT();
 }
 
-void mapPage(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> flags)
+void mapPageUntrackedLocked(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> flags)
 {
+    // a reserved bit set in an entry is a page fault on every access through it
+    ASSERT((static_cast<uint64_t>(physAddr) >> cpu::physicalAddressBits()) == 0);
+
     if (auto& entry = getPML4().entryFromAddress(virtualAddr); !entry.isPresent()) {
         initPDPTForAddress(&entry, virtualAddr);
     }
@@ -192,23 +224,172 @@ void mapPage(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> f
         initPTForAddress(&entry, virtualAddr);
     }
 
-    g_physFrameMap->markFrame(physAddr, true); // maybe check if it's already marked?
     getPT(virtualAddr).entryFromAddress(virtualAddr).set(physAddr, flags);
 }
 
-void mapRange(void* virtualAddr, PhysicalAddress physAddr, size_t length, stl::Flags<PMEFlags> flags)
+// Whether every level on the way to virtualAddr has all of flags, which is how the MMU checks
+// Present and User.
+bool isMappedLocked(const void* virtualAddr, stl::Flags<PMEFlags> flags = PMEFlags::Present)
+{
+    auto allows = [flags](const auto& entry) { return (entry.raw & flags.value()) == flags.value(); };
+
+    if (!allows(getPML4().entryFromAddress(virtualAddr))) {
+        return false;
+    }
+
+    // a large page covers everything below it
+    if (auto& entry = getPDPT(virtualAddr).entryFromAddress(virtualAddr); !allows(entry) || entry.hasFlags(PMEFlags::PageSize)) {
+        return allows(entry);
+    }
+
+    if (auto& entry = getPD(virtualAddr).entryFromAddress(virtualAddr); !allows(entry) || entry.hasFlags(PMEFlags::PageSize)) {
+        return allows(entry);
+    }
+
+    return allows(getPT(virtualAddr).entryFromAddress(virtualAddr));
+}
+
+void mapPageLocked(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> flags)
+{
+    g_physFrameMap->markFrame(physAddr, true); // maybe check if it's already marked?
+    mapPageUntrackedLocked(virtualAddr, physAddr, flags);
+}
+
+void mapRangeLocked(void* virtualAddr, PhysicalAddress physAddr, size_t length, stl::Flags<PMEFlags> flags)
 {
     auto va = alignToPage<char*>(static_cast<char*>(virtualAddr), AlignMode::Down);
     physAddr = alignToPage(physAddr, AlignMode::Down);
 
     for (uint64_t mapped = 0; mapped < length; mapped += PAGE_SIZE) {
-        mapPage(va, physAddr, flags);
+        mapPageLocked(va, physAddr, flags);
 
         va += PAGE_SIZE;
         physAddr += PAGE_SIZE;
     }
 }
 
+void mapPageUntracked(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> flags)
+{
+    IrqLockGuard guard(g_lock);
+    mapPageUntrackedLocked(virtualAddr, physAddr, flags);
+}
+
+bool mapUnusedRangeUntracked(void* virtualAddr, PhysicalAddress physAddr, size_t count, stl::Flags<PMEFlags> flags)
+{
+    auto va = static_cast<char*>(virtualAddr);
+
+    IrqLockGuard guard(g_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        if (isMappedLocked(va + i * PAGE_SIZE)) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        mapPageUntrackedLocked(va + i * PAGE_SIZE, physAddr + i * PAGE_SIZE, flags);
+    }
+
+    return true;
+}
+
+bool isUserAccessible(uint64_t address, size_t length)
+{
+    if (!isUserRange(address, length)) {
+        return false;
+    }
+
+    IrqLockGuard guard(g_lock);
+
+    auto end = reinterpret_cast<const char*>(address) + length;
+
+    for (auto page = alignToPage(reinterpret_cast<const char*>(address), AlignMode::Down); page < end; page += PAGE_SIZE) {
+        if (!isMappedLocked(page, PMEFlags::Present | PMEFlags::User)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void mapPage(void* virtualAddr, PhysicalAddress physAddr, stl::Flags<PMEFlags> flags)
+{
+    IrqLockGuard guard(g_lock);
+    mapPageLocked(virtualAddr, physAddr, flags);
+}
+
+void mapRange(void* virtualAddr, PhysicalAddress physAddr, size_t length, stl::Flags<PMEFlags> flags)
+{
+    IrqLockGuard guard(g_lock);
+    mapRangeLocked(virtualAddr, physAddr, length, flags);
+}
+
+void* allocatePages(size_t count, PhysicalAddress* physAddr)
+{
+    void* va;
+    PhysicalAddress frames;
+
+    {
+        IrqLockGuard guard(g_lock);
+
+        frames = g_physFrameMap->allocateFrames(count);
+        ASSERT(frames != PhysicalAddress::Null);
+
+        va = reinterpret_cast<void*>(g_nextKernelPage);
+        g_nextKernelPage += count * PAGE_SIZE;
+
+        mapRangeLocked(va, frames, count * PAGE_SIZE, PMEFlags::Present | PMEFlags::Write);
+    }
+
+    memset(va, 0, count * PAGE_SIZE);
+
+    if (physAddr) {
+        *physAddr = frames;
+    }
+
+    return va;
+}
+
+void* allocateUserPages(void* virtualAddr, size_t count)
+{
+    ASSERT(reinterpret_cast<uint64_t>(virtualAddr) + count * PAGE_SIZE <= USER_SPACE_END);
+
+    auto va = static_cast<char*>(virtualAddr);
+
+    {
+        IrqLockGuard guard(g_lock);
+
+        for (size_t i = 0; i < count; i++) {
+            auto frame = g_physFrameMap->allocateFrame();
+            ASSERT(frame != PhysicalAddress::Null);
+
+            mapPageUntrackedLocked(va + i * PAGE_SIZE, frame, PMEFlags::Present | PMEFlags::Write | PMEFlags::User);
+        }
+    }
+
+    memset(va, 0, count * PAGE_SIZE);
+
+    return va;
+}
+
+void* mapPhysical(PhysicalAddress physAddr, size_t length, stl::Flags<PMEFlags> flags)
+{
+    auto pageOffset = static_cast<uint64_t>(physAddr) & (PAGE_SIZE - 1);
+    auto firstPage = alignToPage(physAddr, AlignMode::Down);
+    auto pages = stl::align(PAGE_SIZE, pageOffset + length) / PAGE_SIZE;
+
+    IrqLockGuard guard(g_lock);
+
+    auto va = reinterpret_cast<char*>(g_nextPhysicalWindowPage);
+    g_nextPhysicalWindowPage += pages * PAGE_SIZE;
+
+    for (size_t i = 0; i < pages; i++) {
+        mapPageUntrackedLocked(va + i * PAGE_SIZE, firstPage + i * PAGE_SIZE, flags);
+    }
+
+    return va + pageOffset;
+}
+
 void setupPageTables(const multiboot::Info* multibootInfo)
 {
     auto [elfSections, memoryMap] = getMultibootTags(multibootInfo);
@@ -280,8 +461,16 @@ void setupPageTables(const multiboot::Info* multibootInfo)
     printf("No longer running with identity mapping \\:D/\n");
 }
 
+void loadPat()
+{
+    // nothing uses entry 1 yet, so there are no stale cache lines or TLB entries to worry about
+    auto pat = cpu::readMsr(cpu::Msr::Pat);
+    cpu::writeMsr(cpu::Msr::Pat, (pat & ~PAT_ENTRY_1) | PAT_WRITE_COMBINING_1);
+}
+
 void init(const multiboot::Info* multibootInfo)
 {
+    loadPat();
     setupPageTables(multibootInfo);
     printf("if you're reading this, memory mapping actually work\n");
 }
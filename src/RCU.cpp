@@ -0,0 +1,177 @@
+#include <Simo/RCU.h>
+#include <Simo/Heap.h>
+#include <Simo/Interrupt.h>
+#include <Simo/SMP.h>
+#include <Simo/Spinlock.h>
+#include <Simo/Utils.h>
+
+namespace rcu
+{
+
+namespace
+{
+
+static_assert(smp::MAX_CPUS <= 64, "the pending CPU mask is a single uint64_t");
+
+// Grace periods are numbered. started == completed means none is running; otherwise the
+// CPUs still left in g_pendingCpus have to pass a quiescent state before #started is done.
+uint64_t g_started = 0;
+uint64_t g_completed = 0;
+uint64_t g_pendingCpus = 0;
+uint64_t g_onlineCpus = 0;
+uint64_t g_requested = 0;   // the newest grace period someone is waiting for
+Spinlock g_lock;
+
+struct alignas(64) CpuState
+{
+    uint64_t seen = 0;      // the last grace period this CPU reported a quiescent state for
+    Head* head = nullptr;   // callbacks, in grace period order
+    Head* tail = nullptr;
+};
+
+CpuState g_cpus[smp::MAX_CPUS];
+
+struct FreeNode
+{
+    Head head;
+    void* ptr;
+};
+
+// g_lock must be held.
+void startGracePeriodLocked()
+{
+    auto online = __atomic_load_n(&g_onlineCpus, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&g_pendingCpus, online, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_started, g_started + 1, __ATOMIC_RELEASE);
+
+    // nobody's scheduling yet, so there can't be any readers either
+    if (online == 0) {
+        __atomic_store_n(&g_completed, g_started, __ATOMIC_RELEASE);
+    }
+}
+
+void completeGracePeriod(uint64_t gracePeriod)
+{
+    LockGuard guard(g_lock);
+
+    __atomic_store_n(&g_completed, gracePeriod, __ATOMIC_RELEASE);
+
+    if (g_requested > gracePeriod) {
+        startGracePeriodLocked();
+    }
+}
+
+// Makes sure there's a grace period that starts after now, and returns its number.
+uint64_t requestGracePeriod()
+{
+    LockGuard guard(g_lock);
+
+    // one that's already running may have started before the caller's update
+    if (g_started == g_completed) {
+        startGracePeriodLocked();
+        g_requested = g_started;
+    } else {
+        g_requested = g_started + 1;
+    }
+
+    return g_requested;
+}
+
+void runCallbacks(CpuState& state)
+{
+    auto completed = __atomic_load_n(&g_completed, __ATOMIC_ACQUIRE);
+
+    while (state.head && state.head->gracePeriod <= completed) {
+        auto head = state.head;
+        state.head = head->next;
+        if (!state.head) {
+            state.tail = nullptr;
+        }
+
+        head->callback(head);
+    }
+}
+
+void freeCallback(Head* head)
+{
+    auto node = reinterpret_cast<FreeNode*>(head);
+    heap::free(node->ptr);
+    heap::free(node);
+}
+
+}
+
+void cpuOnline()
+{
+    auto index = smp::current().index;
+    g_cpus[index].seen = __atomic_load_n(&g_started, __ATOMIC_ACQUIRE);
+
+    // a grace period that's already running doesn't wait for us, we can't be holding anything from before it
+    __atomic_fetch_or(&g_onlineCpus, uint64_t(1) << index, __ATOMIC_RELEASE);
+}
+
+void quiescentState()
+{
+    auto index = smp::current().index;
+    auto& state = g_cpus[index];
+
+    auto started = __atomic_load_n(&g_started, __ATOMIC_ACQUIRE);
+    if (state.seen != started) {
+        state.seen = started;
+
+        auto bit = uint64_t(1) << index;
+        auto pending = __atomic_fetch_and(&g_pendingCpus, ~bit, __ATOMIC_ACQ_REL);
+        if (pending == bit) {
+            completeGracePeriod(started);
+        }
+    }
+
+    if (state.head) {
+        runCallbacks(state);
+    }
+}
+
+void call(Head* head, void (*callback)(Head*))
+{
+    interrupts::InterruptGuard guard;
+
+    head->next = nullptr;
+    head->callback = callback;
+    head->gracePeriod = requestGracePeriod();
+
+    auto& state = g_cpus[smp::current().index];
+    if (state.tail) {
+        state.tail->next = head;
+    } else {
+        state.head = head;
+    }
+
+    state.tail = head;
+}
+
+void free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    auto node = static_cast<FreeNode*>(heap::allocate(sizeof(FreeNode)));
+    node->ptr = ptr;
+    call(&node->head, &freeCallback);
+}
+
+void synchronize()
+{
+    uint64_t target;
+    {
+        interrupts::InterruptGuard guard;
+        target = requestGracePeriod();
+    }
+
+    while (__atomic_load_n(&g_completed, __ATOMIC_ACQUIRE) < target) {
+        sched::yield();
+    }
+}
+
+}
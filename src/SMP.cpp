@@ -0,0 +1,207 @@
+#include <Simo/SMP.h>
+#include <Simo/ACPI.h>
+#include <Simo/APIC.h>
+#include <Simo/CPU.h>
+#include <Simo/FPU.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Literals.h>
+#include <Simo/Log.h>
+#include <Simo/Paging.h>
+#include <Simo/Scheduler.h>
+#include <Simo/Syscall.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <STL/Bit.h>
+#include <printf.h>
+
+extern "C" char _apTrampolineStart;
+extern "C" char _apTrampolineParams;
+extern "C" char _apTrampolineEnd;
+extern "C" char _kernelStackBottomVA;
+extern "C" char _percpuTemplate;
+extern "C" char _percpuSize;       // absolute, the address is the value
+
+namespace smp
+{
+
+// must match the parameter block at the end of ap_trampoline.S
+struct TrampolineParams
+{
+    uint64_t cr3;
+    uint64_t stack;
+    uint64_t cpu;
+    uint64_t entry;
+};
+
+namespace
+{
+
+const size_t AP_STACK_SIZE = 16_KiB;
+
+// first in .percpu, so every CPU's CpuData sits right at its GS base
+[[gnu::used, gnu::section(".percpu.cpudata")]] CpuData g_cpuDataTemplate;
+
+CpuData* g_cpus[MAX_CPUS];
+size_t g_cpuCount = 0;
+
+// A fresh copy of .percpu, with a clean CpuData at the start.
+CpuData* allocatePerCpuArea()
+{
+    auto size = reinterpret_cast<size_t>(&_percpuSize);
+    auto area = paging::allocatePages(stl::align(paging::PAGE_SIZE, size) / paging::PAGE_SIZE);
+    memcpy(area, &_percpuTemplate, size);
+
+    return new (area) CpuData{};
+}
+
+void setCurrent(CpuData* cpu)
+{
+    cpu->self = cpu;
+    cpu::writeMsr(cpu::Msr::GsBase, reinterpret_cast<uint64_t>(cpu));
+
+    // swapped in by swapgs on the way to ring 3
+    cpu::writeMsr(cpu::Msr::KernelGsBase, 0);
+}
+
+bool waitOnline(const CpuData* cpu, uint64_t timeoutUs)
+{
+    const uint64_t step = 10;
+
+    for (uint64_t waited = 0; waited < timeoutUs; waited += step) {
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+
+        tsc::delayMicroseconds(step);
+    }
+
+    return __atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE);
+}
+
+[[noreturn]] void apMain(CpuData* cpu)
+{
+    // reloading the segment registers clears the GS base, so the GDT goes first
+    gdt::init(cpu->gdt);
+    setCurrent(cpu);
+
+    // memcpy() and memset() use vector registers once memory::init() ran on the BSP
+    fpu::init();
+    interrupts::load();
+    paging::loadPat();
+    apic::initAp();
+    syscalls::init();
+
+    __atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+
+    sched::start();
+}
+
+bool startAp(uint32_t apicId, TrampolineParams* params)
+{
+    auto cpu = allocatePerCpuArea();
+    cpu->index = static_cast<uint32_t>(g_cpuCount);
+    cpu->apicId = apicId;
+
+    auto stack = static_cast<char*>(paging::allocatePages(AP_STACK_SIZE / paging::PAGE_SIZE));
+    cpu->stackTop = stack + AP_STACK_SIZE;
+
+    params->stack = reinterpret_cast<uint64_t>(cpu->stackTop);
+    params->cpu = reinterpret_cast<uint64_t>(cpu);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // INIT, wait 10ms, then SIPI (and a second one if the first one got lost)
+    apic::sendInit(apicId);
+    tsc::delayMicroseconds(10'000);
+
+    apic::sendStartup(apicId, static_cast<uint8_t>(TRAMPOLINE_BASE / paging::PAGE_SIZE));
+    if (!waitOnline(cpu, 1'000)) {
+        apic::sendStartup(apicId, static_cast<uint8_t>(TRAMPOLINE_BASE / paging::PAGE_SIZE));
+
+        if (!waitOnline(cpu, 1'000'000)) {
+            LOG_WARNING("CPU with APIC ID %u didn't come up\n", apicId);
+            return false;
+        }
+    }
+
+    g_cpus[g_cpuCount++] = cpu;
+    LOG_INFO("CPU %u (APIC ID %u) online\n", cpu->index, apicId);
+
+    return true;
+}
+
+}
+
+void initBsp()
+{
+    auto bsp = allocatePerCpuArea();
+    bsp->index = 0;
+    bsp->stackTop = &_kernelStackBottomVA;
+    bsp->online = true;
+
+    gdt::init(bsp->gdt);
+    setCurrent(bsp);
+
+    g_cpus[0] = bsp;
+    g_cpuCount = 1;
+}
+
+void startAps()
+{
+    g_cpus[0]->apicId = apic::id();
+
+    auto madt = reinterpret_cast<const acpi::Madt*>(acpi::findTable("APIC"));
+    if (!madt) {
+        printf("no MADT, staying on the BSP\n");
+        return;
+    }
+
+    auto trampoline = reinterpret_cast<void*>(TRAMPOLINE_BASE);
+    auto trampolineSize = static_cast<size_t>(&_apTrampolineEnd - &_apTrampolineStart);
+    ASSERT(trampolineSize <= paging::PAGE_SIZE);
+
+    // the APs turn on paging while executing from here, so it has to be identity mapped
+    paging::mapPageUntracked(trampoline, paging::PhysicalAddress{TRAMPOLINE_BASE},
+        paging::PMEFlags::Present | paging::PMEFlags::Write);
+    memcpy(trampoline, &_apTrampolineStart, trampolineSize);
+
+    auto params = reinterpret_cast<TrampolineParams*>(
+        TRAMPOLINE_BASE + static_cast<size_t>(&_apTrampolineParams - &_apTrampolineStart));
+
+    // the trampoline loads CR3 while still in 32-bit mode
+    params->cr3 = cpu::readCR3();
+    ASSERT(params->cr3 < 4_GiB);
+    params->entry = reinterpret_cast<uint64_t>(&apMain);
+
+    acpi::forEachMadtEntry(madt, [&](const acpi::MadtEntry& entry) {
+        if (entry.type != acpi::MadtEntryType::LocalApic) {
+            return;
+        }
+
+        const auto& localApic = static_cast<const acpi::MadtLocalApic&>(entry);
+        // online-capable but not enabled ones are for hot-plug, there's nothing to start there yet
+        if ((localApic.flags & acpi::Enabled) == 0) {
+            return;
+        }
+
+        if (localApic.apicId == g_cpus[0]->apicId || g_cpuCount == MAX_CPUS) {
+            return;
+        }
+
+        startAp(localApic.apicId, params);
+    });
+
+    printf("%lu CPUs online\n", g_cpuCount);
+}
+
+size_t cpuCount()
+{
+    return g_cpuCount;
+}
+
+CpuData& cpu(size_t index)
+{
+    return *g_cpus[index];
+}
+
+}
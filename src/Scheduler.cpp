@@ -0,0 +1,558 @@
+#include <Simo/Scheduler.h>
+#include <Simo/APIC.h>
+#include <Simo/Console.h>
+#include <Simo/FramebufferConsole.h>
+#include <Simo/Log.h>
+#include <Simo/CPU.h>
+#include <Simo/FPU.h>
+#include <Simo/Heap.h>
+#include <Simo/Idle.h>
+#include <Simo/Interrupt.h>
+#include <Simo/RCU.h>
+#include <Simo/SMP.h>
+#include <Simo/Spinlock.h>
+#include <Simo/Utils.h>
+#include <Simo/VirtioConsole.h>
+#include <printf.h>
+
+extern "C" void switchContext(uint64_t* oldSp, uint64_t newSp);
+extern "C" void threadStart();
+
+namespace sched
+{
+
+namespace
+{
+
+// Every CPU owns its run queue and only takes another CPU's lock to steal from it,
+// so there's no lock that all CPUs fight over. Everything in here is only touched
+// with interrupts disabled.
+struct alignas(64) CpuState
+{
+    Spinlock lock;
+    Thread* head = nullptr;
+    Thread* tail = nullptr;
+    size_t length = 0;      // read without the lock by thieves, it's just a hint
+
+    Thread* current = nullptr;
+    Thread* previous = nullptr;     // the thread we just switched away from, see finishSwitch()
+    Thread* fpuOwner = nullptr;     // whose extended state is currently in this CPU's registers
+    bool inFpuScope = false;
+    Thread idle = {};
+
+    uint32_t sliceTicks = 0;
+    uint64_t rng = 0;
+    CpuStats stats = {};
+};
+
+CpuState g_cpus[smp::MAX_CPUS];
+uint32_t g_nextThreadId = 1;
+
+CpuState& local()
+{
+    return g_cpus[smp::current().index];
+}
+
+void enqueue(CpuState& state, Thread* thread)
+{
+    thread->next = nullptr;
+
+    if (state.tail) {
+        state.tail->next = thread;
+    } else {
+        state.head = thread;
+    }
+
+    state.tail = thread;
+    __atomic_store_n(&state.length, state.length + 1, __ATOMIC_RELAXED);
+}
+
+Thread* dequeue(CpuState& state)
+{
+    auto thread = state.head;
+    if (!thread) {
+        return nullptr;
+    }
+
+    state.head = thread->next;
+    if (!state.head) {
+        state.tail = nullptr;
+    }
+
+    __atomic_store_n(&state.length, state.length - 1, __ATOMIC_RELAXED);
+    thread->next = nullptr;
+
+    return thread;
+}
+
+// Like dequeue(), but skips over pinned threads.
+Thread* dequeueUnpinned(CpuState& state)
+{
+    Thread* prev = nullptr;
+
+    for (auto thread = state.head; thread; prev = thread, thread = thread->next) {
+        if (thread->flags & ThreadFlags::Pinned) {
+            continue;
+        }
+
+        if (prev) {
+            prev->next = thread->next;
+        } else {
+            state.head = thread->next;
+        }
+
+        if (state.tail == thread) {
+            state.tail = prev;
+        }
+
+        __atomic_store_n(&state.length, state.length - 1, __ATOMIC_RELAXED);
+        thread->next = nullptr;
+
+        return thread;
+    }
+
+    return nullptr;
+}
+
+uint64_t nextRandom(CpuState& state)
+{
+    // xorshift64
+    auto x = state.rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    state.rng = x;
+
+    return x;
+}
+
+// Takes half of a random victim's queue. Only one run queue lock is held at any time,
+// the stolen threads sit on a private list in between.
+Thread* steal(CpuState& state, uint32_t self)
+{
+    auto cpuCount = smp::cpuCount();
+    if (cpuCount < 2) {
+        return nullptr;
+    }
+
+    state.stats.stealAttempts++;
+
+    auto start = nextRandom(state) % cpuCount;
+    for (size_t i = 0; i < cpuCount; i++) {
+        auto victimIndex = (start + i) % cpuCount;
+        if (victimIndex == self) {
+            continue;
+        }
+
+        auto& victim = g_cpus[victimIndex];
+        if (__atomic_load_n(&victim.length, __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+
+        Thread* stolen = nullptr;
+        Thread* stolenTail = nullptr;
+        size_t count = 0;
+
+        victim.lock.lock();
+
+        auto toSteal = (victim.length + 1) / 2;
+        while (count < toSteal) {
+            auto thread = dequeueUnpinned(victim);
+            if (!thread) {
+                break;
+            }
+
+            thread->cpu = self;
+            if (stolenTail) {
+                stolenTail->next = thread;
+            } else {
+                stolen = thread;
+            }
+
+            stolenTail = thread;
+            count++;
+        }
+
+        victim.lock.unlock();
+
+        if (count == 0) {
+            continue;
+        }
+
+        state.stats.steals++;
+        state.stats.threadsStolen += count;
+
+        // run the first one right away, queue up the rest
+        auto first = stolen;
+        if (count > 1) {
+            LockGuard guard(state.lock);
+
+            for (auto thread = first->next; thread;) {
+                auto next = thread->next;
+                enqueue(state, thread);
+                thread = next;
+            }
+        }
+
+        first->next = nullptr;
+        return first;
+    }
+
+    return nullptr;
+}
+
+// Runs on the new thread's stack right after every switch.
+void finishSwitch(CpuState& state)
+{
+    auto previous = state.previous;
+    state.previous = nullptr;
+
+    if (!previous) {
+        return;
+    }
+
+    // only now is it safe for another CPU to pick the previous thread up
+    __atomic_store_n(&previous->onCpu, false, __ATOMIC_RELEASE);
+
+    if (previous->state == ThreadState::Dead) {
+        fpu::freeState(previous->fpuState);
+        heap::free(previous->stack);
+        heap::free(previous);
+    }
+}
+
+// Only threads that asked for it carry extended state: the kernel itself is built without
+// SSE, so for everyone else there's nothing to save. XSAVEOPT makes saving an untouched
+// state nearly free, and we skip the restore when the registers still hold the next
+// thread's state from the last time it ran here.
+void switchFpu(CpuState& state, Thread* previous, Thread* next, uint32_t self)
+{
+    if (previous->fpuState) {
+        fpu::save(previous->fpuState);
+    }
+
+    if (!next->fpuState) {
+        return;
+    }
+
+    if (state.fpuOwner == next && next->fpuCpu == self) {
+        state.stats.fpuRestoresSkipped++;
+        return;
+    }
+
+    fpu::restore(next->fpuState);
+    state.fpuOwner = next;
+    next->fpuCpu = self;
+}
+
+// Picks the next thread and switches to it. Must be called with interrupts disabled.
+void schedule()
+{
+    auto& state = local();
+    auto self = smp::current().index;
+    auto previous = state.current;
+
+    ASSERT(smp::current().preemptCount == 0);
+    smp::current().needResched = false;
+
+    // nobody can be inside a read-side section across a switch
+    rcu::quiescentState();
+
+    Thread* next;
+    {
+        LockGuard guard(state.lock);
+
+        if (previous != &state.idle && previous->state == ThreadState::Running) {
+            previous->state = ThreadState::Ready;
+            enqueue(state, previous);
+        }
+
+        next = dequeue(state);
+    }
+
+    if (!next) {
+        next = steal(state, self);
+    }
+
+    if (!next) {
+        next = &state.idle;
+    }
+
+    state.sliceTicks = 0;
+
+    if (next == previous) {
+        next->state = ThreadState::Running;
+        return;
+    }
+
+    // the thread could still be switching away on the CPU that queued it
+    while (__atomic_load_n(&next->onCpu, __ATOMIC_ACQUIRE)) {
+        cpu::pause();
+    }
+
+    next->state = ThreadState::Running;
+    next->onCpu = true;
+    next->cpu = self;
+
+    state.current = next;
+    state.previous = previous;
+    state.stats.contextSwitches++;
+
+    switchFpu(state, previous, next, self);
+
+    // where SYSCALL and interrupts from ring 3 land; the idle thread runs on the boot stack and never leaves the kernel
+    if (next->stack) {
+        auto stackTop = reinterpret_cast<uint64_t>(static_cast<char*>(next->stack) + THREAD_STACK_SIZE);
+        smp::current().kernelStack = stackTop;
+        smp::current().gdt.tss.rsp[0] = stackTop;
+    }
+
+    switchContext(&previous->sp, next->sp);
+
+    // we might have been stolen in the meantime, so this isn't necessarily the CPU we left from
+    finishSwitch(local());
+}
+
+[[gnu::interrupt]] void timerHandler(interrupts::InterruptContext*)
+{
+    apic::sendEOI();
+
+    auto& cpu = smp::current();
+    auto& state = g_cpus[cpu.index];
+    state.stats.ticks++;
+
+    // interrupting code outside of a read-side section is a quiescent state too
+    if (cpu.preemptCount == 0) {
+        rcu::quiescentState();
+    }
+
+    // picks up console output that didn't end in a flush of its own, and log records nobody woke the drainer for
+    if (cpu.index == 0) {
+        console::flush();
+        framebuffer::console::flush();
+        virtio::console::flushIfDue();
+        klog::poll();
+    }
+
+    if (state.current == &state.idle) {
+        state.stats.idleTicks++;
+        return;
+    }
+
+    if (++state.sliceTicks >= TIME_SLICE_TICKS) {
+        if (cpu.preemptCount > 0) {
+            cpu.needResched = true;
+            return;
+        }
+
+        state.stats.preemptions++;
+        schedule();
+    }
+}
+
+}
+
+extern "C" [[noreturn]] void threadMain()
+{
+    finishSwitch(local());
+    interrupts::enable();
+
+    auto thread = currentThread();
+    thread->entry(thread->arg);
+
+    exit();
+}
+
+Thread* createThread(const char* name, ThreadEntry entry, void* arg, int cpu, stl::Flags<ThreadFlags> flags)
+{
+    auto thread = static_cast<Thread*>(heap::allocate(sizeof(Thread)));
+    auto stack = static_cast<char*>(heap::allocate(THREAD_STACK_SIZE));
+
+    // what switchContext expects to pop: r15, r14, r13, r12, rbx, rbp and the return address
+    auto sp = reinterpret_cast<uint64_t*>(stack + THREAD_STACK_SIZE);
+    *--sp = 0;
+    *--sp = reinterpret_cast<uint64_t>(&threadStart);
+    for (int i = 0; i < 6; i++) {
+        *--sp = 0;
+    }
+
+    new (thread) Thread{
+        .sp = reinterpret_cast<uint64_t>(sp),
+        .next = nullptr,
+        .state = ThreadState::Ready,
+        .onCpu = false,
+        .id = __atomic_fetch_add(&g_nextThreadId, 1, __ATOMIC_RELAXED),
+        .cpu = 0,
+        .flags = flags,
+        .stack = stack,
+        .fpuState = (flags & ThreadFlags::UsesFpu) ? fpu::allocateState() : nullptr,
+        .fpuCpu = UINT32_MAX,
+        .entry = entry,
+        .arg = arg,
+        .name = name,
+    };
+
+    interrupts::InterruptGuard guard;
+
+    auto target = (cpu < 0) ? smp::current().index : static_cast<uint32_t>(cpu);
+    ASSERT(target < smp::cpuCount());
+    thread->cpu = target;
+
+    auto& state = g_cpus[target];
+    {
+        LockGuard lockGuard(state.lock);
+        enqueue(state, thread);
+    }
+
+    if (target != smp::current().index) {
+        idle::kick(target);
+    }
+
+    return thread;
+}
+
+void start()
+{
+    interrupts::disable();
+
+    auto& cpu = smp::current();
+    auto& state = g_cpus[cpu.index];
+
+    // the boot (or AP entry) context becomes the idle thread, it never sits in a run queue
+    state.idle.state = ThreadState::Running;
+    state.idle.onCpu = true;
+    state.idle.cpu = cpu.index;
+    state.idle.name = "idle";
+    state.current = &state.idle;
+    state.rng = cpu::rdtsc() | 1;
+
+    rcu::cpuOnline();
+    idle::init();
+
+    interrupts::setHandler(apic::TIMER_VECTOR, &timerHandler);
+    apic::startTimer(apic::TIMER_VECTOR, TICK_HZ);
+
+    while (true) {
+        schedule();
+
+        // anything queued for us from now on comes with a kick
+        idle::enter();
+    }
+}
+
+void preemptEnable()
+{
+    asm volatile("decl %%gs:%c0" : : "i"(offsetof(smp::CpuData, preemptCount)) : "memory");
+
+    // catch up on the preemption we held off. If we got moved in the meantime, that's
+    // fine too, the count is only ever non-zero for the thread that's running.
+    auto& cpu = smp::current();
+    if (cpu.needResched && cpu.preemptCount == 0) {
+        yield();
+    }
+}
+
+void beginFpu()
+{
+    preemptDisable();
+
+    auto& state = local();
+    ASSERT(!state.inFpuScope);
+    state.inFpuScope = true;
+
+    // a thread's state is live from the switch to it until it switches away
+    auto current = state.current;
+    if (current && current->fpuState) {
+        fpu::save(current->fpuState);
+    }
+
+    state.fpuOwner = nullptr;
+}
+
+void endFpu()
+{
+    auto& state = local();
+    auto current = state.current;
+
+    if (current && current->fpuState) {
+        fpu::restore(current->fpuState);
+        state.fpuOwner = current;
+        current->fpuCpu = smp::current().index;
+    }
+
+    state.inFpuScope = false;
+    preemptEnable();
+}
+
+bool canUseFpuScope()
+{
+    return interrupts::enabled() && smp::current().preemptCount == 0;
+}
+
+void yield()
+{
+    interrupts::InterruptGuard guard;
+    schedule();
+}
+
+void exit()
+{
+    interrupts::disable();
+
+    local().current->state = ThreadState::Dead;
+    schedule();
+
+    __builtin_unreachable();
+}
+
+void block()
+{
+    schedule();
+}
+
+void wake(Thread* thread)
+{
+    interrupts::InterruptGuard guard;
+
+    auto cpu = thread->cpu;
+    {
+        auto& state = g_cpus[cpu];
+        LockGuard lockGuard(state.lock);
+
+        if (thread->state != ThreadState::Blocked) {
+            return;
+        }
+
+        thread->state = ThreadState::Ready;
+        enqueue(state, thread);
+    }
+
+    if (cpu != smp::current().index) {
+        idle::kick(cpu);
+    }
+}
+
+Thread* currentThread()
+{
+    interrupts::InterruptGuard guard;
+    return local().current;
+}
+
+const CpuStats& stats(size_t cpu)
+{
+    return g_cpus[cpu].stats;
+}
+
+void dumpStats()
+{
+    for (size_t i = 0; i < smp::cpuCount(); i++) {
+        const auto& s = g_cpus[i].stats;
+        auto busyPercent = s.ticks ? (s.ticks - s.idleTicks) * 100 / s.ticks : 0;
+
+        printf("CPU %lu: %lu ticks (%lu%% busy), %lu switches, %lu preemptions, %lu/%lu steals (%lu threads), %lu queued\n",
+            i, s.ticks, busyPercent, s.contextSwitches, s.preemptions, s.steals, s.stealAttempts, s.threadsStolen,
+            __atomic_load_n(&g_cpus[i].length, __ATOMIC_RELAXED));
+    }
+}
+
+}
@@ -1,6 +1,11 @@
 #include <Simo/Kernel.h>
+#include <Simo/Interrupt.h>
+#include <Simo/PIC.h>
+#include <Simo/Serial.h>
+#include <Simo/Spinlock.h>
 #include <Simo/Utils.h>
 #include <STL/Bit.h>
+#include <STL/RingBuffer.h>
 #include <stdint.h>
 
 namespace serial
@@ -8,28 +13,205 @@ namespace serial
 
 const uint16_t COM1 = 0x3F8;
 
+// the 16550 TX FIFO is 16 bytes deep, so that's how much we can push per THRE interrupt
+const size_t FIFO_SIZE = 16;
+
+// how long a panic waits for whoever holds the TX lock before writing anyway
+const size_t PANIC_SPINS = 1'000'000;
+
 enum SerialPortOffsets : uint16_t
 {
     Data = 0,
     DivisorLatchLow = 0,
     DivisorLatchHigh = 1,
     InterruptEnable = 1,
+    InterruptIdentification = 2,
     FifoControl = 2,
     LineControl = 3,
+    ModemControl = 4,
     LineStatus = 5,
 };
 
+enum InterruptEnableFlags : uint8_t
+{
+    TransmitterEmpty = stl::bit<uint8_t>(1),
+};
+
+enum FifoControlFlags : uint8_t
+{
+    FifoEnable = stl::bit<uint8_t>(0),
+    ClearReceive = stl::bit<uint8_t>(1),
+    ClearTransmit = stl::bit<uint8_t>(2),
+    Trigger14Bytes = stl::bit<uint8_t>(7) | stl::bit<uint8_t>(6),
+};
+
+enum ModemControlFlags : uint8_t
+{
+    DataTerminalReady = stl::bit<uint8_t>(0),
+    RequestToSend = stl::bit<uint8_t>(1),
+    Out2 = stl::bit<uint8_t>(3), // gates the UART's IRQ line on PC hardware
+};
+
+enum class Mode
+{
+    Polling,
+    Interrupt,
+    Panic,
+};
+
+namespace
+{
+
+stl::RingBuffer<char, 4096> g_txRing;
+Mode g_mode = Mode::Polling;
+
+// Writers on any CPU and the IRQ handler all pop from the ring, so everything below it
+// (including g_txIdle) is only touched with this held.
+TrackedSpinlock g_txLock{"serial tx"};
+REGISTER_LOCK_STATS(g_txLock);
+
+// set by the IRQ handler when it ran out of data; the next writer has to restart transmission
+bool g_txIdle = false;
+
 bool canTransmit()
 {
     auto status = inb(COM1 + LineStatus);
     return (status & stl::bit(5)) != 0;
 }
 
-void write(char value)
+// Call with g_txLock held. Returns false if there was nothing left to send.
+bool fillFifo()
+{
+    // a THRE that was already pending when drainSync() refilled the FIFO would overrun it,
+    // it'll come again once the FIFO is empty
+    if (!canTransmit()) {
+        return true;
+    }
+
+    char c;
+    size_t count = 0;
+
+    while (count < FIFO_SIZE && g_txRing.pop(c)) {
+        outb(COM1 + Data, static_cast<uint8_t>(c));
+        count++;
+    }
+
+    return count > 0;
+}
+
+void drainSync()
+{
+    char c;
+
+    while (g_txRing.pop(c)) {
+        writeSync(c);
+    }
+}
+
+[[gnu::interrupt]] void irqHandler(interrupts::InterruptContext*)
+{
+    // reading IIR acknowledges the THRE interrupt
+    auto iir = inb(COM1 + InterruptIdentification);
+
+    if ((iir & 0x0f) == 0x02) {
+        LockGuard guard(g_txLock);
+
+        if (!fillFifo()) {
+            g_txIdle = true;
+        }
+    }
+
+    pic::sendEOI(pic::Irq::Com1);
+}
+
+}
+
+void init()
+{
+    // FIFOs on (boot.S did this already, but be explicit about the trigger level). Don't clear
+    // the TX FIFO, there might still be some polled output in there.
+    outb(COM1 + FifoControl, FifoEnable | ClearReceive | Trigger14Bytes);
+    outb(COM1 + ModemControl, DataTerminalReady | RequestToSend | Out2);
+
+    interrupts::setHandler(pic::vectorFromIrq(pic::Irq::Com1), irqHandler);
+    pic::unmask(pic::Irq::Com1);
+
+    {
+        interrupts::InterruptGuard guard;
+
+        // the UART raises THRE as soon as the FIFO runs dry, which marks us idle
+        outb(COM1 + InterruptEnable, TransmitterEmpty);
+        g_mode = Mode::Interrupt;
+    }
+}
+
+void writeSync(char value)
 {
     while (!canTransmit()) {}
 
     outb(COM1 + Data, static_cast<uint8_t>(value));
 }
 
+void write(const char* data, size_t length)
+{
+    if (g_mode != Mode::Interrupt) {
+        for (size_t i = 0; i < length; i++) {
+            writeSync(data[i]);
+        }
+
+        return;
+    }
+
+    // the IRQ handler may run on another CPU, so it can't just be kept out by disabling interrupts
+    IrqLockGuard guard(g_txLock);
+
+    while (true) {
+        auto pushed = g_txRing.push(data, length);
+        data += pushed;
+        length -= pushed;
+
+        if (length == 0) {
+            break;
+        }
+
+        // ring is full, so we'd rather stall here than drop log output
+        drainSync();
+    }
+
+    // nothing sent means no THRE interrupt either, so the next writer has to try again
+    if (g_txIdle) {
+        g_txIdle = !fillFifo();
+    }
+}
+
+void flush()
+{
+    IrqLockGuard guard(g_txLock);
+    drainSync();
+}
+
+void enterPanicMode()
+{
+    interrupts::disable();
+
+    if (g_mode == Mode::Interrupt) {
+        outb(COM1 + InterruptEnable, 0);
+    }
+
+    g_mode = Mode::Panic;
+
+    // the lock holder might be a CPU that's never coming back
+    bool locked = false;
+    for (size_t i = 0; i < PANIC_SPINS && !locked; i++) {
+        locked = g_txLock.tryLock();
+        cpu::pause();
+    }
+
+    drainSync();
+
+    if (locked) {
+        g_txLock.unlock();
+    }
+}
+
 }
\ No newline at end of file
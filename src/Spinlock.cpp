@@ -0,0 +1,22 @@
+#include <Simo/Spinlock.h>
+#include <Simo/TSC.h>
+#include <printf.h>
+
+extern "C" const TrackedLock* const _lockStatsStart[];
+extern "C" const TrackedLock* const _lockStatsEnd[];
+
+void dumpLockStats()
+{
+    printf("%-16s %12s %12s %6s %12s\n", "lock", "acquires", "contended", "%", "max hold ns");
+
+    for (auto entry = _lockStatsStart; entry < _lockStatsEnd; entry++) {
+        const auto& lock = **entry;
+        const auto& stats = lock.stats();
+
+        // racy snapshot, good enough for a rough picture
+        auto contendedPercent = stats.acquires ? stats.contended * 100 / stats.acquires : 0;
+
+        printf("%-16s %12lu %12lu %5lu%% %12lu\n", lock.name(), stats.acquires, stats.contended,
+            contendedPercent, tsc::cyclesToNanoseconds(stats.maxHoldCycles));
+    }
+}
@@ -0,0 +1,99 @@
+#include <Simo/Syscall.h>
+#include <Simo/CPU.h>
+#include <Simo/GDT.h>
+#include <Simo/IoRing.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <STL/Bit.h>
+
+extern "C" void syscallEntry();
+extern "C" [[noreturn]] void enterUserModeStub(uint64_t entry, uint64_t stack, uint64_t arg);
+
+namespace syscalls
+{
+
+namespace
+{
+
+// SyscallEntry.S hardcodes these
+static_assert(offsetof(smp::CpuData, kernelStack) == 8);
+static_assert(offsetof(smp::CpuData, userStack) == 16);
+static_assert((static_cast<uint16_t>(gdt::Selector::UserData) | gdt::USER_RPL) == 0x1b);
+static_assert((static_cast<uint16_t>(gdt::Selector::UserCode) | gdt::USER_RPL) == 0x23);
+
+const uint64_t EFER_SYSCALL_ENABLE = stl::bit(0);
+
+// SYSCALL comes in with interrupts, single stepping, the direction flag and AC all cleared
+const uint64_t SYSCALL_FLAGS_MASK = stl::bit(8) | stl::bit(9) | stl::bit(10) | stl::bit(14) | stl::bit(18);
+
+uint64_t sysNull(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    return 0;
+}
+
+uint64_t sysExit(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    sched::exit();
+}
+
+uint64_t sysYield(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    sched::yield();
+    return 0;
+}
+
+uint64_t sysIoRingSetup(uint64_t address, uint64_t flags, uint64_t pollCpu, uint64_t, uint64_t, uint64_t)
+{
+    return static_cast<uint64_t>(ioring::setup(address, static_cast<uint32_t>(flags), static_cast<uint32_t>(pollCpu)));
+}
+
+uint64_t sysIoRingEnter(uint64_t ring, uint64_t toSubmit, uint64_t flags, uint64_t, uint64_t, uint64_t)
+{
+    return static_cast<uint64_t>(ioring::enter(ring, static_cast<uint32_t>(toSubmit), static_cast<uint32_t>(flags)));
+}
+
+}
+
+}
+
+// indexed by syscalls::Number, SyscallEntry.S bounds checks against syscallCount
+extern "C" const syscalls::Handler syscallTable[] = {
+    &syscalls::sysNull,
+    &syscalls::sysExit,
+    &syscalls::sysYield,
+    &syscalls::sysIoRingSetup,
+    &syscalls::sysIoRingEnter,
+};
+
+extern "C" const uint64_t syscallCount = sizeof(syscallTable) / sizeof(syscallTable[0]);
+
+// SyscallEntry.S comes here instead of returning when the return address isn't canonical,
+// which takes a SYSCALL in the very last bytes of the lower half. There's nowhere to go back to.
+extern "C" [[noreturn]] void syscallBadReturn()
+{
+    sched::exit();
+}
+
+namespace syscalls
+{
+
+void init()
+{
+    cpu::writeMsr(cpu::Msr::Efer, cpu::readMsr(cpu::Msr::Efer) | EFER_SYSCALL_ENABLE);
+
+    // SYSCALL loads CS from bits 32-47 (SS is that + 8), SYSRET loads CS from bits 48-63 + 16
+    // and SS from the same + 8, both with RPL 3
+    auto kernelBase = uint64_t(gdt::Selector::KernelCode);
+    auto userBase = uint64_t(gdt::Selector::UserData) - 8;
+    cpu::writeMsr(cpu::Msr::Star, (userBase << 48) | (kernelBase << 32));
+
+    cpu::writeMsr(cpu::Msr::LStar, reinterpret_cast<uint64_t>(&syscallEntry));
+    cpu::writeMsr(cpu::Msr::SfMask, SYSCALL_FLAGS_MASK);
+}
+
+void enterUserMode(uint64_t entry, uint64_t stack, uint64_t arg)
+{
+    enterUserModeStub(entry, stack, arg);
+}
+
+}
@@ -0,0 +1,103 @@
+#include <Simo/TSC.h>
+#include <Simo/CPU.h>
+#include <Simo/Paging.h>
+#include <Simo/Utils.h>
+#include <printf.h>
+
+namespace tsc
+{
+
+namespace
+{
+
+const uint64_t PIT_FREQUENCY = 1'193'182;
+const uint64_t CALIBRATION_MS = 10;
+const uint32_t TIME_PAGE_SHIFT = 32;
+
+enum PitPorts : uint16_t
+{
+    Channel2Data = 0x42,
+    ModeCommand = 0x43,
+    SpeakerControl = 0x61,
+};
+
+uint64_t g_frequency = 0;
+TimePage* g_timePage = nullptr;
+
+// There's only one writer, and it's never a reader at the same time.
+void publishTimePage(uint64_t frequency)
+{
+    auto cycles = cpu::rdtsc();
+    auto nanoseconds = g_timePage->baseCycles ? readTimePage(*g_timePage) : 0;
+
+    g_timePage->sequence.writeBegin();
+    g_timePage->shift = TIME_PAGE_SHIFT;
+    g_timePage->multiplier = (1'000'000'000ull << TIME_PAGE_SHIFT) / frequency;
+    g_timePage->baseCycles = cycles;
+    g_timePage->baseNanoseconds = nanoseconds;
+    g_timePage->sequence.writeEnd();
+}
+
+}
+
+void init()
+{
+    // gate channel 2 on, keep the speaker quiet
+    auto control = static_cast<uint8_t>((inb(SpeakerControl) & ~0x02) | 0x01);
+    outb(SpeakerControl, control);
+
+    // channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(ModeCommand, 0b1011'0000);
+
+    const auto count = PIT_FREQUENCY * CALIBRATION_MS / 1000;
+    outb(Channel2Data, static_cast<uint8_t>(count & 0xff));
+    outb(Channel2Data, static_cast<uint8_t>(count >> 8));
+
+    // restart the count by toggling the gate
+    outb(SpeakerControl, static_cast<uint8_t>(control & ~0x01));
+    outb(SpeakerControl, control);
+
+    auto start = cpu::rdtsc();
+
+    // OUT2 goes high once the count hits zero
+    while ((inb(SpeakerControl) & 0x20) == 0) {}
+
+    auto end = cpu::rdtsc();
+
+    g_frequency = (end - start) * 1000 / CALIBRATION_MS;
+    printf("TSC runs at %lu.%03lu MHz\n", g_frequency / 1'000'000, (g_frequency / 1000) % 1000);
+
+    // one page shared by everyone, user space gets a read-only alias of it
+    paging::PhysicalAddress timePagePA;
+    g_timePage = static_cast<TimePage*>(paging::allocatePages(1, &timePagePA));
+    publishTimePage(g_frequency);
+
+    paging::mapPageUntracked(reinterpret_cast<void*>(TIME_PAGE_ADDRESS), timePagePA, paging::PMEFlags::Present | paging::PMEFlags::User);
+}
+
+uint64_t frequency()
+{
+    return g_frequency;
+}
+
+uint64_t cyclesToNanoseconds(uint64_t cycles)
+{
+    // split to avoid overflowing cycles * 10^9
+    return (cycles / g_frequency) * 1'000'000'000 + (cycles % g_frequency) * 1'000'000'000 / g_frequency;
+}
+
+uint64_t now()
+{
+    return readTimePage(*g_timePage);
+}
+
+void delayMicroseconds(uint64_t us)
+{
+    auto end = cpu::rdtsc() + g_frequency * us / 1'000'000;
+
+    while (cpu::rdtsc() < end) {
+        cpu::pause();
+    }
+}
+
+}
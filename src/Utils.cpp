@@ -1,95 +1,178 @@
 #include <Simo/Utils.h>
+#include <Simo/CPU.h>
+#include <Simo/Console.h>
+#include <Simo/FramebufferConsole.h>
 #include <printf.h>
 #include <Simo/Serial.h>
+#include <Simo/Heap.h>
+#include <Simo/Log.h>
+#include <Simo/PerCpu.h>
+#include <Simo/Spinlock.h>
+#include <Simo/VirtioConsole.h>
 
-// these are #defined to the gcc builtins in the header
-#undef memcpy
-#undef memset
-#undef memmove
+namespace assertion
+{
+
+constexpr const char* ASSERTION_FORMAT =
+R"(
+Assertion failed: %s
+    at %s:%d:%s
+)";
 
-extern "C" void* memcpy(void* dest, const void* src, size_t length)
+[[noreturn]] void assertionFailed(const char* msg, const char* file, int line, const char* func)
 {
-    if (dest == src || length == 0) {
-        return dest;
-    }
+    panic::enter();
+    printf(ASSERTION_FORMAT, msg, file, line, func);
 
-    auto destPtr = static_cast<char*>(dest);
-    auto srcPtr = static_cast<const char*>(src);
+    // the consoles only reach the screen on a flush, which nothing will do after this
+    console::flush();
+    framebuffer::console::flush();
+    virtio::console::flush();
+    cpu::halt();
+}
 
-    if (reinterpret_cast<uintptr_t>(dest) < reinterpret_cast<uintptr_t>(src)) {
-        // Copy forward
-        while (length--) {
-            *destPtr++ = *srcPtr++;
-        }
-    } else {
-        // Copy backwards
-        destPtr += length;
-        srcPtr += length;
+}
 
-        while (length--) {
-            *--destPtr = *--srcPtr;
-        }
-    }
+namespace panic
+{
+
+static bool g_active = false;
+
+void enter()
+{
+    interrupts::disable();
+    __atomic_store_n(&g_active, true, __ATOMIC_RELAXED);
 
-    return dest;
+    serial::enterPanicMode();
+    klog::panicFlush();
 }
 
-extern "C" void* memmove(void* dest, const void* src, size_t length)
+bool active()
 {
-    return memcpy(dest, src, length);
+    return __atomic_load_n(&g_active, __ATOMIC_RELAXED);
 }
 
-extern "C" void* memset(void* dest, int value, size_t length)
+}
+
+static const size_t MAX_OUTPUT_HANDLERS = 4;
+
+static OutputHandler g_outputs[MAX_OUTPUT_HANDLERS] = {&serial::write};
+static size_t g_outputCount = 1;
+
+// every CPU printing at once funnels through here, so it gets the queue lock
+static TrackedMcsLock g_outputLock{"output"};
+REGISTER_LOCK_STATS(g_outputLock);
+
+bool addOutputHandler(OutputHandler handler)
 {
-    auto destPtr = static_cast<char*>(dest);
+    IrqLockGuard guard(g_outputLock);
 
-    while (length--) {
-        *destPtr++ = static_cast<char>(value);
+    if (g_outputCount == MAX_OUTPUT_HANDLERS) {
+        return false;
     }
 
-    return dest;
+    g_outputs[g_outputCount++] = handler;
+    return true;
 }
 
-namespace assertion
+void removeOutputHandler(OutputHandler handler)
 {
+    IrqLockGuard guard(g_outputLock);
 
-constexpr const char* ASSERTION_FORMAT =
-R"(
-Assertion failed: %s
-    at %s:%d:%s
-)";
+    for (size_t i = 0; i < g_outputCount; i++) {
+        if (g_outputs[i] == handler) {
+            g_outputs[i] = g_outputs[--g_outputCount];
+            return;
+        }
+    }
+}
 
-[[noreturn]] void assertionFailed(const char* msg, const char* file, int line, const char* func)
+void writeOutput(const char* data, size_t length)
 {
-    printf(ASSERTION_FORMAT, msg, file, line, func);
-    while (true) {
-        asm("hlt");
+    // The holder might be this CPU, inside one of the handlers, so a panic goes around the lock.
+    // The handlers still lock for themselves.
+    if (panic::active()) {
+        for (size_t i = 0; i < g_outputCount; i++) {
+            g_outputs[i](data, length);
+        }
+
+        return;
+    }
+
+    IrqLockGuard guard(g_outputLock);
+
+    for (size_t i = 0; i < g_outputCount; i++) {
+        g_outputs[i](data, length);
     }
 }
 
+void writeSerialOutput(const char* data, size_t length)
+{
+    if (panic::active()) {
+        serial::write(data, length);
+        return;
+    }
+
+    IrqLockGuard guard(g_outputLock);
+    serial::write(data, length);
 }
 
-static PutcharHandler g_putchar = &serial::write;
+extern "C" void _putchar(char c)
+{
+    writeOutput(&c, 1);
+}
 
-void setPutcharHandler(PutcharHandler handler)
+extern "C" void _write(const char* data, size_t length)
 {
-    g_putchar = handler;
+    writeOutput(data, length);
 }
 
-extern "C" void _putchar(char c)
+// printf() formats into this and hands it over a chunk at a time. Interrupts stay off while
+// it's in use, so only an exception in the middle of a printf() can find it busy.
+struct PrintfBuffer
 {
-    if (!g_putchar) {
-        // hmm
-        return;
+    char data[256];
+    bool busy;
+    uint64_t flags;
+};
+
+PER_CPU static PerCpu<PrintfBuffer> g_printfBuffer;
+
+extern "C" char* _printf_buffer_acquire(size_t* size)
+{
+    // there's no per-CPU area before smp::initBsp()
+    if (smp::cpuCount() == 0) {
+        return nullptr;
     }
 
-    g_putchar(c);
+    auto flags = interrupts::saveAndDisable();
+    auto buffer = percpu::localPointer<g_printfBuffer>();
+
+    if (buffer->busy) {
+        interrupts::restore(flags);
+        return nullptr;
+    }
+
+    buffer->busy = true;
+    buffer->flags = flags;
+    *size = sizeof(buffer->data);
+
+    return buffer->data;
+}
+
+extern "C" void _printf_buffer_release(char*)
+{
+    auto buffer = percpu::localPointer<g_printfBuffer>();
+    auto flags = buffer->flags;
+
+    buffer->busy = false;
+    interrupts::restore(flags);
 }
 
 void* operator new  (size_t, void* p) throw() { return p; }
 void* operator new[](size_t, void* p) throw() { return p; }
 
-void  operator delete  (void*) throw() { };
-void  operator delete[](void*) throw() { };
-void  operator delete  (void*, size_t) throw() { };
-void  operator delete[](void*, size_t) throw() { };
+void  operator delete  (void* p) throw() { heap::free(p); };
+void  operator delete[](void* p) throw() { heap::free(p); };
+void  operator delete  (void* p, size_t) throw() { heap::free(p); };
+void  operator delete[](void* p, size_t) throw() { heap::free(p); };
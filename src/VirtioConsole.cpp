@@ -0,0 +1,268 @@
+#include <Simo/VirtioConsole.h>
+#include <Simo/Virtio.h>
+#include <Simo/FrameMap.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Paging.h>
+#include <Simo/PCI.h>
+#include <Simo/Spinlock.h>
+#include <Simo/TSC.h>
+#include <Simo/Utils.h>
+#include <printf.h>
+
+namespace virtio::console
+{
+
+namespace
+{
+
+const uint16_t DEVICE_ID = 0x1003;          // transitional virtio-console
+const uint16_t TRANSMIT_QUEUE = 1;          // port 0: receiveq is 0, transmitq is 1
+const size_t MAX_BUFFERS = 8;
+const size_t BUFFER_SIZE = paging::PAGE_SIZE;
+
+// every notify is a VM exit, so a line only gets sent right away if the last one went out this long ago
+const uint64_t FLUSH_INTERVAL_US = 10'000;
+
+struct TransmitQueue
+{
+    uint16_t ioBase;
+    uint16_t size;
+    Descriptor* descriptors;
+    AvailRing* avail;
+    UsedRing* used;
+    uint16_t lastUsedIdx;
+    bool notifyPending;
+};
+
+struct Buffer
+{
+    char* data;
+    paging::PhysicalAddress physAddr;
+    size_t length;
+    bool inFlight;
+};
+
+TransmitQueue g_queue;
+Buffer g_buffers[MAX_BUFFERS];
+size_t g_numBuffers = 0;
+size_t g_current = 0;
+bool g_initialized = false;
+uint64_t g_lastFlush = 0;
+
+// the timer tick flushes from CPU 0 while others write
+TrackedSpinlock g_lock{"virtio-console"};
+REGISTER_LOCK_STATS(g_lock);
+
+void reclaim()
+{
+    auto usedIdx = __atomic_load_n(&g_queue.used->idx, __ATOMIC_ACQUIRE);
+
+    while (g_queue.lastUsedIdx != usedIdx) {
+        const auto& element = g_queue.used->ring[g_queue.lastUsedIdx % g_queue.size];
+        g_buffers[element.id].inFlight = false;
+        g_queue.lastUsedIdx++;
+    }
+}
+
+void notify()
+{
+    // the avail index has to be visible before we look at the device's notification suppression flag
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if ((__atomic_load_n(&g_queue.used->flags, __ATOMIC_RELAXED) & UsedNoNotify) == 0) {
+        outw(g_queue.ioBase + QueueNotify, TRANSMIT_QUEUE);
+    }
+
+    g_queue.notifyPending = false;
+}
+
+void submit(size_t index)
+{
+    auto& buffer = g_buffers[index];
+    auto& descriptor = g_queue.descriptors[index];
+
+    descriptor.addr = static_cast<uint64_t>(buffer.physAddr);
+    descriptor.len = static_cast<uint32_t>(buffer.length);
+    descriptor.flags = 0;
+    descriptor.next = 0;
+
+    auto availIdx = g_queue.avail->idx;
+    g_queue.avail->ring[availIdx % g_queue.size] = static_cast<uint16_t>(index);
+    buffer.inFlight = true;
+
+    __atomic_store_n(&g_queue.avail->idx, static_cast<uint16_t>(availIdx + 1), __ATOMIC_RELEASE);
+    g_queue.notifyPending = true;
+}
+
+// Queues the current buffer and switches to the next one, waiting for the device if it's still busy with it.
+void advance()
+{
+    submit(g_current);
+    g_current = (g_current + 1) % g_numBuffers;
+
+    while (g_buffers[g_current].inFlight) {
+        if (g_queue.notifyPending) {
+            notify();
+        }
+
+        reclaim();
+        asm volatile("pause");
+    }
+
+    g_buffers[g_current].length = 0;
+}
+
+void flushLocked()
+{
+    if (g_buffers[g_current].length > 0) {
+        advance();
+    }
+
+    if (g_queue.notifyPending) {
+        notify();
+    }
+
+    reclaim();
+    g_lastFlush = cpu::rdtsc();
+}
+
+void flushIfDueLocked()
+{
+    if (cpu::rdtsc() - g_lastFlush >= tsc::frequency() * FLUSH_INTERVAL_US / 1'000'000) {
+        flushLocked();
+    }
+}
+
+}
+
+bool init()
+{
+    pci::Address address;
+    if (!pci::findDevice(VENDOR_ID, DEVICE_ID, &address)) {
+        return false;
+    }
+
+    auto ioBase = pci::getIoBar(address, 0);
+    if (ioBase == 0) {
+        printf("virtio-console: BAR0 isn't an I/O BAR, no legacy interface?\n");
+        return false;
+    }
+
+    auto command = pci::read16(address, pci::Command);
+    pci::write16(address, pci::Command, command | pci::IoSpace | pci::BusMaster | pci::InterruptDisable);
+
+    // reset, then tell the device we know what it is
+    outb(ioBase + DeviceStatus, 0);
+    outb(ioBase + DeviceStatus, Acknowledge);
+    outb(ioBase + DeviceStatus, (Acknowledge | Driver).value());
+
+    // no multiport, no console size, nothing fancy
+    inl(ioBase + DeviceFeatures);
+    outl(ioBase + GuestFeatures, 0);
+
+    outw(ioBase + QueueSelect, TRANSMIT_QUEUE);
+    auto queueSize = inw(ioBase + QueueSize);
+    if (queueSize == 0) {
+        outb(ioBase + DeviceStatus, Failed);
+        return false;
+    }
+
+    paging::PhysicalAddress queuePA;
+    auto queuePages = queueByteSize(queueSize) / paging::PAGE_SIZE;
+    auto queueVA = static_cast<char*>(paging::allocatePages(queuePages, &queuePA));
+
+    g_queue.ioBase = ioBase;
+    g_queue.size = queueSize;
+    g_queue.descriptors = reinterpret_cast<Descriptor*>(queueVA);
+    g_queue.avail = reinterpret_cast<AvailRing*>(queueVA + sizeof(Descriptor) * queueSize);
+    g_queue.used = reinterpret_cast<UsedRing*>(queueVA + usedRingOffset(queueSize));
+    g_queue.lastUsedIdx = 0;
+    g_queue.notifyPending = false;
+
+    // we reclaim buffers by polling the used ring, so the device doesn't need to interrupt us
+    g_queue.avail->flags = AvailNoInterrupt;
+
+    outl(ioBase + QueueAddress, static_cast<uint32_t>(static_cast<uint64_t>(queuePA) / QUEUE_ALIGN));
+
+    // one descriptor per buffer, and descriptor i always points at buffer i
+    g_numBuffers = (queueSize < MAX_BUFFERS) ? queueSize : MAX_BUFFERS;
+
+    paging::PhysicalAddress buffersPA;
+    auto buffersVA = static_cast<char*>(paging::allocatePages(g_numBuffers, &buffersPA));
+
+    for (size_t i = 0; i < g_numBuffers; i++) {
+        g_buffers[i] = Buffer{
+            .data = buffersVA + i * BUFFER_SIZE,
+            .physAddr = buffersPA + i * BUFFER_SIZE,
+            .length = 0,
+            .inFlight = false,
+        };
+    }
+
+    outb(ioBase + DeviceStatus, (Acknowledge | Driver | DriverOk).value());
+
+    g_current = 0;
+    g_initialized = true;
+
+    printf("virtio-console at %02x:%02x.%x, io %04x, tx queue size %u\n",
+        address.bus, address.device, address.function, ioBase, queueSize);
+
+    return true;
+}
+
+void write(const char* data, size_t length)
+{
+    if (!g_initialized) {
+        return;
+    }
+
+    OutputLockGuard guard(g_lock);
+    bool newline = false;
+
+    while (length > 0) {
+        auto& buffer = g_buffers[g_current];
+        auto space = BUFFER_SIZE - buffer.length;
+        auto count = (length < space) ? length : space;
+
+        for (size_t i = 0; i < count; i++) {
+            newline |= data[i] == '\n';
+        }
+
+        memcpy(buffer.data + buffer.length, data, count);
+        buffer.length += count;
+        data += count;
+        length -= count;
+
+        if (buffer.length == BUFFER_SIZE) {
+            advance();
+            notify();
+        }
+    }
+
+    // a burst of lines goes out in one go, the timer picks up whatever's left
+    if (newline) {
+        flushIfDueLocked();
+    }
+}
+
+void flush()
+{
+    if (!g_initialized) {
+        return;
+    }
+
+    OutputLockGuard guard(g_lock);
+    flushLocked();
+}
+
+void flushIfDue()
+{
+    if (!g_initialized) {
+        return;
+    }
+
+    OutputLockGuard guard(g_lock);
+    flushIfDueLocked();
+}
+
+}
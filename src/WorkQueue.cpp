@@ -0,0 +1,207 @@
+#include <Simo/WorkQueue.h>
+#include <Simo/Interrupt.h>
+#include <Simo/Scheduler.h>
+#include <Simo/SMP.h>
+#include <Simo/Spinlock.h>
+#include <Simo/Utils.h>
+
+namespace work
+{
+
+namespace
+{
+
+struct alignas(64) Queue
+{
+    Spinlock lock;
+    Item* head = nullptr;
+    Item* tail = nullptr;
+    sched::Thread* worker = nullptr;
+    bool sleeping = false;
+};
+
+Queue g_queues[smp::MAX_CPUS];
+bool g_running = false;
+
+Item* pop(Queue& queue)
+{
+    auto item = queue.head;
+    if (item) {
+        queue.head = item->next;
+        if (!queue.head) {
+            queue.tail = nullptr;
+        }
+    }
+
+    return item;
+}
+
+void workerMain(void* arg)
+{
+    auto& queue = *static_cast<Queue*>(arg);
+
+    while (true) {
+        Item* item;
+
+        {
+            interrupts::InterruptGuard irqGuard;
+
+            {
+                LockGuard guard(queue.lock);
+
+                item = pop(queue);
+                if (!item) {
+                    queue.sleeping = true;
+                    sched::currentThread()->state = sched::ThreadState::Blocked;
+                }
+            }
+
+            // queue() wakes us up once it sees sleeping
+            if (!item) {
+                sched::block();
+                continue;
+            }
+        }
+
+        item->function(item);
+    }
+}
+
+struct ParallelFor;
+
+struct Helper
+{
+    Item item;
+    ParallelFor* context;
+};
+
+struct ParallelFor
+{
+    size_t next;
+    size_t end;
+    size_t grain;
+    void (*invoke)(const void*, Range);
+    const void* fn;
+    uint32_t pendingHelpers;
+    Helper helpers[smp::MAX_CPUS];
+};
+
+void runChunks(ParallelFor& context)
+{
+    while (true) {
+        auto begin = __atomic_fetch_add(&context.next, context.grain, __ATOMIC_RELAXED);
+        if (begin >= context.end) {
+            return;
+        }
+
+        auto end = (context.end - begin < context.grain) ? context.end : begin + context.grain;
+        context.invoke(context.fn, Range{begin, end});
+    }
+}
+
+void helperMain(Item* item)
+{
+    auto& context = *reinterpret_cast<Helper*>(item)->context;
+
+    runChunks(context);
+
+    // the context lives on the caller's stack, this has to be the last thing we touch
+    __atomic_sub_fetch(&context.pendingHelpers, 1, __ATOMIC_RELEASE);
+}
+
+}
+
+void init()
+{
+    for (size_t i = 0; i < smp::cpuCount(); i++) {
+        auto& queue = g_queues[i];
+        queue.worker = sched::createThread("worker", &workerMain, &queue, static_cast<int>(i),
+            sched::ThreadFlags::Pinned);
+    }
+
+    __atomic_store_n(&g_running, true, __ATOMIC_RELEASE);
+}
+
+bool running()
+{
+    return __atomic_load_n(&g_running, __ATOMIC_ACQUIRE);
+}
+
+void queue(Item* item, uint32_t cpu)
+{
+    ASSERT(cpu < smp::cpuCount());
+
+    auto& queue = g_queues[cpu];
+    bool wake;
+
+    item->next = nullptr;
+
+    {
+        IrqLockGuard guard(queue.lock);
+
+        if (queue.tail) {
+            queue.tail->next = item;
+        } else {
+            queue.head = item;
+        }
+
+        queue.tail = item;
+
+        wake = queue.sleeping;
+        queue.sleeping = false;
+    }
+
+    if (wake) {
+        sched::wake(queue.worker);
+    }
+}
+
+void parallelFor(Range range, size_t grain, void (*invoke)(const void*, Range), const void* fn)
+{
+    if (range.begin >= range.end) {
+        return;
+    }
+
+    ParallelFor context;
+    context.next = range.begin;
+    context.end = range.end;
+    context.grain = (grain > 0) ? grain : 1;
+    context.invoke = invoke;
+    context.fn = fn;
+    context.pendingHelpers = 0;
+
+    if (running()) {
+        auto chunks = (range.end - range.begin + context.grain - 1) / context.grain;
+
+        // stay on this CPU while handing out work, so we know which one to skip
+        sched::preemptDisable();
+        auto self = smp::current().index;
+
+        for (uint32_t cpu = 0; cpu < smp::cpuCount() && context.pendingHelpers + 1 < chunks; cpu++) {
+            if (cpu == self) {
+                continue;
+            }
+
+            auto& helper = context.helpers[context.pendingHelpers++];
+            helper.item.function = &helperMain;
+            helper.context = &context;
+        }
+
+        for (uint32_t i = 0, cpu = 0; i < context.pendingHelpers; cpu++) {
+            if (cpu != self) {
+                queue(&context.helpers[i++].item, cpu);
+            }
+        }
+
+        sched::preemptEnable();
+    }
+
+    runChunks(context);
+
+    // whatever helpers are left only have their last chunk to finish, or find nothing to do
+    while (__atomic_load_n(&context.pendingHelpers, __ATOMIC_ACQUIRE) > 0) {
+        cpu::pause();
+    }
+}
+
+}
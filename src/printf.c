@@ -122,6 +122,27 @@ static inline void _out_char(char character, void* buffer, size_t idx, size_t ma
 }
 
 
+// internal chunked output, hands the buffer to _write() whenever it's full and at the end
+typedef struct {
+  char*  data;
+  size_t size;
+  size_t used;
+} out_chunk_type;
+
+static inline void _out_chunk(char character, void* buffer, size_t idx, size_t maxlen)
+{
+  out_chunk_type* chunk = (out_chunk_type*)buffer;
+  (void)idx; (void)maxlen;
+  if (character) {
+    chunk->data[chunk->used++] = character;
+  }
+  if ((!character || (chunk->used == chunk->size)) && chunk->used) {
+    _write(chunk->data, chunk->used);
+    chunk->used = 0U;
+  }
+}
+
+
 // internal output function wrapper
 static inline void _out_fct(char character, void* buffer, size_t idx, size_t maxlen)
 {
@@ -711,8 +732,17 @@ int printf_(const char* format, ...)
 {
   va_list va;
   va_start(va, format);
-  char buffer[1];
-  const int ret = _vsnprintf(_out_char, buffer, (size_t)-1, format, va);
+  int ret;
+  out_chunk_type chunk = { NULL, 0U, 0U };
+  chunk.data = _printf_buffer_acquire(&chunk.size);
+  if (chunk.data) {
+    ret = _vsnprintf(_out_chunk, (char*)&chunk, (size_t)-1, format, va);
+    _printf_buffer_release(chunk.data);
+  }
+  else {
+    char buffer[1];
+    ret = _vsnprintf(_out_char, buffer, (size_t)-1, format, va);
+  }
   va_end(va);
   return ret;
 }
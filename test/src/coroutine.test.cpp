@@ -0,0 +1,85 @@
+#include "catch.hpp"
+
+#include "STL/Coroutine.h"
+
+namespace
+{
+
+// Hands out one value per resume.
+struct Counter
+{
+    struct promise_type
+    {
+        int value = 0;
+
+        Counter get_return_object() { return Counter{stl::CoroutineHandle<promise_type>::from_promise(*this)}; }
+        stl::SuspendAlways initial_suspend() noexcept { return {}; }
+        stl::SuspendAlways final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() {}
+
+        stl::SuspendAlways yield_value(int v)
+        {
+            value = v;
+            return {};
+        }
+    };
+
+    stl::CoroutineHandle<promise_type> handle;
+};
+
+Counter countTo(int limit)
+{
+    for (int i = 1; i <= limit; i++) {
+        co_yield i;
+    }
+}
+
+// Symmetric transfer to the noop coroutine has to just return to whoever resumed us.
+struct ToNoop
+{
+    bool await_ready() const noexcept { return false; }
+    stl::CoroutineHandle<> await_suspend(stl::CoroutineHandle<>) noexcept { return stl::noop_coroutine(); }
+    void await_resume() const noexcept {}
+};
+
+Counter suspendThroughNoop()
+{
+    co_await ToNoop{};
+    co_yield 42;
+}
+
+}
+
+TEST_CASE("coroutine handle resume and promise", "[coroutine]") {
+    auto counter = countTo(3);
+    auto handle = counter.handle;
+
+    REQUIRE(handle);
+    REQUIRE(!handle.done());
+
+    for (int expected = 1; expected <= 3; expected++) {
+        handle.resume();
+        REQUIRE(handle.promise().value == expected);
+    }
+
+    handle.resume();
+    REQUIRE(handle.done());
+
+    REQUIRE(stl::CoroutineHandle<Counter::promise_type>::from_address(handle.address()) == handle);
+    handle.destroy();
+}
+
+TEST_CASE("coroutine symmetric transfer to noop", "[coroutine]") {
+    auto counter = suspendThroughNoop();
+    auto handle = counter.handle;
+
+    handle.resume();
+    REQUIRE(handle.promise().value == 0);
+    REQUIRE(!handle.done());
+
+    handle.resume();
+    REQUIRE(handle.promise().value == 42);
+
+    handle.destroy();
+}
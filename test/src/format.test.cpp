@@ -0,0 +1,105 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "catch.hpp"
+
+#include "STL/Format.h"
+
+// formats the same thing with stl::format and snprintf, which both have to agree on
+#define CHECK_FORMAT(fmt, ...) \
+    do { \
+        char expected[128]; \
+        char actual[128]; \
+        auto expectedLength = std::snprintf(expected, sizeof(expected), fmt, __VA_ARGS__); \
+        auto actualLength = stl::format<fmt>(actual, sizeof(actual), __VA_ARGS__); \
+        CHECK(std::string(actual) == std::string(expected)); \
+        CHECK(actualLength == static_cast<size_t>(expectedLength)); \
+    } while (0)
+
+TEST_CASE("format integers", "[format]") {
+    CHECK_FORMAT("%d %i", 0, -1);
+    CHECK_FORMAT("%d", 2147483647);
+    CHECK_FORMAT("%d", (-2147483647 - 1));
+    CHECK_FORMAT("%ld", INT64_MIN);
+    CHECK_FORMAT("%lu", UINT64_MAX);
+    CHECK_FORMAT("%u", 1234567890u);
+    CHECK_FORMAT("%u", -1);
+    CHECK_FORMAT("%hhx %hx", -1, -1);
+    CHECK_FORMAT("%hhd", 200);
+    CHECK_FORMAT("%+d %+d", 5, -5);
+    CHECK_FORMAT("%zu", sizeof(int));
+
+    // 7^22 is the last power that fits
+    for (uint64_t value = 1, i = 0; i <= 22; value *= 7, i++) {
+        CHECK_FORMAT("%lu %lx %lX", value, value, value);
+    }
+}
+
+TEST_CASE("format widths and precisions", "[format]") {
+    CHECK_FORMAT("[%5d] [%-5d] [%05d]", 42, 42, 42);
+    CHECK_FORMAT("[%05d] [%-5d]", -42, -42);
+    CHECK_FORMAT("[%016lx] [%04lx] [%08lx]", 0xffffffff80001234ul, 0x10ul, 0x246ul);
+    CHECK_FORMAT("[%#x] [%#X] [%#x] [%#010x]", 255, 255, 0, 255);
+    CHECK_FORMAT("[%.5d] [%8.3d] [%.0d] [%.0d]", 42, 7, 0, 1);
+    CHECK_FORMAT("[%5lu.%06lu]", 12ul, 3456ul);
+    CHECK_FORMAT("[%*d] [%-*d] [%*d]", 6, 1, 6, 2, -6, 3);
+    CHECK_FORMAT("[%.*d]", 4, 9);
+}
+
+TEST_CASE("format strings and characters", "[format]") {
+    CHECK_FORMAT("%s, %s!", "hello", "world");
+    CHECK_FORMAT("[%10s] [%-10s] [%.3s]", "right", "left", "truncated");
+    CHECK_FORMAT("[%.*s] [%*.*s]", 2, "abcdef", 6, 3, "abcdef");
+    CHECK_FORMAT("%c%c%c [%3c] [%-3c]", 'a', 'b', 'c', 'x', 'y');
+    CHECK_FORMAT("100%% %s", "done");
+
+    char buffer[32];
+    CHECK(stl::format<"plain text">(buffer, sizeof(buffer)) == 10);
+    CHECK(std::string(buffer) == "plain text");
+
+    const char* null = nullptr;
+    stl::format<"%s">(buffer, sizeof(buffer), null);
+    CHECK(std::string(buffer) == "(null)");
+}
+
+TEST_CASE("format pointers like printf.c", "[format]") {
+    char buffer[32];
+
+    stl::format<"%p">(buffer, sizeof(buffer), reinterpret_cast<void*>(0xffffffff8000abcdul));
+    CHECK(std::string(buffer) == "FFFFFFFF8000ABCD");
+
+    stl::format<"%p">(buffer, sizeof(buffer), reinterpret_cast<int*>(0x10));
+    CHECK(std::string(buffer) == "0000000000000010");
+}
+
+TEST_CASE("format truncates like snprintf", "[format]") {
+    char buffer[8];
+
+    CHECK(stl::format<"%s %d">(buffer, sizeof(buffer), "truncated", 12345) == 15);
+    CHECK(std::string(buffer) == "truncat");
+
+    CHECK(stl::format<"%d">(buffer, 0, 1) == 1);
+}
+
+namespace
+{
+
+std::string g_flushed;
+
+void flushTo(const char* data, size_t length)
+{
+    g_flushed.append(data, length);
+}
+
+}
+
+TEST_CASE("format buffer hands over full chunks", "[format]") {
+    char buffer[4];
+    stl::FormatBuffer out(buffer, sizeof(buffer), &flushTo);
+
+    g_flushed.clear();
+    stl::formatTo<"%s-%08x-%s">(out, "longer than the buffer", 0xbeef, "end");
+
+    CHECK(out.finish() == 35);
+    CHECK(g_flushed == "longer than the buffer-0000beef-end");
+}
@@ -0,0 +1,72 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "catch.hpp"
+
+#include "STL/Hash.h"
+
+// check values from RFC 3720 and the usual "123456789"
+static_assert(stl::crc32c("123456789", 9) == 0xE306'9283);
+static_assert(stl::crc32c("", 0) == 0);
+static_assert(stl::hash64("", 0) == 0xEF46'DB37'51D8'E999);
+
+TEST_CASE("crc32c check values", "[hash]") {
+    uint8_t data[32];
+
+    std::memset(data, 0, sizeof(data));
+    CHECK(stl::crc32c(data, sizeof(data)) == 0x8A91'36AA);
+
+    std::memset(data, 0xff, sizeof(data));
+    CHECK(stl::crc32c(data, sizeof(data)) == 0x62A8'AB43);
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    CHECK(stl::crc32c(data, sizeof(data)) == 0x46DD'794E);
+
+    CHECK(stl::crc32c("123456789", 9) == 0xE306'9283);
+    CHECK(stl::crc32cSoftware("123456789", 9) == 0xE306'9283);
+}
+
+TEST_CASE("crc32c agrees with itself on every path", "[hash]") {
+    // long enough for the interleaved streams, with a few bytes of slack to misalign it
+    std::vector<char> data(4000);
+    uint32_t state = 1;
+
+    for (auto& c : data) {
+        state = state * 1103515245 + 12345;
+        c = static_cast<char>(state >> 16);
+    }
+
+    for (size_t size : {0, 1, 7, 8, 9, 63, 255, 767, 768, 769, 1536, 2309, 3990}) {
+        for (size_t offset = 0; offset < 8; offset += 3) {
+            auto p = data.data() + offset;
+            auto expected = stl::detail::hash::crc32cBytes(~0u, p, size) ^ ~0u;
+
+            CHECK(stl::crc32c(p, size) == expected);
+            CHECK(stl::crc32cSoftware(p, size) == expected);
+
+            // continuing from a split gives the same as doing it in one go
+            auto half = size / 2;
+            CHECK(stl::crc32c(p + half, size - half, stl::crc32c(p, half)) == expected);
+        }
+    }
+}
+
+TEST_CASE("hash64 matches XXH64", "[hash]") {
+    CHECK(stl::hash64("", 0) == 0xEF46'DB37'51D8'E999);
+    CHECK(stl::hash64("a", 1) == 0xD24E'C4F1'A98C'6E5B);
+    CHECK(stl::hash64("abc", 3) == 0x44BC'2CF5'AD77'0999);
+
+    const char text[] = "Nobody inspects the spammish repetition";
+    CHECK(stl::hash64(text, sizeof(text) - 1) == 0xFBCE'A83C'8A37'8BF1);
+}
+
+TEST_CASE("hash64 is the same at compile time and at run time", "[hash]") {
+    static constexpr char text[] = "a key that's long enough for the four accumulators, plus a tail";
+    constexpr auto compiled = stl::hash64(text, sizeof(text) - 1, 42);
+
+    std::vector<char> copy(text, text + sizeof(text) - 1);
+    CHECK(stl::hash64(copy.data(), copy.size(), 42) == compiled);
+    CHECK(stl::hash64(copy.data(), copy.size(), 43) != compiled);
+}
@@ -0,0 +1,62 @@
+#include "catch.hpp"
+
+#include "STL/RingBuffer.h"
+
+TEST_CASE("ring buffer push and pop", "[ringbuffer]") {
+    stl::RingBuffer<int, 4> rb;
+
+    REQUIRE(rb.empty());
+    REQUIRE(rb.push(1));
+    REQUIRE(rb.push(2));
+    REQUIRE(rb.size() == 2);
+
+    int value = 0;
+    REQUIRE(rb.pop(value));
+    REQUIRE(value == 1);
+    REQUIRE(rb.pop(value));
+    REQUIRE(value == 2);
+    REQUIRE(!rb.pop(value));
+}
+
+TEST_CASE("ring buffer full and wraparound", "[ringbuffer]") {
+    stl::RingBuffer<char, 4> rb;
+
+    for (int round = 0; round < 3; round++) {
+        for (char c = 'a'; c < 'e'; c++) {
+            REQUIRE(rb.push(c));
+        }
+
+        REQUIRE(rb.full());
+        REQUIRE(!rb.push('x'));
+
+        for (char c = 'a'; c < 'e'; c++) {
+            char value = 0;
+            REQUIRE(rb.pop(value));
+            REQUIRE(value == c);
+        }
+
+        REQUIRE(rb.empty());
+    }
+}
+
+TEST_CASE("ring buffer bulk push", "[ringbuffer]") {
+    stl::RingBuffer<char, 8> rb;
+
+    REQUIRE(rb.push("abcde", 5) == 5);
+
+    char value = 0;
+    REQUIRE(rb.pop(value));
+    REQUIRE(value == 'a');
+
+    // only 4 of these fit, and they wrap around the end of the storage
+    REQUIRE(rb.push("fghij", 5) == 4);
+    REQUIRE(rb.full());
+    REQUIRE(rb.push("x", 1) == 0);
+
+    for (char c = 'b'; c <= 'i'; c++) {
+        REQUIRE(rb.pop(value));
+        REQUIRE(value == c);
+    }
+
+    REQUIRE(rb.empty());
+}
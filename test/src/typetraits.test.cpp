@@ -30,4 +30,11 @@ TEST_CASE("type traits", "[type-traits]") {
 
     REQUIRE(stl::AreSame<TestTypeAlias, TestType, TestTypeAlias2> == true);
     REQUIRE(stl::AreSame<int, TestType> == false);
-}
\ No newline at end of file
+}
+
+TEST_CASE("move of an lvalue", "[type-traits]") {
+    TestType value;
+
+    REQUIRE(stl::IsSame<decltype(stl::move(value)), TestType&&> == true);
+    REQUIRE(stl::IsSame<decltype(stl::move(TestType{})), TestType&&> == true);
+}
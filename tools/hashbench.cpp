@@ -0,0 +1,60 @@
+// Host-side throughput of the hashes in STL/Hash.h, the same ones the kernel's benchmarks time,
+// so the two can be compared (and changes to Hash.h tried out without booting anything):
+//
+//     $ build/tools/hashbench
+#include <STL/Hash.h>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+
+const size_t TOTAL = 256 * 1024 * 1024;
+const size_t SIZES[] = {64, 4 * 1024, 64 * 1024, 1024 * 1024};
+
+template<typename THash>
+void measure(const char* name, const std::vector<char>& buffer, size_t size, THash&& hash)
+{
+    auto iterations = TOTAL / size;
+    uint64_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        asm volatile("" : : "r"(buffer.data()) : "memory");
+        sink += hash(buffer.data(), size);
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    asm volatile("" : : "r"(sink));
+
+    printf("%-14s %8zu bytes: %6.2f GB/s\n", name, size, double(iterations * size) / elapsed.count());
+}
+
+}
+
+int main()
+{
+    std::vector<char> buffer(SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1]);
+
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<char>(i * 131);
+    }
+
+    printf("crc32 instruction: %s\n", stl::detail::hash::hasCrc32Instruction() ? "yes" : "no");
+
+    for (auto size : SIZES) {
+        measure("crc32c", buffer, size, [](const char* data, size_t length) {
+            return stl::crc32c(data, length);
+        });
+        measure("crc32c tables", buffer, size, [](const char* data, size_t length) {
+            return stl::crc32cSoftware(data, length);
+        });
+        measure("hash64", buffer, size, [](const char* data, size_t length) {
+            return stl::hash64(data, length);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,341 @@
+// Turns a capture of the kernel's serial output back into text when it was built with
+// -Dlog_format=binary. Text passes through as it is, binary log records (see LogFrame.h) get
+// formatted with the strings in kernel.elf's .klog.formats section:
+//
+//     $ qemu-system-x86_64 ... -serial file:serial.log
+//     $ build/tools/klogdecode build/kernel.elf serial.log
+//
+// Without a capture file it reads stdin, so it works at the end of a pipe too. -l adds where
+// each record was logged from.
+#include <Simo/LogFrame.h>
+#include <elf.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const char LEVEL_TAGS[] = {'D', 'I', 'W', 'E'};
+const size_t MAX_ARGUMENTS = 13;    // has to match Log.h, which isn't host-compilable
+
+struct Section
+{
+    uint64_t address;
+    uint64_t size;
+    const char* data;
+};
+
+struct Image
+{
+    std::vector<char> file;
+    Section formats{};
+    std::vector<Section> loaded;    // for %s, strings in .rodata and friends
+};
+
+bool readFile(FILE* input, std::vector<char>& data)
+{
+    char buffer[64 * 1024];
+    size_t count;
+
+    while ((count = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+
+    return !ferror(input);
+}
+
+bool loadImage(const char* path, Image& image)
+{
+    auto file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    auto ok = readFile(file, image.file);
+    fclose(file);
+
+    if (!ok || image.file.size() < sizeof(Elf64_Ehdr)) {
+        fprintf(stderr, "%s: can't read the ELF header\n", path);
+        return false;
+    }
+
+    auto base = image.file.data();
+    auto header = reinterpret_cast<const Elf64_Ehdr*>(base);
+
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS64 ||
+        header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > image.file.size() || header->e_shstrndx >= header->e_shnum) {
+        fprintf(stderr, "%s: not a 64-bit ELF file\n", path);
+        return false;
+    }
+
+    auto sections = reinterpret_cast<const Elf64_Shdr*>(base + header->e_shoff);
+    auto names = base + sections[header->e_shstrndx].sh_offset;
+
+    for (size_t i = 0; i < header->e_shnum; i++) {
+        auto& section = sections[i];
+
+        if (section.sh_type == SHT_NOBITS || section.sh_offset + section.sh_size > image.file.size()) {
+            continue;
+        }
+
+        Section entry{section.sh_addr, section.sh_size, base + section.sh_offset};
+
+        if (strcmp(names + section.sh_name, klog::FORMAT_SECTION) == 0) {
+            image.formats = entry;
+        } else if (section.sh_flags & SHF_ALLOC) {
+            image.loaded.push_back(entry);
+        }
+    }
+
+    if (!image.formats.data) {
+        fprintf(stderr, "%s: no %s section, was it built with -Dlog_format=binary?\n", path, klog::FORMAT_SECTION);
+        return false;
+    }
+
+    return true;
+}
+
+std::string stringAt(const Image& image, uint64_t address)
+{
+    for (auto& section : image.loaded) {
+        if (address >= section.address && address < section.address + section.size) {
+            auto start = section.data + (address - section.address);
+            auto end = static_cast<const char*>(memchr(start, 0, section.size - (address - section.address)));
+
+            if (end) {
+                return std::string(start, end);
+            }
+        }
+    }
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "<string at %#lx>", static_cast<unsigned long>(address));
+    return buffer;
+}
+
+// Formats one record the way the kernel's printf() would have. Every conversion is handed to
+// the host's snprintf() with the argument narrowed to what its length modifier says.
+std::string formatRecord(const Image& image, const char* format, const uint64_t* arguments, size_t count)
+{
+    std::string output;
+    size_t next = 0;
+
+    auto argument = [&]() -> uint64_t {
+        return (next < count) ? arguments[next++] : 0;
+    };
+
+    while (*format) {
+        if (*format != '%') {
+            output += *format++;
+            continue;
+        }
+
+        // flags, width and precision are copied as they are, with any * filled in
+        std::string spec = "%";
+        format++;
+
+        while (*format && strchr("-+ #0", *format)) {
+            spec += *format++;
+        }
+
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*format != '.') {
+                    break;
+                }
+
+                spec += *format++;
+            }
+
+            if (*format == '*') {
+                spec += std::to_string(static_cast<int>(argument()));
+                format++;
+            }
+
+            while (*format >= '0' && *format <= '9') {
+                spec += *format++;
+            }
+        }
+
+        int size = 0;   // -2 hh, -1 h, 0 int, 1 long and up
+        while (*format && strchr("hlzjt", *format)) {
+            size += (*format == 'h') ? -1 : 1;
+            format++;
+        }
+
+        char buffer[128];
+        auto conversion = *format;
+        if (conversion) {
+            format++;
+        }
+
+        switch (conversion) {
+        case '%':
+            output += '%';
+            break;
+
+        case 'd':
+        case 'i': {
+            auto word = argument();
+            long long value = (size <= -2) ? static_cast<signed char>(word) : (size == -1) ? static_cast<short>(word) :
+                (size == 0) ? static_cast<int>(word) : static_cast<long long>(word);
+            snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), value);
+            output += buffer;
+            break;
+        }
+
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o': {
+            auto word = argument();
+            unsigned long long value = (size <= -2) ? static_cast<unsigned char>(word) : (size == -1) ? static_cast<unsigned short>(word) :
+                (size == 0) ? static_cast<unsigned int>(word) : word;
+            snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), value);
+            output += buffer;
+            break;
+        }
+
+        case 'b': {
+            // the kernel's printf has it, the host's doesn't
+            auto value = argument();
+            if (size <= 0) {
+                value &= 0xffffffff;
+            }
+
+            std::string digits;
+            do {
+                digits.insert(digits.begin(), static_cast<char>('0' + (value & 1)));
+                value >>= 1;
+            } while (value);
+
+            output += digits;
+            break;
+        }
+
+        case 'c':
+            snprintf(buffer, sizeof(buffer), (spec + 'c').c_str(), static_cast<unsigned char>(argument()));
+            output += buffer;
+            break;
+
+        case 's': {
+            auto value = stringAt(image, argument());
+            std::vector<char> formatted(value.size() + 64);
+            snprintf(formatted.data(), formatted.size(), (spec + 's').c_str(), value.c_str());
+            output += formatted.data();
+            break;
+        }
+
+        case 'p':
+            snprintf(buffer, sizeof(buffer), "0x%016llx", static_cast<unsigned long long>(argument()));
+            output += buffer;
+            break;
+
+        default:
+            output += spec;
+            if (conversion) {
+                output += conversion;
+            }
+            break;
+        }
+    }
+
+    return output;
+}
+
+// Returns how many bytes the frame at data took, or 0 if it doesn't look like one.
+size_t decodeFrame(const Image& image, const char* data, size_t available, bool locations)
+{
+    klog::FrameHeader header;
+
+    if (available < sizeof(header)) {
+        return 0;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    auto length = sizeof(header) + header.count * sizeof(uint64_t);
+
+    if (header.magic != klog::FRAME_MAGIC || header.level >= sizeof(LEVEL_TAGS) || header.count > MAX_ARGUMENTS ||
+        header.format == 0 || header.format >= image.formats.size || length > available) {
+        return 0;
+    }
+
+    // the entry is "file:line\0format\0"
+    auto location = image.formats.data + header.format;
+    auto locationEnd = static_cast<const char*>(memchr(location, 0, image.formats.size - header.format));
+    if (!locationEnd || locationEnd + 1 >= image.formats.data + image.formats.size) {
+        return 0;
+    }
+
+    uint64_t arguments[MAX_ARGUMENTS];
+    memcpy(arguments, data + sizeof(header), header.count * sizeof(uint64_t));
+
+    auto text = formatRecord(image, locationEnd + 1, arguments, header.count);
+
+    printf("[%5lu.%06lu] %u %c ", static_cast<unsigned long>(header.timestamp / 1'000'000'000),
+        static_cast<unsigned long>(header.timestamp / 1'000 % 1'000'000), unsigned(header.cpu), LEVEL_TAGS[header.level]);
+
+    if (locations) {
+        printf("%s: ", location);
+    }
+
+    fputs(text.c_str(), stdout);
+
+    if (text.empty() || text.back() != '\n') {
+        putchar('\n');
+    }
+
+    return length;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bool locations = false;
+    int first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-l") == 0) {
+        locations = true;
+        first++;
+    }
+
+    if (argc - first < 1 || argc - first > 2) {
+        fprintf(stderr, "usage: %s [-l] kernel.elf [serial capture]\n", argv[0]);
+        return 2;
+    }
+
+    Image image;
+    if (!loadImage(argv[first], image)) {
+        return 1;
+    }
+
+    auto input = (argc - first == 2) ? fopen(argv[first + 1], "rb") : stdin;
+    if (!input) {
+        perror(argv[first + 1]);
+        return 1;
+    }
+
+    std::vector<char> capture;
+    if (!readFile(input, capture)) {
+        perror("read");
+        return 1;
+    }
+
+    for (size_t i = 0; i < capture.size();) {
+        auto length = (static_cast<uint8_t>(capture[i]) == klog::FRAME_MAGIC) ?
+            decodeFrame(image, capture.data() + i, capture.size() - i, locations) : 0;
+
+        if (length > 0) {
+            i += length;
+        } else {
+            putchar(capture[i++]);
+        }
+    }
+
+    return 0;
+}